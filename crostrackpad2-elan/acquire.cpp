@@ -0,0 +1,159 @@
+#include <ntddk.h>
+#include <wdf.h>
+#include "acquire.h"
+
+VOID
+ElanAcquireStart(
+	IN ELAN_ACQUISITION *Acq,
+	IN ULONGLONG Now
+	)
+/*++
+
+Routine Description:
+
+This routine picks the frame source once the interrupt is connected.
+The timer stays the source; when interrupts were asked for, the line's
+self-test starts, and ElanAcquireRecordFrame switches to the line once
+it passes. Called with PollLock held.
+
+Arguments:
+
+Acq - the acquisition state
+Now - the interrupt time, in 100ns units
+
+Return Value:
+
+None
+
+--*/
+{
+	Acq->Source = ELAN_ACQUIRE_TIMER;
+	Acq->InterruptSeen = FALSE;
+	Acq->MissedStreak = 0;
+
+	if (!Acq->InterruptRequested)
+	{
+		Acq->SelfTest = ELAN_SELFTEST_NOT_RUN;
+		return;
+	}
+
+	Acq->SelfTest = ELAN_SELFTEST_RUNNING;
+	Acq->SelfTestEnd = Now + ELAN_SELFTEST_MS * 10000ULL;
+	Acq->SelfTestSpurious = Acq->SpuriousInterrupts;
+}
+
+BOOLEAN
+ElanAcquireOnInterrupt(
+	IN ELAN_ACQUISITION *Acq,
+	OUT BOOLEAN *DisableLine
+	)
+/*++
+
+Routine Description:
+
+This routine decides what the ISR does with an edge. The frame is read
+while the line is the source or under test; otherwise the edge is
+ignored, and a line that failed is to be switched off.
+
+Arguments:
+
+Acq         - the acquisition state
+DisableLine - Receives TRUE when the line failed and should be disabled
+
+Return Value:
+
+TRUE when the ISR should read a frame as ELAN_ACQUIRE_INTERRUPT
+
+--*/
+{
+	*DisableLine = FALSE;
+
+	if (Acq->Source == ELAN_ACQUIRE_INTERRUPT || Acq->SelfTest == ELAN_SELFTEST_RUNNING)
+		return TRUE;
+
+	*DisableLine = Acq->SelfTest == ELAN_SELFTEST_STUCK_LINE ||
+		Acq->SelfTest == ELAN_SELFTEST_DEAD_LINE;
+	return FALSE;
+}
+
+BOOLEAN
+ElanAcquireRecordFrame(
+	IN ELAN_ACQUISITION *Acq,
+	IN ULONG Source,
+	IN BOOLEAN ValidFrame,
+	IN ULONGLONG Now
+	)
+/*++
+
+Routine Description:
+
+This routine counts a processed frame against the interrupt line and
+moves the self-test on. Interrupt reads that find nothing are
+spurious; timer polls that find a frame the line never signalled are
+missed interrupts. The self-test ends at the first frame processed
+after ELAN_SELFTEST_MS, or early on a storm. Called with PollLock held.
+
+Arguments:
+
+Acq        - the acquisition state
+Source     - ELAN_ACQUIRE_TIMER for polls, ELAN_ACQUIRE_INTERRUPT when
+             the interrupt line signalled the frame
+ValidFrame - the read returned a valid report
+Now        - the interrupt time, in 100ns units
+
+Return Value:
+
+TRUE when the line was just given up on and should be disabled
+
+--*/
+{
+	BOOLEAN giveUp = FALSE;
+
+	if (Source == ELAN_ACQUIRE_INTERRUPT)
+	{
+		Acq->Interrupts++;
+		Acq->InterruptSeen = TRUE;
+		Acq->MissedStreak = 0;
+		if (!ValidFrame)
+			Acq->SpuriousInterrupts++;
+	}
+	else if (Acq->Source == ELAN_ACQUIRE_INTERRUPT)
+	{
+		//
+		// The pad only has a frame for us while it asserts the line
+		//
+		if (ValidFrame && !Acq->InterruptSeen)
+		{
+			Acq->MissedInterrupts++;
+			if (++Acq->MissedStreak >= ELAN_MISSED_INTERRUPT_LIMIT)
+			{
+				Acq->Source = ELAN_ACQUIRE_TIMER;
+				Acq->SelfTest = ELAN_SELFTEST_DEAD_LINE;
+				giveUp = TRUE;
+			}
+		}
+		Acq->InterruptSeen = FALSE;
+	}
+
+	if (Acq->SelfTest == ELAN_SELFTEST_RUNNING)
+	{
+		//
+		// Timer polls can take a frame before the edge is serviced, so
+		// a working line shows a few spurious interrupts too
+		//
+		if (Acq->SpuriousInterrupts - Acq->SelfTestSpurious > ELAN_SELFTEST_SPURIOUS_LIMIT)
+		{
+			Acq->SelfTest = ELAN_SELFTEST_STUCK_LINE;
+			giveUp = TRUE;
+		}
+		else if (Now >= Acq->SelfTestEnd)
+		{
+			Acq->SelfTest = ELAN_SELFTEST_PASSED;
+			Acq->Source = ELAN_ACQUIRE_INTERRUPT;
+			Acq->InterruptSeen = FALSE;
+			Acq->MissedStreak = 0;
+		}
+	}
+
+	return giveUp;
+}
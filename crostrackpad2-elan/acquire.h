@@ -0,0 +1,105 @@
+#ifndef _ACQUIRE_H_
+#define _ACQUIRE_H_
+
+//
+// Frame acquisition. Every frame is processed at PASSIVE_LEVEL under
+// PollLock, and read synchronously by ElanAcquireFrame unless the
+// timer pipelines its reads (see ELAN_FRAME_PIPELINE); sources only
+// differ in what calls it. The timer source polls on the scheduler's
+// intervals.
+// The interrupt source reads from the passive-level ISR on the GPIO
+// edge and keeps the timer only to age gestures after a lift and as a
+// watchdog for a dead line. A simulated source just calls
+// ElanAcquireFrame on its own schedule.
+//
+// Which source is used, and when the line is given up on, is decided
+// here without WDF, so that the host can drive it with a simulated
+// line. The driver only has to read the frames it is told to and
+// disable a line it is told to.
+//
+
+#include "elanioctl.h"
+
+enum elan_acquisition {
+	ELAN_ACQUIRE_TIMER = 0,
+	ELAN_ACQUIRE_INTERRUPT
+};
+
+//
+// The self-test watches the line for ELAN_SELFTEST_MS with the pad
+// expected to be quiet, while the timer keeps polling; more than
+// ELAN_SELFTEST_SPURIOUS_LIMIT interrupts with nothing to read means
+// the line is stuck. Timer polls that find ELAN_MISSED_INTERRUPT_LIMIT
+// frames in a row the line never signalled mean it died; with contacts
+// down they run every ActiveMs.
+//
+
+#define ELAN_SELFTEST_MS                50
+#define ELAN_SELFTEST_SPURIOUS_LIMIT    10
+#define ELAN_MISSED_INTERRUPT_LIMIT     3
+
+typedef struct _ELAN_ACQUISITION
+{
+	ULONG Source;
+
+	//
+	// ConnectInterrupt setting, and the result of the interrupt line
+	// self-test (ELAN_SELFTEST_*)
+	//
+
+	BOOLEAN InterruptRequested;
+	ULONG SelfTest;
+
+	//
+	// While the self-test runs: when it ends, in 100ns interrupt time,
+	// and SpuriousInterrupts when it started
+	//
+
+	ULONGLONG SelfTestEnd;
+	ULONGLONG SelfTestSpurious;
+
+	//
+	// An interrupt read a frame since the last timer poll. Timer polls
+	// that find a frame the line never signalled count as missed; after
+	// ELAN_MISSED_INTERRUPT_LIMIT in a row the line is given up on.
+	//
+
+	BOOLEAN InterruptSeen;
+	ULONG MissedStreak;
+
+	//
+	// A line given up on is disabled so it can't keep the ISR busy, by
+	// LineWorkItem when that happens under PollLock or in the ISR. The
+	// framework enables it again on the next D0 entry, for the
+	// self-test; LineDisabled only keeps it from being disabled twice.
+	//
+
+	WDFWORKITEM LineWorkItem;
+	BOOLEAN LineDisabled;
+
+	ULONGLONG Interrupts;
+	ULONGLONG SpuriousInterrupts;
+	ULONGLONG MissedInterrupts;
+} ELAN_ACQUISITION;
+
+VOID
+ElanAcquireStart(
+	IN ELAN_ACQUISITION *Acq,
+	IN ULONGLONG Now
+	);
+
+BOOLEAN
+ElanAcquireOnInterrupt(
+	IN ELAN_ACQUISITION *Acq,
+	OUT BOOLEAN *DisableLine
+	);
+
+BOOLEAN
+ElanAcquireRecordFrame(
+	IN ELAN_ACQUISITION *Acq,
+	IN ULONG Source,
+	IN BOOLEAN ValidFrame,
+	IN ULONGLONG Now
+	);
+
+#endif
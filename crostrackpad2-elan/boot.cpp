@@ -0,0 +1,168 @@
+#include <ntddk.h>
+#include <wdf.h>
+#include "elandebug.h"
+#include "boot.h"
+
+static ULONG ElanPrintDebugLevel = 100;
+static ULONG ElanPrintDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+#define INFO(field) ((USHORT)FIELD_OFFSET(ELAN_DEVICE_INFO, field))
+
+//
+// Reads of each step that fetches data. Registers grouped in one table
+// go out as one SPB sequence, so none of them may depend on another.
+//
+
+static const ELAN_BOOT_READ ElanBootResetAck[] = {
+	{ 0x00, ETP_I2C_INF_LENGTH, INFO(ResetAck) },
+};
+
+static const ELAN_BOOT_READ ElanBootDescriptors[] = {
+	{ ETP_I2C_DESC_CMD, ETP_I2C_DESC_LENGTH, INFO(Descriptor) },
+	{ ETP_I2C_REPORT_DESC_CMD, ETP_I2C_REPORT_DESC_LENGTH, INFO(ReportDescriptor) },
+};
+
+static const ELAN_BOOT_READ ElanBootIdentity[] = {
+	{ ETP_I2C_UNIQUEID_CMD, ETP_I2C_INF_LENGTH, INFO(UniqueId) },
+	{ ETP_I2C_FW_VERSION_CMD, ETP_I2C_INF_LENGTH, INFO(FwVersion) },
+	{ ETP_I2C_FW_CHECKSUM_CMD, ETP_I2C_INF_LENGTH, INFO(FwChecksum) },
+	{ ETP_I2C_SM_VERSION_CMD, ETP_I2C_INF_LENGTH, INFO(SmVersion) },
+	{ ETP_I2C_IAP_VERSION_CMD, ETP_I2C_INF_LENGTH, INFO(IapVersion) },
+	{ ETP_I2C_PRESSURE_CMD, ETP_I2C_INF_LENGTH, INFO(Pressure) },
+	{ ETP_I2C_MAX_X_AXIS_CMD, ETP_I2C_INF_LENGTH, INFO(MaxX) },
+	{ ETP_I2C_MAX_Y_AXIS_CMD, ETP_I2C_INF_LENGTH, INFO(MaxY) },
+	{ ETP_I2C_XY_TRACENUM_CMD, ETP_I2C_INF_LENGTH, INFO(XTraces) },
+};
+
+static const ELAN_BOOT_READ ElanBootCalibrate[] = {
+	{ ETP_I2C_CALIBRATE_CMD, 1, INFO(Calibrate) },
+};
+
+#define READS(table) RTL_NUMBER_OF(table), table
+
+//
+// Reset, fetch the descriptors, switch to absolute mode and read the
+// identity and geometry, then calibrate and go back to absolute mode.
+// The pad is only usable once it was reset, woken and told its
+// geometry.
+//
+
+static const ELAN_BOOT_STEP ElanBootScript[] = {
+	{ ELAN_BOOT_WRITE, ELAN_BOOT_REQUIRED, ETP_I2C_STAND_CMD, ETP_I2C_RESET },
+	{ ELAN_BOOT_READ8, 0, 0, 0, READS(ElanBootResetAck) },
+	{ ELAN_BOOT_READ16, 0, 0, 0, READS(ElanBootDescriptors) },
+	{ ELAN_BOOT_WRITE, 0, ETP_I2C_SET_CMD, ETP_ENABLE_ABS },
+	{ ELAN_BOOT_WRITE, ELAN_BOOT_REQUIRED, ETP_I2C_STAND_CMD, ETP_I2C_WAKE_UP },
+	{ ELAN_BOOT_READ16, ELAN_BOOT_REQUIRED, 0, 0, READS(ElanBootIdentity) },
+	{ ELAN_BOOT_WRITE, 0, ETP_I2C_SET_CMD, ETP_ENABLE_CALIBRATE | ETP_ENABLE_ABS },
+	{ ELAN_BOOT_WRITE, ELAN_BOOT_REQUIRED, ETP_I2C_STAND_CMD, ETP_I2C_WAKE_UP },
+	{ ELAN_BOOT_WRITE, 0, ETP_I2C_CALIBRATE_CMD, 1 },
+	{ ELAN_BOOT_READ16, 0, 0, 0, READS(ElanBootCalibrate) },
+	{ ELAN_BOOT_WRITE, 0, ETP_I2C_SET_CMD, ETP_ENABLE_ABS },
+};
+
+C_ASSERT(RTL_NUMBER_OF(ElanBootScript) <= ELAN_BOOT_STEPS_MAX);
+C_ASSERT(RTL_NUMBER_OF(ElanBootIdentity) <= SPB_READ_BATCH_MAX);
+C_ASSERT(RTL_NUMBER_OF(ElanBootDescriptors) <= SPB_READ_BATCH_MAX);
+
+static
+NTSTATUS
+ElanRunBootStep(
+	IN SPB_CONTEXT *SpbContext,
+	IN const ELAN_BOOT_STEP *Step,
+	OUT ELAN_DEVICE_INFO *Info
+	)
+{
+	SPB_READ_BATCH_ENTRY entries[SPB_READ_BATCH_MAX];
+	const ELAN_BOOT_READ *read;
+	uint16_t value;
+
+	switch (Step->Op)
+	{
+	case ELAN_BOOT_WRITE:
+		value = Step->Value;
+		return SpbWriteDataSynchronously16(SpbContext, Step->Register, &value, sizeof(value));
+
+	case ELAN_BOOT_READ8:
+		read = &Step->Reads[0];
+		return SpbReadDataSynchronously(SpbContext, (UCHAR)read->Register,
+			(PUCHAR)Info + read->Offset, read->Length);
+
+	case ELAN_BOOT_READ16:
+		for (ULONG i = 0; i < Step->ReadCount; i++)
+		{
+			read = &Step->Reads[i];
+			entries[i].Address = read->Register;
+			entries[i].Data = (PUCHAR)Info + read->Offset;
+			entries[i].Length = read->Length;
+		}
+		return SpbReadBatchSynchronously16(SpbContext, entries, Step->ReadCount);
+	}
+
+	return STATUS_INVALID_PARAMETER;
+}
+
+NTSTATUS
+ElanRunBootScript(
+	IN SPB_CONTEXT *SpbContext,
+	OUT ELAN_DEVICE_INFO *Info,
+	OUT ELAN_BOOT_TIMING *Timing
+	)
+/*++
+
+Routine Description:
+
+This routine runs the boot script against the trackpad, one bus
+transaction per step, and times each step. A failed step is logged
+and the script carries on, since later commands still bring up a part
+that answered some queries wrong. Unlike the command sequence it
+replaced, a failed ELAN_BOOT_REQUIRED step fails the boot.
+
+Arguments:
+
+SpbContext - the trackpad's bus
+Info       - Receives the replies; fields whose read failed are zero
+Timing     - Receives the cost of each step
+
+Return Value:
+
+STATUS_SUCCESS, or the status of the first required step that failed
+
+--*/
+{
+	NTSTATUS result = STATUS_SUCCESS;
+	LARGE_INTEGER start;
+	LARGE_INTEGER now;
+	NTSTATUS status;
+
+	RtlZeroMemory(Info, sizeof(ELAN_DEVICE_INFO));
+
+	Timing->Boots++;
+	Timing->Steps = RTL_NUMBER_OF(ElanBootScript);
+	Timing->FailedSteps = 0;
+	Timing->Ticks = 0;
+
+	start = KeQueryPerformanceCounter(NULL);
+
+	for (ULONG i = 0; i < RTL_NUMBER_OF(ElanBootScript); i++)
+	{
+		status = ElanRunBootStep(SpbContext, &ElanBootScript[i], Info);
+
+		now = KeQueryPerformanceCounter(NULL);
+		Timing->StepTicks[i] = now.QuadPart - start.QuadPart;
+		Timing->Ticks += Timing->StepTicks[i];
+		start = now;
+
+		if (!NT_SUCCESS(status))
+		{
+			ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+				"Boot step %d failed - %!STATUS!\n", i, status);
+
+			Timing->FailedSteps++;
+			if ((ElanBootScript[i].Flags & ELAN_BOOT_REQUIRED) && NT_SUCCESS(result))
+				result = status;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,98 @@
+#ifndef _BOOT_H_
+#define _BOOT_H_
+
+#include "spb.h"
+#include "elantp.h"
+
+//
+// Replies BOOTTRACKPAD collects from the trackpad, as read off the bus.
+// The boot script reads each register straight into its field.
+//
+
+typedef struct _ELAN_DEVICE_INFO
+{
+	uint8_t ResetAck[ETP_I2C_INF_LENGTH];
+	uint8_t Descriptor[ETP_I2C_DESC_LENGTH];
+	uint8_t ReportDescriptor[ETP_I2C_REPORT_DESC_LENGTH];
+
+	// Low byte of UniqueId is the product ID
+	uint16_t UniqueId;
+	uint16_t FwVersion;
+	uint16_t FwChecksum;
+	uint16_t SmVersion;
+	uint16_t IapVersion;
+	uint16_t Pressure;
+
+	// Axis maxima are in the low 12 bits
+	uint16_t MaxX;
+	uint16_t MaxY;
+
+	// XY_TRACENUM: sensor traces along each axis
+	uint8_t XTraces;
+	uint8_t YTraces;
+
+	uint8_t Calibrate;
+} ELAN_DEVICE_INFO;
+
+//
+// A boot script is a table of steps, each one bus transaction: a
+// command write, or a set of register reads that don't depend on each
+// other and go out as a single SPB sequence.
+//
+
+enum elan_boot_op {
+	ELAN_BOOT_WRITE = 0,	// 16-bit Value to 16-bit Register
+	ELAN_BOOT_READ16,	// Reads with 16-bit register addresses
+	ELAN_BOOT_READ8		// One read with an 8-bit register address
+};
+
+typedef struct _ELAN_BOOT_READ
+{
+	UINT16 Register;
+	USHORT Length;
+
+	// Where the reply lands in ELAN_DEVICE_INFO
+	USHORT Offset;
+} ELAN_BOOT_READ;
+
+//
+// Steps the pad can't work without; when one fails, the boot fails
+//
+
+#define ELAN_BOOT_REQUIRED      0x01
+
+typedef struct _ELAN_BOOT_STEP
+{
+	enum elan_boot_op Op;
+	ULONG Flags;
+	UINT16 Register;
+	UINT16 Value;
+
+	ULONG ReadCount;
+	const ELAN_BOOT_READ *Reads;
+} ELAN_BOOT_STEP;
+
+#define ELAN_BOOT_STEPS_MAX     16
+
+//
+// Cost of the last boot, in KeQueryPerformanceCounter() ticks, per step
+// and in total, and the steps whose transaction failed
+//
+
+typedef struct _ELAN_BOOT_TIMING
+{
+	ULONG Boots;
+	ULONG Steps;
+	ULONG FailedSteps;
+	ULONGLONG Ticks;
+	ULONGLONG StepTicks[ELAN_BOOT_STEPS_MAX];
+} ELAN_BOOT_TIMING;
+
+NTSTATUS
+ElanRunBootScript(
+	IN SPB_CONTEXT *SpbContext,
+	OUT ELAN_DEVICE_INFO *Info,
+	OUT ELAN_BOOT_TIMING *Timing
+	);
+
+#endif
@@ -0,0 +1,200 @@
+#include "internal.h"
+#include "hiddevice.h"
+#include "capture.h"
+
+static ULONG ElanPrintDebugLevel = 100;
+static ULONG ElanPrintDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+C_ASSERT(ELAN_CAPTURE_REPORT_LEN == ETP_MAX_REPORT_LEN);
+C_ASSERT(sizeof(ELAN_CAPTURE_RECORD) % sizeof(ULONGLONG) == 0);
+
+NTSTATUS
+ElanCaptureInitialize(
+	IN WDFDEVICE FxDevice,
+	IN ELAN_CAPTURE_RING *Ring,
+	IN ULONG Capacity
+	)
+/*++
+
+Routine Description:
+
+This routine allocates the raw report capture ring.
+
+Arguments:
+
+FxDevice - Handle to the framework device object
+Ring     - The capture ring to initialize
+Capacity - Number of records the ring holds, 0 leaves capture disabled
+
+Return Value:
+
+NTSTATUS Status indicating success or failure
+
+--*/
+{
+	WDF_OBJECT_ATTRIBUTES attributes;
+	NTSTATUS status;
+
+	RtlZeroMemory(Ring, sizeof(*Ring));
+
+	if (Capacity == 0)
+		return STATUS_SUCCESS;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = FxDevice;
+
+	status = WdfMemoryCreate(
+		&attributes,
+		NonPagedPool,
+		CYAPA_POOL_TAG,
+		Capacity * sizeof(ELAN_CAPTURE_RECORD),
+		&Ring->Memory,
+		(PVOID *)&Ring->Records);
+
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(
+			DEBUG_LEVEL_ERROR,
+			DBG_PNP,
+			"Error allocating capture ring - %!STATUS!",
+			status);
+		goto exit;
+	}
+
+	status = WdfSpinLockCreate(&attributes, &Ring->Lock);
+
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(
+			DEBUG_LEVEL_ERROR,
+			DBG_PNP,
+			"Error creating capture ring lock - %!STATUS!",
+			status);
+		goto exit;
+	}
+
+	Ring->Capacity = Capacity;
+
+exit:
+
+	if (!NT_SUCCESS(status) && Ring->Memory != NULL)
+	{
+		WdfObjectDelete(Ring->Memory);
+		Ring->Memory = NULL;
+		Ring->Records = NULL;
+	}
+
+	return status;
+}
+
+VOID
+ElanCaptureReport(
+	IN ELAN_CAPTURE_RING *Ring,
+	IN uint8_t *Report,
+	IN int IntervalMs,
+	IN ULONG OutputDigest,
+	IN int OutputCount
+	)
+{
+	ELAN_CAPTURE_RECORD *record;
+
+	if (Ring->Capacity == 0)
+		return;
+
+	WdfSpinLockAcquire(Ring->Lock);
+
+	record = &Ring->Records[Ring->Head];
+	record->Timestamp = KeQueryInterruptTime();
+	record->IntervalMs = IntervalMs;
+	record->OutputDigest = OutputDigest;
+	record->OutputCount = (UCHAR)OutputCount;
+	RtlCopyMemory(record->Report, Report, ELAN_CAPTURE_REPORT_LEN);
+
+	Ring->Head = (Ring->Head + 1) % Ring->Capacity;
+	if (Ring->Count < Ring->Capacity)
+		Ring->Count++;
+	else
+		Ring->Overwritten++;
+
+	WdfSpinLockRelease(Ring->Lock);
+}
+
+NTSTATUS
+ElanReadCapture(
+	IN ELAN_CAPTURE_RING *Ring,
+	IN WDFREQUEST Request,
+	OUT size_t *BytesReturned
+	)
+/*++
+
+Routine Description:
+
+This routine drains the oldest records of the capture ring into the
+output buffer of an IOCTL_ELAN_READ_CAPTURE request, behind an
+ELAN_CAPTURE_HEADER.
+
+Arguments:
+
+Ring          - The capture ring
+Request       - Handle to the IOCTL request
+BytesReturned - Receives the number of bytes written to the output buffer
+
+Return Value:
+
+NTSTATUS Status indicating success or failure
+
+--*/
+{
+	ELAN_CAPTURE_HEADER *header;
+	ELAN_CAPTURE_RECORD *records;
+	size_t bufferLength;
+	ULONG toCopy, tail;
+	NTSTATUS status;
+
+	*BytesReturned = 0;
+
+	if (Ring->Capacity == 0)
+		return STATUS_DEVICE_NOT_READY;
+
+	status = WdfRequestRetrieveOutputBuffer(Request,
+		sizeof(ELAN_CAPTURE_HEADER),
+		(PVOID *)&header,
+		&bufferLength);
+
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+			"ElanReadCapture WdfRequestRetrieveOutputBuffer failed 0x%x\n", status);
+		return status;
+	}
+
+	records = (ELAN_CAPTURE_RECORD *)(header + 1);
+
+	WdfSpinLockAcquire(Ring->Lock);
+
+	toCopy = (ULONG)min((bufferLength - sizeof(ELAN_CAPTURE_HEADER)) / sizeof(ELAN_CAPTURE_RECORD),
+		Ring->Count);
+
+	tail = (Ring->Head + Ring->Capacity - Ring->Count) % Ring->Capacity;
+	for (ULONG i = 0; i < toCopy; i++)
+	{
+		records[i] = Ring->Records[tail];
+		tail = (tail + 1) % Ring->Capacity;
+	}
+	Ring->Count -= toCopy;
+
+	header->Magic = ELAN_CAPTURE_MAGIC;
+	header->Version = ELAN_CAPTURE_VERSION;
+	header->HeaderSize = sizeof(ELAN_CAPTURE_HEADER);
+	header->RecordSize = sizeof(ELAN_CAPTURE_RECORD);
+	header->RecordCount = toCopy;
+	header->TimestampFrequency = 10000000;
+	header->Overwritten = Ring->Overwritten;
+	Ring->Overwritten = 0;
+
+	WdfSpinLockRelease(Ring->Lock);
+
+	*BytesReturned = sizeof(ELAN_CAPTURE_HEADER) + toCopy * sizeof(ELAN_CAPTURE_RECORD);
+
+	return STATUS_SUCCESS;
+}
@@ -0,0 +1,51 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include "elanioctl.h"
+
+//
+// Ring of raw reports as they were handed to the gesture engine.
+// Allocated only when the CaptureRecords setting is non-zero; the
+// oldest record is overwritten once the ring is full.
+//
+
+// 64K records is about 4MB of nonpaged pool, well past any useful capture
+#define ELAN_CAPTURE_MAX_RECORDS    0x10000
+
+typedef struct _ELAN_CAPTURE_RING
+{
+	WDFMEMORY Memory;
+	ELAN_CAPTURE_RECORD *Records;
+	ULONG Capacity;
+
+	ULONG Head;
+	ULONG Count;
+	ULONGLONG Overwritten;
+
+	WDFSPINLOCK Lock;
+} ELAN_CAPTURE_RING;
+
+NTSTATUS
+ElanCaptureInitialize(
+	IN WDFDEVICE FxDevice,
+	IN ELAN_CAPTURE_RING *Ring,
+	IN ULONG Capacity
+	);
+
+VOID
+ElanCaptureReport(
+	IN ELAN_CAPTURE_RING *Ring,
+	IN uint8_t *Report,
+	IN int IntervalMs,
+	IN ULONG OutputDigest,
+	IN int OutputCount
+	);
+
+NTSTATUS
+ElanReadCapture(
+	IN ELAN_CAPTURE_RING *Ring,
+	IN WDFREQUEST Request,
+	OUT size_t *BytesReturned
+	);
+
+#endif
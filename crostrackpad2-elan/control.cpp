@@ -0,0 +1,469 @@
+#include "internal.h"
+#include "driver.h"
+#include "hiddevice.h"
+#include "control.h"
+
+static ULONG ElanPrintDebugLevel = 100;
+static ULONG ElanPrintDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+C_ASSERT(ELAN_SPB_POOL_CLASSES == SPB_POOL_CLASSES);
+C_ASSERT(ELAN_BOOT_STEPS == ELAN_BOOT_STEPS_MAX);
+C_ASSERT(ELAN_SPB_TRACE_WRITE == SPB_TRACE_WRITE);
+C_ASSERT(ELAN_SPB_TRACE_READ == SPB_TRACE_READ);
+C_ASSERT(ELAN_SPB_TRACE_READ_BATCH == SPB_TRACE_READ_BATCH);
+C_ASSERT(ELAN_SPB_TRACE_ASYNC == SPB_TRACE_ASYNC);
+
+#define NT_DEVICE_NAME      L"\\Device\\ELANTP"
+#define DOS_DEVICE_NAME     L"\\DosDevices\\ELANTP"
+
+//
+// System and administrators only
+//
+DECLARE_CONST_UNICODE_STRING(ControlDeviceSddl, L"D:P(A;;GA;;;SY)(A;;GA;;;BA)");
+
+NTSTATUS
+ElanCreateControlDevice(
+	IN PDEVICE_CONTEXT pDevice
+	)
+/*++
+
+Routine Description:
+
+This routine creates the \\Device\\ELANTP control device and its
+\\DosDevices\\ELANTP symbolic link.
+
+Arguments:
+
+pDevice - the trackpad the control device reports on
+
+Return Value:
+
+Status
+
+--*/
+{
+	PWDFDEVICE_INIT deviceInit;
+	WDFDEVICE controlDevice;
+	WDF_OBJECT_ATTRIBUTES attributes;
+	WDF_IO_QUEUE_CONFIG queueConfig;
+	NTSTATUS status;
+
+	DECLARE_CONST_UNICODE_STRING(ntDeviceName, NT_DEVICE_NAME);
+	DECLARE_CONST_UNICODE_STRING(dosDeviceName, DOS_DEVICE_NAME);
+
+	deviceInit = WdfControlDeviceInitAllocate(
+		WdfDeviceGetDriver(pDevice->FxDevice),
+		&ControlDeviceSddl);
+
+	if (deviceInit == NULL)
+	{
+		status = STATUS_INSUFFICIENT_RESOURCES;
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"WdfControlDeviceInitAllocate failed\n");
+		return status;
+	}
+
+	WdfDeviceInitSetExclusive(deviceInit, FALSE);
+
+	status = WdfDeviceInitAssignName(deviceInit, &ntDeviceName);
+
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"WdfDeviceInitAssignName failed 0x%x\n", status);
+		WdfDeviceInitFree(deviceInit);
+		return status;
+	}
+
+	WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&attributes, CONTROL_DEVICE_CONTEXT);
+
+	status = WdfDeviceCreate(&deviceInit, &attributes, &controlDevice);
+
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"WdfDeviceCreate for control device failed 0x%x\n", status);
+		WdfDeviceInitFree(deviceInit);
+		return status;
+	}
+
+	GetControlDeviceContext(controlDevice)->Trackpad = pDevice;
+
+	status = WdfDeviceCreateSymbolicLink(controlDevice, &dosDeviceName);
+
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"WdfDeviceCreateSymbolicLink failed 0x%x\n", status);
+		goto exit;
+	}
+
+	WDF_IO_QUEUE_CONFIG_INIT_DEFAULT_QUEUE(
+		&queueConfig,
+		WdfIoQueueDispatchSequential);
+
+	queueConfig.EvtIoDeviceControl = OnControlIoDeviceControl;
+
+	status = WdfIoQueueCreate(
+		controlDevice,
+		&queueConfig,
+		WDF_NO_OBJECT_ATTRIBUTES,
+		WDF_NO_HANDLE);
+
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"WdfIoQueueCreate for control device failed 0x%x\n", status);
+		goto exit;
+	}
+
+	WdfControlFinishInitializing(controlDevice);
+
+	pDevice->ControlDevice = controlDevice;
+
+exit:
+
+	if (!NT_SUCCESS(status))
+	{
+		WdfObjectDelete(controlDevice);
+	}
+
+	return status;
+}
+
+VOID
+ElanDeleteControlDevice(
+	IN PDEVICE_CONTEXT pDevice
+	)
+{
+	if (pDevice->ControlDevice != NULL)
+	{
+		WdfObjectDelete(pDevice->ControlDevice);
+		pDevice->ControlDevice = NULL;
+	}
+}
+
+static
+NTSTATUS
+ElanReadStats(
+	IN PDEVICE_CONTEXT pDevice,
+	IN WDFREQUEST Request,
+	OUT size_t *BytesReturned
+	)
+/*++
+
+Routine Description:
+
+This routine snapshots the hot-path counters into the output buffer of
+an IOCTL_SIOCTL_METHOD_OUT_DIRECT request.
+
+Arguments:
+
+pDevice       - the trackpad to report on
+Request       - Handle to the IOCTL request
+BytesReturned - Receives the number of bytes written to the output buffer
+
+Return Value:
+
+NTSTATUS Status indicating success or failure
+
+--*/
+{
+	ELAN_PERF_COUNTERS *perf = &pDevice->Perf;
+	ELAN_STATS *stats;
+	NTSTATUS status;
+
+	*BytesReturned = 0;
+
+	status = WdfRequestRetrieveOutputBuffer(Request,
+		sizeof(ELAN_STATS),
+		(PVOID *)&stats,
+		NULL);
+
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+			"ElanReadStats WdfRequestRetrieveOutputBuffer failed 0x%x\n", status);
+		return status;
+	}
+
+	RtlZeroMemory(stats, sizeof(ELAN_STATS));
+	stats->Version = ELAN_STATS_VERSION;
+	stats->Size = sizeof(ELAN_STATS);
+	stats->PerformanceFrequency = perf->Frequency;
+
+	stats->FramesPolled = perf->FramesPolled;
+	stats->WorkItemOverlaps = perf->WorkItemOverlaps;
+
+	stats->EmptyFrames = perf->EmptyFrames;
+	stats->MalformedFrames = perf->MalformedFrames;
+	stats->SpbErrors = perf->SpbErrors;
+	stats->ReprocessedFrames = perf->ReprocessedFrames;
+
+	stats->ReportsEmitted = perf->ReportsEmitted;
+	stats->ReportsDropped = perf->ReportsDropped;
+	stats->KeyboardGestures = perf->KeyboardGestures;
+
+	stats->OverBudgetFrames = perf->OverBudgetFrames;
+
+	stats->SpbRead = perf->SpbRead;
+	stats->Decode = perf->Decode;
+	stats->Gesture = perf->Gesture;
+	stats->Frame = perf->Frame;
+
+	stats->PollState = pDevice->Poll.State;
+	stats->ActivePolls = perf->StatePolls[ELAN_POLL_ACTIVE];
+	stats->CooldownPolls = perf->StatePolls[ELAN_POLL_COOLDOWN];
+	stats->IdlePolls = perf->StatePolls[ELAN_POLL_IDLE];
+
+	stats->AcquisitionSource = pDevice->Acquisition.Source;
+	stats->SelfTest = pDevice->Acquisition.SelfTest;
+	stats->Interrupts = pDevice->Acquisition.Interrupts;
+	stats->SpuriousInterrupts = pDevice->Acquisition.SpuriousInterrupts;
+	stats->MissedInterrupts = pDevice->Acquisition.MissedInterrupts;
+
+	stats->UnchangedFrames = perf->UnchangedFrames;
+
+	stats->Pipelined = pDevice->Pipeline.Enabled;
+	stats->PipelinedReads = perf->PipelinedReads;
+	stats->OverlappedReads = perf->OverlappedReads;
+	stats->PipelineStalls = perf->PipelineStalls;
+
+	stats->HighResolutionTimer = pDevice->Poll.HighResolution;
+	stats->PollActiveMs = pDevice->Poll.ActiveMs;
+	stats->TimerFires = perf->TimerFires;
+	stats->TimerJitterTicks = perf->TimerJitterTicks;
+	stats->TimerMaxJitterTicks = perf->TimerMaxJitterTicks;
+	stats->ActiveIntervals = perf->ActiveIntervals;
+	stats->ActiveIntervalTicks = perf->ActiveIntervalTicks;
+
+	stats->PredictionMs = pDevice->sc.predictms;
+	stats->PredictionSamples = pDevice->sc.predictsamples;
+	stats->PredictionErrorSq = pDevice->sc.predicterrorsq;
+	stats->UnpredictedErrorSq = pDevice->sc.unpredictederrorsq;
+
+	stats->SequenceReads = pDevice->I2CContext.SequenceReads;
+	stats->SplitReads = pDevice->I2CContext.SplitReads;
+
+	for (int c = 0; c < SPB_POOL_CLASSES; c++)
+	{
+		SPB_POOL_CLASS *pool = &pDevice->I2CContext.Pool[c];
+
+		stats->SpbPool[c].BufferSize = pool->BufferSize;
+		stats->SpbPool[c].Buffers = SPB_POOL_BUFFERS;
+		stats->SpbPool[c].InUse = pool->InUse;
+		stats->SpbPool[c].HighWater = pool->HighWater;
+		stats->SpbPool[c].Acquired = pool->Acquired;
+		stats->SpbPool[c].Fallbacks = pool->Fallbacks;
+	}
+	stats->SpbPoolOversize = pDevice->I2CContext.PoolOversize;
+
+	stats->Boots = pDevice->Boot.Boots;
+	stats->BootSteps = pDevice->Boot.Steps;
+	stats->BootFailedSteps = pDevice->Boot.FailedSteps;
+	stats->BootTicks = pDevice->Boot.Ticks;
+	for (int i = 0; i < ELAN_BOOT_STEPS; i++)
+		stats->BootStepTicks[i] = pDevice->Boot.StepTicks[i];
+
+	stats->SpbNacks = pDevice->I2CContext.Errors[SPB_ERROR_NACK];
+	stats->SpbTimeouts = pDevice->I2CContext.Errors[SPB_ERROR_TIMEOUT];
+	stats->SpbShortReads = pDevice->I2CContext.Errors[SPB_ERROR_SHORT];
+	stats->SpbOtherErrors = pDevice->I2CContext.Errors[SPB_ERROR_OTHER];
+	stats->SpbRetries = pDevice->I2CContext.Retries;
+	stats->SpbRecovered = pDevice->I2CContext.Recovered;
+	stats->TrackpadResets = pDevice->Recovery.Resets;
+
+	*BytesReturned = sizeof(ELAN_STATS);
+
+	return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+ElanReadSpbTrace(
+	IN PDEVICE_CONTEXT pDevice,
+	IN WDFREQUEST Request,
+	OUT size_t *BytesReturned
+	)
+/*++
+
+Routine Description:
+
+This routine copies the bus transactions traced since the previous
+IOCTL_ELAN_READ_SPB_TRACE into its output buffer, behind an
+ELAN_SPB_TRACE_HEADER. The ring is written without a lock, so records
+are only copied once their writer has published them. Requests are
+handled one at a time by the sequential control queue, which makes
+this the only reader of ReadCursor.
+
+Arguments:
+
+pDevice       - the trackpad to report on
+Request       - Handle to the IOCTL request
+BytesReturned - Receives the number of bytes written to the output buffer
+
+Return Value:
+
+NTSTATUS Status indicating success or failure
+
+--*/
+{
+	SPB_CONTEXT *spb = &pDevice->I2CContext;
+	SPB_TRACE *trace = &spb->Trace;
+	ELAN_SPB_TRACE_HEADER *header;
+	ELAN_SPB_TRACE_RECORD *records;
+	SPB_TRACE_RECORD record;
+	size_t bufferLength;
+	ULONGLONG next, sequence, lost = 0;
+	ULONG capacity, count = 0;
+	NTSTATUS status;
+
+	*BytesReturned = 0;
+
+	if (!trace->Enabled)
+		return STATUS_DEVICE_NOT_READY;
+
+	status = WdfRequestRetrieveOutputBuffer(Request,
+		sizeof(ELAN_SPB_TRACE_HEADER),
+		(PVOID *)&header,
+		&bufferLength);
+
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+			"ElanReadSpbTrace WdfRequestRetrieveOutputBuffer failed 0x%x\n", status);
+		return status;
+	}
+
+	records = (ELAN_SPB_TRACE_RECORD *)(header + 1);
+	capacity = (ULONG)((bufferLength - sizeof(ELAN_SPB_TRACE_HEADER)) / sizeof(ELAN_SPB_TRACE_RECORD));
+
+	next = trace->Next;
+	sequence = trace->ReadCursor + 1;
+
+	//
+	// Skip what the ring no longer holds
+	//
+	if (next >= SPB_TRACE_RECORDS && sequence + SPB_TRACE_RECORDS <= next)
+	{
+		lost = next - SPB_TRACE_RECORDS + 1 - sequence;
+		sequence = next - SPB_TRACE_RECORDS + 1;
+	}
+
+	for (; sequence <= next && count < capacity; sequence++)
+	{
+		if (!SpbTraceGet(spb, sequence, &record))
+		{
+			//
+			// Overwritten while we copied, or still being written;
+			// the latter is picked up by the next read
+			//
+			if (trace->Next - sequence >= SPB_TRACE_RECORDS)
+			{
+				lost++;
+				continue;
+			}
+			break;
+		}
+
+		records[count].Sequence = sequence;
+		records[count].Timestamp = record.Timestamp;
+		records[count].WaitTicks = record.WaitTicks;
+		records[count].BusTicks = record.BusTicks;
+		records[count].Status = record.Status;
+		records[count].Length = record.Length;
+		records[count].Address = record.Address;
+		records[count].Type = record.Type;
+		records[count].Attempt = record.Attempt;
+		records[count].Reserved = 0;
+		count++;
+	}
+
+	trace->ReadCursor = sequence - 1;
+
+	header->Version = ELAN_SPB_TRACE_VERSION;
+	header->HeaderSize = sizeof(ELAN_SPB_TRACE_HEADER);
+	header->RecordSize = sizeof(ELAN_SPB_TRACE_RECORD);
+	header->RecordCount = count;
+	header->TimestampFrequency = pDevice->Perf.Frequency;
+	header->Transactions = trace->Next;
+	header->Lost = lost;
+
+	*BytesReturned = sizeof(ELAN_SPB_TRACE_HEADER) + count * sizeof(ELAN_SPB_TRACE_RECORD);
+
+	return STATUS_SUCCESS;
+}
+
+VOID
+OnControlIoDeviceControl(
+	_In_  WDFQUEUE    FxQueue,
+	_In_  WDFREQUEST  FxRequest,
+	_In_  size_t      OutputBufferLength,
+	_In_  size_t      InputBufferLength,
+	_In_  ULONG       IoControlCode
+	)
+/*++
+Routine Description:
+
+This event is called when a user-mode tool sends IRP_MJ_DEVICE_CONTROL
+to the control device.
+
+Arguments:
+
+FxQueue - Handle to the framework queue object that is associated
+with the I/O request.
+FxRequest - Handle to a framework request object.
+OutputBufferLength - length of the request's output buffer,
+if an output buffer is available.
+InputBufferLength - length of the request's input buffer,
+if an input buffer is available.
+IoControlCode - the driver-defined IOCTL that is associated with the request.
+
+Return Value:
+
+VOID
+
+--*/
+{
+	PDEVICE_CONTEXT pDevice;
+	size_t bytesReturned = 0;
+	NTSTATUS status;
+
+	UNREFERENCED_PARAMETER(OutputBufferLength);
+	UNREFERENCED_PARAMETER(InputBufferLength);
+
+	pDevice = GetControlDeviceContext(WdfIoQueueGetDevice(FxQueue))->Trackpad;
+
+	switch (IoControlCode)
+	{
+	case IOCTL_SIOCTL_METHOD_OUT_DIRECT:
+		status = ElanReadStats(pDevice, FxRequest, &bytesReturned);
+		break;
+
+	case IOCTL_ELAN_READ_CAPTURE:
+		status = ElanReadCapture(&pDevice->Capture, FxRequest, &bytesReturned);
+		break;
+
+	case IOCTL_ELAN_READ_LATENCY:
+		status = ElanReadLatency(&pDevice->Latency, FxRequest, &bytesReturned);
+		break;
+
+	case IOCTL_ELAN_READ_CONTACTS:
+		status = ElanReadContacts(&pDevice->Contacts, FxRequest, &bytesReturned);
+		break;
+
+	case IOCTL_ELAN_READ_SPB_TRACE:
+		status = ElanReadSpbTrace(pDevice, FxRequest, &bytesReturned);
+		break;
+
+	default:
+		status = STATUS_INVALID_DEVICE_REQUEST;
+		ElanPrint(
+			DEBUG_LEVEL_INFO, DBG_IOCTL,
+			"Control request %p received with unexpected IOCTL=%lu",
+			FxRequest,
+			IoControlCode);
+	}
+
+	WdfRequestCompleteWithInformation(FxRequest, status, bytesReturned);
+}
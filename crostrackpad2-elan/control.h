@@ -0,0 +1,28 @@
+#ifndef _CONTROL_H_
+#define _CONTROL_H_
+
+//
+// Control device used by user-mode diagnostics tools. HIDclass owns the
+// trackpad's own stack, so private IOCTLs can't reach us through it.
+//
+
+typedef struct _CONTROL_DEVICE_CONTEXT
+{
+	PDEVICE_CONTEXT Trackpad;
+} CONTROL_DEVICE_CONTEXT, *PCONTROL_DEVICE_CONTEXT;
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(CONTROL_DEVICE_CONTEXT, GetControlDeviceContext);
+
+NTSTATUS
+ElanCreateControlDevice(
+	IN PDEVICE_CONTEXT pDevice
+	);
+
+VOID
+ElanDeleteControlDevice(
+	IN PDEVICE_CONTEXT pDevice
+	);
+
+EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL   OnControlIoDeviceControl;
+
+#endif
@@ -1,5 +1,6 @@
 #include "internal.h"
 #include "device.h"
+#include "driver.h"
 #include "hiddevice.h"
 #include "spb.h"
 
@@ -120,6 +121,34 @@ Status
 			status);
 	}
 
+#ifdef ELAN_SIMULATOR
+	//
+	// Optionally talk to a register model instead of the bus
+	//
+
+	if (ElanQuerySetting(FxDevice, L"SimulatedTarget", 0) != 0)
+	{
+		ELAN_SIM_DEVICE *sim = &pDevice->Simulator;
+
+		ElanSimInitialize(sim);
+		sim->LatencyUs = ElanQuerySetting(FxDevice, L"SimLatencyUs", 0);
+		sim->LatencyUsPerByte = ElanQuerySetting(FxDevice, L"SimLatencyUsPerByte", 0);
+		sim->ErrorInterval = ElanQuerySetting(FxDevice, L"SimErrorInterval", 0);
+		if (ElanQuerySetting(FxDevice, L"SimShortReads", 0) != 0)
+			sim->ErrorStatus = STATUS_SUCCESS;
+		ElanSimRunScript(sim, ElanQuerySetting(FxDevice, L"SimScript", ELAN_SIM_SCRIPT_NONE));
+
+		ElanSimAttach(&pDevice->I2CContext, sim);
+	}
+#endif
+
+	pDevice->I2CContext.UseSequence =
+		ElanQuerySetting(FxDevice, L"CombinedReads", 1) != 0;
+	pDevice->I2CContext.RetryCount = min(SPB_RETRY_LIMIT,
+		ElanQuerySetting(FxDevice, L"BusRetries", ETP_RETRY_COUNT));
+	pDevice->I2CContext.Trace.Enabled =
+		ElanQuerySetting(FxDevice, L"SpbTrace", 1) != 0;
+
 	status = SpbTargetInitialize(FxDevice, &pDevice->I2CContext);
 	if (!NT_SUCCESS(status))
 	{
@@ -174,19 +203,86 @@ Status
 	return status;
 }
 
-bool IsElanLoaded(){
-	return deviceLoaded;
-}
+ULONG
+ElanQuerySetting(
+	IN WDFDEVICE FxDevice,
+	IN PCWSTR ValueName,
+	IN ULONG DefaultValue
+	)
+/*++
+
+Routine Description:
+
+This routine reads a DWORD from the Settings subkey of the device's
+hardware key, which the INF populates.
+
+Arguments:
+
+FxDevice     - a handle to the framework device object
+ValueName    - name of the value to read
+DefaultValue - returned if the key or value is missing
+
+Return Value:
+
+The setting
+
+--*/
+{
+	WDFKEY hwKey = NULL;
+	WDFKEY settingsKey = NULL;
+	UNICODE_STRING valueName;
+	ULONG value = DefaultValue;
+	NTSTATUS status;
+
+	DECLARE_CONST_UNICODE_STRING(settingsKeyName, L"Settings");
+
+	status = WdfDeviceOpenRegistryKey(FxDevice,
+		PLUGPLAY_REGKEY_DEVICE,
+		KEY_READ,
+		WDF_NO_OBJECT_ATTRIBUTES,
+		&hwKey);
+
+	if (!NT_SUCCESS(status))
+		goto exit;
+
+	status = WdfRegistryOpenKey(hwKey,
+		&settingsKeyName,
+		KEY_READ,
+		WDF_NO_OBJECT_ATTRIBUTES,
+		&settingsKey);
+
+	if (!NT_SUCCESS(status))
+		goto exit;
+
+	RtlInitUnicodeString(&valueName, ValueName);
 
-void elan_i2c_read_cmd(PDEVICE_CONTEXT pDevice, UINT16 reg, uint8_t *val) {
-	SpbReadDataSynchronously16(&pDevice->I2CContext, reg, val, ETP_I2C_INF_LENGTH);
+	status = WdfRegistryQueryULong(settingsKey, &valueName, &value);
+
+	if (!NT_SUCCESS(status))
+		value = DefaultValue;
+
+exit:
+
+	if (settingsKey != NULL)
+		WdfRegistryClose(settingsKey);
+
+	if (hwKey != NULL)
+		WdfRegistryClose(hwKey);
+
+	return value;
 }
 
-void elan_i2c_write_cmd(PDEVICE_CONTEXT pDevice, UINT16 reg, UINT16 cmd){
-	uint16_t buffer[] = { cmd };
-	SpbWriteDataSynchronously16(&pDevice->I2CContext, reg, (uint8_t *)buffer, sizeof(buffer));
+bool IsElanLoaded(){
+	return deviceLoaded;
 }
 
+//
+// Every caller holds PollLock, so that two boots never interleave on the
+// bus or in deviceLoaded, Info and Boot, and no synchronous frame read
+// runs in the middle of one. Pipelined reads are started by the timer
+// without PollLock, so they are held off with Pipeline.Booting and the
+// ones already queued are waited out first.
+//
 NTSTATUS BOOTTRACKPAD(
 	_In_  PDEVICE_CONTEXT  pDevice
 	)
@@ -198,72 +294,90 @@ NTSTATUS BOOTTRACKPAD(
 
 	FuncEntry(TRACE_FLAG_WDFLOADING);
 
-	elan_i2c_write_cmd(pDevice, ETP_I2C_STAND_CMD, ETP_I2C_RESET);
-	
-	uint8_t val[256];
-	SpbReadDataSynchronously(&pDevice->I2CContext, 0x00, &val, ETP_I2C_INF_LENGTH);
-
-	SpbReadDataSynchronously16(&pDevice->I2CContext, ETP_I2C_DESC_CMD, &val, ETP_I2C_DESC_LENGTH);
-
-	SpbReadDataSynchronously16(&pDevice->I2CContext, ETP_I2C_REPORT_DESC_CMD, &val, ETP_I2C_REPORT_DESC_LENGTH);
+	ELAN_DEVICE_INFO *info = &pDevice->Info;
 
-	elan_i2c_write_cmd(pDevice, ETP_I2C_SET_CMD, ETP_ENABLE_ABS);
+	InterlockedExchange(&pDevice->Pipeline.Booting, 1);
+	while (pDevice->Pipeline.Issuing != 0)
+		YieldProcessor();
+	SpbWaitForIdle(&pDevice->I2CContext);
 
-	elan_i2c_write_cmd(pDevice, ETP_I2C_STAND_CMD, ETP_I2C_WAKE_UP);
+	status = ElanRunBootScript(&pDevice->I2CContext, info, &pDevice->Boot);
 
-	uint8_t val2[3];
+	InterlockedExchange(&pDevice->Pipeline.Booting, 0);
 
-	elan_i2c_read_cmd(pDevice, ETP_I2C_UNIQUEID_CMD, val2);
-	uint8_t prodid = val2[0];
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Boot failed, %d of %d steps failed - %!STATUS!\n",
+			pDevice->Boot.FailedSteps, pDevice->Boot.Steps, status);
+		FuncExit(TRACE_FLAG_WDFLOADING);
+		return status;
+	}
 
-	elan_i2c_read_cmd(pDevice, ETP_I2C_FW_VERSION_CMD, val2);
-	uint8_t version = val2[0];
+	uint8_t prodid = info->UniqueId & 0xff;
+	uint8_t version = info->FwVersion & 0xff;
+	uint16_t csum = info->FwChecksum;
+	uint8_t smvers = info->SmVersion & 0xff;
+	uint8_t iapversion = info->IapVersion & 0xff;
+	uint16_t max_x = info->MaxX & 0x0fff;
+	uint16_t max_y = info->MaxY & 0x0fff;
 
-	elan_i2c_read_cmd(pDevice, ETP_I2C_FW_CHECKSUM_CMD, val2);
-	uint16_t csum = *((uint16_t *)val2);
+	csgesture_softc *sc = &pDevice->sc;
+	sc->resx = max_x;
+	sc->resy = max_y;
+	if (info->XTraces != 0 && info->YTraces != 0)
+	{
+		sc->phyx = max_x / info->XTraces;
+		sc->phyy = max_y / info->YTraces;
+	}
 
-	elan_i2c_read_cmd(pDevice, ETP_I2C_SM_VERSION_CMD, val2);
-	uint8_t smvers = val2[0];
+	ElanPrint(DEBUG_LEVEL_INFO, DBG_PNP, "[etp] ProdID: %d Vers: %d Csum: %d SmVers: %d IAPVers: %d Max X: %d Max Y: %d\n", prodid, version, csum, smvers, iapversion, max_x, max_y);
 
-	elan_i2c_read_cmd(pDevice, ETP_I2C_IAP_VERSION_CMD, val2);
-	uint8_t iapversion = val2[0];
+	ElanPrint(DEBUG_LEVEL_INFO, DBG_PNP, "[etp] Boot took %lld ticks over %d steps, %d failed\n", pDevice->Boot.Ticks, pDevice->Boot.Steps, pDevice->Boot.FailedSteps);
 
-	elan_i2c_read_cmd(pDevice, ETP_I2C_PRESSURE_CMD, val2);
+	deviceLoaded = true;
 
-	elan_i2c_read_cmd(pDevice, ETP_I2C_MAX_X_AXIS_CMD, val2);
-	uint16_t max_x = (*((uint16_t *)val2)) & 0x0fff;
+	FuncExit(TRACE_FLAG_WDFLOADING);
+	return status;
+}
 
-	elan_i2c_read_cmd(pDevice, ETP_I2C_MAX_Y_AXIS_CMD, val2);
-	uint16_t max_y = (*((uint16_t *)val2)) & 0x0fff;
+NTSTATUS
+ElanResetTrackpad(
+	IN PDEVICE_CONTEXT pDevice
+	)
+/*++
 
-	elan_i2c_read_cmd(pDevice, ETP_I2C_XY_TRACENUM_CMD, val2);
+Routine Description:
 
-	uint8_t x_traces = val2[0];
-	uint8_t y_traces = val2[1];
+This routine resets a trackpad that stopped answering and boots it
+again. Called at PASSIVE_LEVEL from ResetWorkItem with PollLock held. Only resets that
+booted the pad are counted; after a failed one the pad is left
+unloaded, and ResetFailed lets the next run of failures try again.
 
-	pDevice->max_y = max_y;
+Arguments:
 
-	csgesture_softc *sc = &pDevice->sc;
-	sc->resx = max_x;
-	sc->resy = max_y;
-	sc->phyx = max_x / x_traces;
-	sc->phyy = max_y / y_traces;
+pDevice - the trackpad
 
-	ElanPrint(DEBUG_LEVEL_INFO, DBG_PNP, "[etp] ProdID: %d Vers: %d Csum: %d SmVers: %d IAPVers: %d Max X: %d Max Y: %d\n", prodid, version, csum, smvers, iapversion, max_x, max_y);
+Return Value:
 
-	elan_i2c_write_cmd(pDevice, ETP_I2C_SET_CMD, ETP_ENABLE_CALIBRATE | ETP_ENABLE_ABS);
+Status
 
-	elan_i2c_write_cmd(pDevice, ETP_I2C_STAND_CMD, ETP_I2C_WAKE_UP);
+--*/
+{
+	ELAN_RECOVERY *recovery = &pDevice->Recovery;
+	NTSTATUS status;
 
-	elan_i2c_write_cmd(pDevice, ETP_I2C_CALIBRATE_CMD, 1);
+	ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+		"Trackpad not answering, resetting it (%lld resets)\n", recovery->Resets);
 
-	SpbReadDataSynchronously16(&pDevice->I2CContext, ETP_I2C_CALIBRATE_CMD, &val2, 1);
+	deviceLoaded = false;
 
-	elan_i2c_write_cmd(pDevice, ETP_I2C_SET_CMD, ETP_ENABLE_ABS);
+	status = BOOTTRACKPAD(pDevice);
 
-	deviceLoaded = true;
+	recovery->ResetFailed = !NT_SUCCESS(status);
+	if (NT_SUCCESS(status))
+		recovery->Resets++;
 
-	FuncExit(TRACE_FLAG_WDFLOADING);
 	return status;
 }
 
@@ -296,16 +410,102 @@ Status
 	PDEVICE_CONTEXT pDevice = GetDeviceContext(FxDevice);
 	NTSTATUS status = STATUS_SUCCESS;
 
-	WdfTimerStart(pDevice->Timer, WDF_REL_TIMEOUT_IN_MS(10));
+	pDevice->Poll.State = ELAN_POLL_ACTIVE;
+	pDevice->Poll.CooldownLeft = pDevice->Poll.CooldownPolls;
+	pDevice->Poll.NextMs = pDevice->Poll.ActiveMs;
+
+	pDevice->Recovery.FailureStreak = 0;
+	pDevice->Recovery.ResetAfter = ELAN_RESET_FAILURES;
+	pDevice->Recovery.ResetFailed = FALSE;
+	pDevice->Recovery.ResetPending = FALSE;
+
+	ElanPipelineStart(pDevice);
+
+	//
+	// Poll until OnD0EntryPostInterruptsEnabled has tested the line
+	//
+	pDevice->Acquisition.Source = ELAN_ACQUIRE_TIMER;
+	pDevice->Acquisition.SelfTest = ELAN_SELFTEST_NOT_RUN;
 
 	pDevice->RegsSet = false;
 	pDevice->ConnectInterrupt = true;
 
+#if (KMDF_VERSION_MAJOR == 1) && (KMDF_VERSION_MINOR < 13)
+	//
+	// No high resolution WDFTIMERs here, so raise the system clock to
+	// 1ms for as long as we poll
+	//
+	if (pDevice->Poll.HighResolution)
+		pDevice->Poll.TimerResolution = ExSetTimerResolution(10000, TRUE);
+#endif
+
+	pDevice->Poll.LastActiveFire = 0;
+	ElanArmPollTimer(pDevice, pDevice->Poll.ActiveMs);
+
 	FuncExit(TRACE_FLAG_WDFLOADING);
 
 	return status;
 }
 
+NTSTATUS
+OnD0EntryPostInterruptsEnabled(
+_In_  WDFDEVICE               FxDevice,
+_In_  WDF_POWER_DEVICE_STATE  FxPreviousState
+)
+/*++
+
+Routine Description:
+
+This routine starts the interrupt line's self-test once the interrupt
+is connected, when the ConnectInterrupt setting asks for interrupts.
+The adaptive timer stays the source while the line is watched for
+ELAN_SELFTEST_MS, with reports also read on every edge, so D0 entry
+doesn't wait on it; ElanAcquireRecordFrame ends it from the frames the
+timer processes. A working line stays quiet or only signals frames
+that carry data, and becomes the source; a stuck line storms with
+nothing to read, so it is disabled and the timer keeps polling. A line
+that never fires is caught later, by the timer finding frames the line
+didn't signal, and disabled then. A line disabled in the last D0 was
+enabled again by the framework, and gets another chance here.
+
+Arguments:
+
+FxDevice - a handle to the framework device object
+FxPreviousState - previous power state
+
+Return Value:
+
+Status
+
+--*/
+{
+	FuncEntry(TRACE_FLAG_WDFLOADING);
+
+	UNREFERENCED_PARAMETER(FxPreviousState);
+
+	PDEVICE_CONTEXT pDevice = GetDeviceContext(FxDevice);
+	ELAN_ACQUISITION *acq = &pDevice->Acquisition;
+
+	//
+	// The poll timer is already running
+	//
+	WdfWaitLockAcquire(pDevice->PollLock, NULL);
+
+	//
+	// The framework enabled every interrupt on its way into D0, a line
+	// disabled in the last D0 included, so only the flag is left over
+	//
+	acq->LineDisabled = FALSE;
+
+	ElanAcquireStart(acq, KeQueryInterruptTime());
+
+	WdfWaitLockRelease(pDevice->PollLock);
+
+	FuncExit(TRACE_FLAG_WDFLOADING);
+
+	return STATUS_SUCCESS;
+}
+
 NTSTATUS
 OnD0Exit(
 _In_  WDFDEVICE               FxDevice,
@@ -334,9 +534,26 @@ Status
 
 	PDEVICE_CONTEXT pDevice = GetDeviceContext(FxDevice);
 
+	pDevice->ConnectInterrupt = false;
+
+	//
+	// A poll still running may re-arm the timer before it sees
+	// ConnectInterrupt cleared, so stop the timer again once it's done.
+	// A pipelined read still queued or on the bus queues the work item
+	// when it completes, so cancel it and wait before flushing.
+	//
+	WdfTimerStop(pDevice->Timer, TRUE);
+	SpbCancelAsynchronous(&pDevice->I2CContext);
+	WdfWorkItemFlush(pDevice->PollWorkItem);
+	WdfWorkItemFlush(pDevice->Recovery.ResetWorkItem);
+	WdfWorkItemFlush(pDevice->Acquisition.LineWorkItem);
 	WdfTimerStop(pDevice->Timer, TRUE);
 
-	pDevice->ConnectInterrupt = false;
+	if (pDevice->Poll.TimerResolution != 0)
+	{
+		ExSetTimerResolution(0, FALSE);
+		pDevice->Poll.TimerResolution = 0;
+	}
 
 	FuncExit(TRACE_FLAG_WDFLOADING);
 
@@ -511,7 +728,21 @@ VOID
 		//
 		//Transmits a class driver-supplied report to the device.
 		//
+		//
+		// PollLock keeps this boot apart from synchronous frame reads
+		// and from ResetWorkItem resetting the pad; BOOTTRACKPAD holds
+		// off the pipelined reads itself
+		//
+		WdfWaitLockAcquire(pDevice->PollLock, NULL);
 		status = BOOTTRACKPAD(pDevice);
+
+		//
+		// A pad that never booted isn't loaded, so let the next run of
+		// failed reads reset it as if a reset had failed
+		//
+		if (!NT_SUCCESS(status))
+			pDevice->Recovery.ResetFailed = TRUE;
+		WdfWaitLockRelease(pDevice->PollLock);
 		if (!NT_SUCCESS(status)){
 			ElanPrint(DBG_IOCTL, DEBUG_LEVEL_ERROR, "Error booting Elan device!\n");
 		}
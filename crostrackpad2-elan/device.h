@@ -8,6 +8,7 @@
 EVT_WDF_DEVICE_PREPARE_HARDWARE      OnPrepareHardware;
 EVT_WDF_DEVICE_RELEASE_HARDWARE      OnReleaseHardware;
 EVT_WDF_DEVICE_D0_ENTRY              OnD0Entry;
+EVT_WDF_DEVICE_D0_ENTRY_POST_INTERRUPTS_ENABLED OnD0EntryPostInterruptsEnabled;
 EVT_WDF_DEVICE_D0_EXIT               OnD0Exit;
 
 EVT_WDF_FILE_CLEANUP                 OnFileCleanup;
@@ -20,4 +21,22 @@ EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL   OnIoDeviceControl;
 EVT_WDF_INTERRUPT_ISR                OnInterruptIsr;
 EVT_WDF_TIMER OnPollTimerFunc;
 
+//
+// Helpers
+//
+
+ULONG
+ElanQuerySetting(
+	IN WDFDEVICE FxDevice,
+	IN PCWSTR ValueName,
+	IN ULONG DefaultValue
+	);
+
+bool IsElanLoaded();
+
+NTSTATUS
+ElanResetTrackpad(
+	IN PDEVICE_CONTEXT pDevice
+	);
+
 #endif
\ No newline at end of file
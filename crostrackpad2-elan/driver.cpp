@@ -4,17 +4,16 @@
 #include "ntstrsafe.h"
 #include "hiddevice.h"
 #include "input.h"
+#include "gesture.h"
+#include "control.h"
 
 static ULONG ElanPrintDebugLevel = 100;
 static ULONG ElanPrintDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
 
-void TrackpadRawInput(PDEVICE_CONTEXT pDevice, struct csgesture_softc *sc, uint8_t report[ETP_MAX_REPORT_LEN], int tickinc);
 void ElanTimerFunc(_In_ WDFTIMER hTimer);
-
-#define NT_DEVICE_NAME      L"\\Device\\ELANTP"
-#define DOS_DEVICE_NAME     L"\\DosDevices\\ELANTP"
-
-#define MAX_FINGERS 5
+EVT_WDF_WORKITEM ElanReadWriteWorkItem;
+EVT_WDF_WORKITEM ElanLineWorkItem;
+EVT_WDF_WORKITEM ElanResetWorkItem;
 
 //#include "driver.tmh"
 
@@ -138,6 +137,7 @@ Status
 		pnpCallbacks.EvtDevicePrepareHardware = OnPrepareHardware;
 		pnpCallbacks.EvtDeviceReleaseHardware = OnReleaseHardware;
 		pnpCallbacks.EvtDeviceD0Entry = OnD0Entry;
+		pnpCallbacks.EvtDeviceD0EntryPostInterruptsEnabled = OnD0EntryPostInterruptsEnabled;
 		pnpCallbacks.EvtDeviceD0Exit = OnD0Exit;
 
 		WdfDeviceInitSetPnpPowerEventCallbacks(FxDeviceInit, &pnpCallbacks);
@@ -163,6 +163,7 @@ Status
 	{
 		WDF_OBJECT_ATTRIBUTES deviceAttributes;
 		WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&deviceAttributes, DEVICE_CONTEXT);
+		deviceAttributes.EvtCleanupCallback = OnDeviceCleanup;
 
 		status = WdfDeviceCreate(
 			&FxDeviceInit,
@@ -311,7 +312,14 @@ Status
 	WDFTIMER                      hTimer;
 	WDF_OBJECT_ATTRIBUTES         attributes;
 
-	WDF_TIMER_CONFIG_INIT_PERIODIC(&timerConfig, ElanTimerFunc, 10);
+	WDF_TIMER_CONFIG_INIT(&timerConfig, ElanTimerFunc);
+
+	pDevice->Poll.HighResolution =
+		ElanQuerySetting(fxDevice, L"HighResolutionTimer", 0) != 0;
+#if (KMDF_VERSION_MAJOR > 1) || (KMDF_VERSION_MINOR >= 13)
+	if (pDevice->Poll.HighResolution)
+		timerConfig.UseHighResolutionTimer = WdfTrue;
+#endif
 
 	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
 	attributes.ParentObject = fxDevice;
@@ -323,11 +331,94 @@ Status
 		return status;
 	}
 
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = fxDevice;
+	status = WdfWaitLockCreate(&attributes, &pDevice->PollLock);
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "(%!FUNC!) WdfWaitLockCreate failed status:%!STATUS!\n", status);
+		return status;
+	}
+
+	WDF_WORKITEM_CONFIG           workitemConfig;
+
+	WDF_WORKITEM_CONFIG_INIT(&workitemConfig, ElanReadWriteWorkItem);
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = fxDevice;
+	status = WdfWorkItemCreate(&workitemConfig, &attributes, &pDevice->PollWorkItem);
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "(%!FUNC!) WdfWorkItemCreate failed status:%!STATUS!\n", status);
+		return status;
+	}
+
+	WDF_WORKITEM_CONFIG_INIT(&workitemConfig, ElanLineWorkItem);
+
+	status = WdfWorkItemCreate(&workitemConfig, &attributes, &pDevice->Acquisition.LineWorkItem);
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "(%!FUNC!) WdfWorkItemCreate failed status:%!STATUS!\n", status);
+		return status;
+	}
+
+	WDF_WORKITEM_CONFIG_INIT(&workitemConfig, ElanResetWorkItem);
+
+	status = WdfWorkItemCreate(&workitemConfig, &attributes, &pDevice->Recovery.ResetWorkItem);
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "(%!FUNC!) WdfWorkItemCreate failed status:%!STATUS!\n", status);
+		return status;
+	}
+
 	ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
 		"Success! 0x%x\n", status);
 
 	pDevice->DeviceMode = DEVICE_MODE_MOUSE;
 
+	{
+		LARGE_INTEGER frequency;
+		KeQueryPerformanceCounter(&frequency);
+		pDevice->Perf.Frequency = frequency.QuadPart;
+		pDevice->Perf.FrameBudgetTicks = frequency.QuadPart *
+			ElanQuerySetting(fxDevice, L"FrameBudgetUs", 1000) / 1000000;
+	}
+
+	pDevice->Poll.ActiveMs = min(ELAN_POLL_MAX_MS,
+		max(ELAN_POLL_MIN_MS, ElanQuerySetting(fxDevice, L"PollActiveMs", 8)));
+	pDevice->Poll.CooldownMs = max(1, ElanQuerySetting(fxDevice, L"PollCooldownMs", 10));
+	pDevice->Poll.IdleMs = max(1, ElanQuerySetting(fxDevice, L"PollIdleMs", 25));
+	pDevice->Poll.CooldownPolls = ElanQuerySetting(fxDevice, L"PollCooldownPolls", 50);
+
+	pDevice->Acquisition.InterruptRequested =
+		ElanQuerySetting(fxDevice, L"ConnectInterrupt", 0) != 0;
+
+	pDevice->sc.predictms = min(GESTURE_MAX_PREDICT_MS,
+		ElanQuerySetting(fxDevice, L"PredictionMs", 0));
+
+	status = ElanPipelineInitialize(pDevice);
+	if (!NT_SUCCESS(status))
+	{
+		goto exit;
+	}
+
+	status = ElanCaptureInitialize(fxDevice,
+		&pDevice->Capture,
+		min(ELAN_CAPTURE_MAX_RECORDS,
+			ElanQuerySetting(fxDevice, L"CaptureRecords", 0)));
+	if (!NT_SUCCESS(status))
+	{
+		goto exit;
+	}
+
+	//
+	// Diagnostics are optional, the trackpad works without them
+	//
+	if (!NT_SUCCESS(ElanCreateControlDevice(pDevice)))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "Control device not created\n");
+	}
+
 exit:
 
 	FuncExit(TRACE_FLAG_WDFLOADING);
@@ -336,6 +427,16 @@ exit:
 }
 
 
+VOID
+OnDeviceCleanup(
+_In_ WDFOBJECT Object
+)
+{
+	PDEVICE_CONTEXT pDevice = GetDeviceContext((WDFDEVICE)Object);
+
+	ElanDeleteControlDevice(pDevice);
+}
+
 BOOLEAN OnInterruptIsr(
 	WDFINTERRUPT Interrupt,
 	ULONG MessageID){
@@ -348,602 +449,733 @@ BOOLEAN OnInterruptIsr(
 		return true;
 	}
 
-	//IRQ's don't work with the elan trackpad so we are resorting to polling instead.
+	//
+	// Passive-level interrupt, so the report is read right here, also
+	// while the line is on its self-test. When the line failed or isn't
+	// wanted we poll instead, and a failed line is switched off; not
+	// from here, where the interrupt lock WdfInterruptDisable takes is
+	// held.
+	//
+	BOOLEAN disableLine;
+	if (!ElanAcquireOnInterrupt(&pDevice->Acquisition, &disableLine)){
+		if (disableLine)
+			WdfWorkItemEnqueue(pDevice->Acquisition.LineWorkItem);
+		return true;
+	}
+
+	ElanAcquireFrame(pDevice, ELAN_ACQUIRE_INTERRUPT);
 	return true;
 }
 
-VOID
-ElanReadWriteWorkItem(
-IN WDFWORKITEM  WorkItem
-)
-{
-	WDFDEVICE Device = (WDFDEVICE)WdfWorkItemGetParentObject(WorkItem);
-	PDEVICE_CONTEXT pDevice = GetDeviceContext(Device);
-	if (!pDevice->ConnectInterrupt)
-		return;
-
-	uint8_t report[ETP_MAX_REPORT_LEN];
-	SpbReadDataSynchronously(&pDevice->I2CContext, 0, &report, sizeof(report));
+static
+ULONG
+ElanSchedulePoll(
+	IN PDEVICE_CONTEXT pDevice
+	)
+/*++
 
-	if (report[0] != 0xff){
-		for (int i = 0; i < ETP_MAX_REPORT_LEN; i++)
-			pDevice->lastreport[i] = report[i];
-	}
+Routine Description:
 
-	uint8_t *report2 = pDevice->lastreport;
+This routine moves the poll scheduler on from the state the gesture
+engine was left in by the last poll.
 
-	csgesture_softc sc = pDevice->sc;
-	TrackpadRawInput(pDevice, &sc, report2, 1);
-	pDevice->sc = sc;
-	WdfObjectDelete(WorkItem);
-}
+Arguments:
 
-void ElanTimerFunc(_In_ WDFTIMER hTimer){
-	WDFDEVICE Device = (WDFDEVICE)WdfTimerGetParentObject(hTimer);
-	PDEVICE_CONTEXT pDevice = GetDeviceContext(Device);
+pDevice - the trackpad
 
-	if (!pDevice->ConnectInterrupt)
-		return;
+Return Value:
 
-	PDEVICE_CONTEXT context;
-	WDF_OBJECT_ATTRIBUTES attributes;
-	WDF_WORKITEM_CONFIG workitemConfig;
-	WDFWORKITEM hWorkItem;
+Milliseconds until the next poll
 
-	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
-	WDF_OBJECT_ATTRIBUTES_SET_CONTEXT_TYPE(&attributes, DEVICE_CONTEXT);
-	attributes.ParentObject = Device;
-	WDF_WORKITEM_CONFIG_INIT(&workitemConfig, ElanReadWriteWorkItem);
+--*/
+{
+	ELAN_POLL_SCHEDULER *poll = &pDevice->Poll;
+	csgesture_softc *sc = &pDevice->sc;
+	bool busy = sc->buttondown || sc->mousedown || sc->mouseDownDueToTap;
 
-	WdfWorkItemCreate(&workitemConfig,
-		&attributes,
-		&hWorkItem);
+	for (int i = 0; i < ETP_MAX_FINGERS && !busy; i++){
+		if (sc->x[i] != -1)
+			busy = true;
+	}
 
-	WdfWorkItemEnqueue(hWorkItem);
+	if (busy){
+		poll->State = ELAN_POLL_ACTIVE;
+		poll->CooldownLeft = poll->CooldownPolls;
+	}
+	else if (poll->CooldownLeft > 0){
+		poll->State = ELAN_POLL_COOLDOWN;
+		poll->CooldownLeft--;
+	}
+	else {
+		poll->State = ELAN_POLL_IDLE;
+	}
 
-	return;
+	switch (poll->State){
+	case ELAN_POLL_ACTIVE:
+		//
+		// Interrupts bring the frames while a finger is down, and each
+		// one pushes the timer out again. The timer only fires once
+		// they stop, and at ActiveMs, so that a dead line costs
+		// ELAN_MISSED_INTERRUPT_LIMIT active polls of motion rather
+		// than as many idle ones.
+		//
+		return poll->ActiveMs;
+	case ELAN_POLL_COOLDOWN:
+		return poll->CooldownMs;
+	default:
+		return poll->IdleMs;
+	}
 }
 
-static int distancesq(int delta_x, int delta_y){
-	return (delta_x * delta_x) + (delta_y*delta_y);
-}
+static
+ULONG
+ElanProcessFrame(
+	IN PDEVICE_CONTEXT pDevice,
+	IN ULONG Source,
+	IN NTSTATUS ReadStatus,
+	IN OUT ELAN_FRAME *Frame,
+	IN LONGLONG frameStart,
+	IN LONGLONG readEnd
+	)
+/*++
 
-_CYAPA_RELATIVE_MOUSE_REPORT lastreport;
-
-static void update_relative_mouse(PDEVICE_CONTEXT pDevice, BYTE button,
-	BYTE x, BYTE y, BYTE wheelPosition, BYTE wheelHPosition){
-	_CYAPA_RELATIVE_MOUSE_REPORT report;
-	report.ReportID = REPORTID_RELATIVE_MOUSE;
-	report.Button = button;
-	report.XValue = x;
-	report.YValue = y;
-	report.WheelPosition = wheelPosition;
-	report.HWheelPosition = wheelHPosition;
-	if (report.Button == lastreport.Button &&
-		report.XValue == lastreport.XValue &&
-		report.YValue == lastreport.YValue &&
-		report.WheelPosition == lastreport.WheelPosition &&
-		report.HWheelPosition == lastreport.HWheelPosition)
-		return;
-	lastreport = report;
+Routine Description:
 
-	size_t bytesWritten;
-	ElanProcessVendorReport(pDevice, &report, sizeof(report), &bytesWritten);
-}
+This routine runs a frame read from the trackpad through the decoder
+and the gesture engine. Called at PASSIVE_LEVEL with PollLock held.
 
-static void update_keyboard(PDEVICE_CONTEXT pDevice, BYTE shiftKeys, BYTE keyCodes[KBD_KEY_CODES]){
-	_CYAPA_KEYBOARD_REPORT report;
-	report.ReportID = REPORTID_KEYBOARD;
-	report.ShiftKeyFlags = shiftKeys;
-	for (int i = 0; i < KBD_KEY_CODES; i++){
-		report.KeyCodes[i] = keyCodes[i];
-	}
+Arguments:
 
-	size_t bytesWritten;
-	ElanProcessVendorReport(pDevice, &report, sizeof(report), &bytesWritten);
-}
+pDevice    - the trackpad
+Source     - ELAN_ACQUIRE_TIMER for polls, ELAN_ACQUIRE_INTERRUPT when
+             the interrupt line signalled the frame
+ReadStatus - outcome of the report read
+Frame      - the buffer the report was read into. A valid report is
+             kept as the last frame, and Frame gets the buffer that
+             held the previous one.
+frameStart - KeQueryPerformanceCounter() when the read was started
+readEnd    - KeQueryPerformanceCounter() when the read completed
 
-bool ProcessMove(csgesture_softc *sc, int abovethreshold, int iToUse[3]) {
-	if (abovethreshold == 1 || sc->panningActive) {
-		int i = iToUse[0];
-		if (!sc->panningActive && sc->tick[i] < 5)
-			return false;
+Return Value:
 
-		if (sc->panningActive && i == -1)
-			i = sc->idForPanning;
+Milliseconds until the next timer poll
 
-		int delta_x = sc->x[i] - sc->lastx[i];
-		int delta_y = sc->y[i] - sc->lasty[i];
+--*/
+{
+	ELAN_PERF_COUNTERS *perf = &pDevice->Perf;
+	ELAN_ACQUISITION *acq = &pDevice->Acquisition;
+	LONGLONG processStart, decodeEnd, gestureEnd;
+	int frame = ELAN_FRAME_EMPTY;
+	ELAN_FRAME last;
 
-		if (abs(delta_x) > 75 || abs(delta_y) > 75) {
-			delta_x = 0;
-			delta_y = 0;
-		}
+	perf->FramesPolled++;
+	perf->StatePolls[pDevice->Poll.State]++;
 
-		for (int j = 0;j < MAX_FINGERS;j++) {
-			if (j != i) {
-				if (sc->blacklistedids[j] != 1) {
-					if (sc->y[j] > sc->y[i]) {
-						if (sc->truetick[j] > sc->truetick[i] + 15) {
-							sc->blacklistedids[j] = 1;
-						}
-					}
-				}
-			}
-		}
+	ElanStageAccumulate(&perf->SpbRead, frameStart, readEnd);
+	pDevice->FrameReadTime = readEnd;
 
-		sc->dx = delta_x;
-		sc->dy = delta_y;
+	processStart = KeQueryPerformanceCounter(NULL).QuadPart;
 
-		sc->panningActive = true;
-		sc->idForPanning = i;
-		return true;
-	}
-	return false;
-}
+	if (!NT_SUCCESS(ReadStatus)){
+		ELAN_RECOVERY *recovery = &pDevice->Recovery;
 
-int CalcScrollValue(int rawValue, int ticks) {
-	int actionThreshold = 3;
-	int invalidThreshold = 120;
+		perf->SpbErrors++;
+		perf->ReprocessedFrames++;
 
-	int absValue = abs(rawValue);
-	int speed = absValue / max(ticks, 1);
-	int step = speed > 11 ? 3 : (speed > 7 ? 4 : (speed > 4 ? 6 : 7));
-	if (absValue > invalidThreshold || absValue < actionThreshold) {
-		return 0;
-	} else {
-		return (rawValue / absValue) * ((absValue > actionThreshold && absValue < 2 * step ? 0 : 1) + (absValue - actionThreshold) / step);
+		//
+		// The bus already retried this read, so a run of failures
+		// means the trackpad itself needs a reset. The boot is too
+		// long to run here, so ResetWorkItem does it. Whether or not
+		// it boots, the next reset waits for a longer run.
+		//
+		if (++recovery->FailureStreak >= recovery->ResetAfter &&
+			!recovery->ResetPending &&
+			(IsElanLoaded() || recovery->ResetFailed)){
+			recovery->FailureStreak = 0;
+			recovery->ResetAfter = min(recovery->ResetAfter * 2, ELAN_RESET_MAX_FAILURES);
+			recovery->ResetPending = TRUE;
+			WdfWorkItemEnqueue(recovery->ResetWorkItem);
+		}
 	}
-}
+	else {
+		if (pDevice->Recovery.FailureStreak != 0){
+			pDevice->Recovery.FailureStreak = 0;
+			pDevice->Recovery.ResetAfter = ELAN_RESET_FAILURES;
+		}
 
-bool ProcessScroll(csgesture_softc *sc, int abovethreshold, int iToUse[3]) {
-	sc->scrollx = 0;
-	sc->scrolly = 0;
-	if (abovethreshold == 2 || sc->scrollingActive) {
-		int i1 = iToUse[0];
-		int i2 = iToUse[1];
-		if (sc->scrollingActive) {
-			if (i1 == -1) {
-				if (i2 != sc->idsForScrolling[0])
-					i1 = sc->idsForScrolling[0];
-				else
-					i1 = sc->idsForScrolling[1];
-			}
-			if (i2 == -1) {
-				if (i1 != sc->idsForScrolling[0])
-					i2 = sc->idsForScrolling[0];
-				else
-					i2 = sc->idsForScrolling[1];
-			}
+		frame = ElanClassifyReport(Frame->Report);
+		switch (frame){
+		case ELAN_FRAME_VALID:
+			last = pDevice->LastFrame;
+			pDevice->LastFrame = *Frame;
+			*Frame = last;
+			break;
+		case ELAN_FRAME_EMPTY:
+			perf->EmptyFrames++;
+			perf->ReprocessedFrames++;
+			break;
+		case ELAN_FRAME_MALFORMED:
+			perf->MalformedFrames++;
+			perf->ReprocessedFrames++;
+			break;
 		}
+	}
 
-		int delta_x1 = sc->x[i1] - sc->lastx[i1];
-		int delta_y1 = sc->y[i1] - sc->lasty[i1];
+	if (ElanAcquireRecordFrame(acq, Source, frame == ELAN_FRAME_VALID, KeQueryInterruptTime())){
+		if (acq->SelfTest == ELAN_SELFTEST_STUCK_LINE)
+			ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+				"Interrupt line stuck (%lld spurious), polling instead\n",
+				acq->SpuriousInterrupts - acq->SelfTestSpurious);
+		else
+			ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+				"Interrupt line missed %d frames, polling instead\n", acq->MissedStreak);
+		WdfWorkItemEnqueue(acq->LineWorkItem);
+	}
 
-		int delta_x2 = sc->x[i2] - sc->lastx[i2];
-		int delta_y2 = sc->y[i2] - sc->lasty[i2];
+	uint8_t *report2 = pDevice->LastFrame.Report;
 
-		if ((abs(delta_y1) + abs(delta_y2)) > (abs(delta_x1) + abs(delta_x2))) {
-			int avgy = (delta_y1 + delta_y2) / 2;
-			sc->scrolly = -avgy;
+	//
+	// Same work as TrackpadRawInput, split so that the decoder and
+	// the gesture engine can be timed separately. PollLock keeps
+	// everything else off the engine state, so it is worked on in place.
+	//
+	csgesture_softc *sc = &pDevice->sc;
+	if (ElanClassifyReport(report2) == ELAN_FRAME_VALID){
+		//
+		// The gesture engine runs on wall time, the polling rate varies
+		// with the scheduler state and the acquisition source
+		//
+		ULONGLONG now = KeQueryInterruptTime();
+		int intervalMs = GESTURE_TICK_MS;
+		if (pDevice->LastInterruptTime != 0 &&
+			now - pDevice->LastInterruptTime < GESTURE_MAX_FRAME_MS * 10000ULL){
+			//
+			// Only whole milliseconds are handed on and the rest is
+			// carried to the next frame, so polls faster than 1 kHz
+			// still add up to the time that passed
+			//
+			intervalMs = (int)((now - pDevice->LastInterruptTime) / 10000);
+			pDevice->LastInterruptTime += intervalMs * 10000ULL;
 		}
 		else {
-			int avgx = (delta_x1 + delta_x2) / 2;
-			sc->scrollx = -avgx;
-		}
-
-		int ticks = (sc->tick[i1] + sc->tick[i2]) / 2;
-		sc->scrolly = CalcScrollValue(sc->scrolly, ticks);
-		sc->scrollx = CalcScrollValue(sc->scrollx, ticks);
-
-		int fngrcount = 0;
-		int totfingers = 0;
-		for (int i = 0; i < MAX_FINGERS; i++) {
-			if (sc->x[i] != -1) {
-				totfingers++;
-				if (i == i1 || i == i2)
-					fngrcount++;
-			}
+			if (pDevice->LastInterruptTime != 0)
+				intervalMs = GESTURE_MAX_FRAME_MS;
+			pDevice->LastInterruptTime = now;
 		}
+		sc->frameintervalms = intervalMs;
 
-		if (fngrcount == 2)
-			sc->ticksSinceScrolling = 0;
-		else
-			sc->ticksSinceScrolling++;
-		if (fngrcount == 2 || sc->ticksSinceScrolling <= 5) {
-			sc->scrollingActive = true;
-			if (abovethreshold == 2) {
-				sc->idsForScrolling[0] = iToUse[0];
-				sc->idsForScrolling[1] = iToUse[1];
-			}
+		if (ElanSkipUnchangedFrame(sc, report2)){
+			perf->UnchangedFrames++;
 		}
 		else {
-			sc->scrollingActive = false;
-			sc->idsForScrolling[0] = -1;
-			sc->idsForScrolling[1] = -1;
+			ElanDecodeReport(sc, report2);
+
+			decodeEnd = KeQueryPerformanceCounter(NULL).QuadPart;
+			ElanStageAccumulate(&perf->Decode, processStart, decodeEnd);
+
+			ProcessGesture(pDevice, sc);
+
+			gestureEnd = KeQueryPerformanceCounter(NULL).QuadPart;
+			ElanStageAccumulate(&perf->Gesture, decodeEnd, gestureEnd);
+			ElanStageAccumulate(&perf->Frame, frameStart, gestureEnd);
+
+			if (gestureEnd - processStart > perf->FrameBudgetTicks)
+				perf->OverBudgetFrames++;
 		}
-		return true;
+
+		ElanCaptureReport(&pDevice->Capture, report2, intervalMs, sc->reportdigest, sc->reportcount);
+		ElanPublishContacts(&pDevice->Contacts, sc, now);
 	}
-	return false;
+	pDevice->FrameReadTime = 0;
+
+	pDevice->Poll.NextMs = ElanSchedulePoll(pDevice);
+
+	return pDevice->Poll.NextMs;
 }
 
-bool ProcessThreeFingerSwipe(PDEVICE_CONTEXT pDevice, csgesture_softc *sc, int abovethreshold, int iToUse[3]) {
-	if (abovethreshold == 3 || abovethreshold == 4) {
-		int i1 = iToUse[0];
-		int delta_x1 = sc->x[i1] - sc->lastx[i1];
-		int delta_y1 = sc->y[i1] - sc->lasty[i1];
-
-		int i2 = iToUse[1];
-		int delta_x2 = sc->x[i2] - sc->lastx[i2];
-		int delta_y2 = sc->y[i2] - sc->lasty[i2];
-
-		int i3 = iToUse[2];
-		int delta_x3 = sc->x[i3] - sc->lastx[i3];
-		int delta_y3 = sc->y[i3] - sc->lasty[i3];
-
-		int avgx = (delta_x1 + delta_x2 + delta_x3) / 3;
-		int avgy = (delta_y1 + delta_y2 + delta_y3) / 3;
-
-		sc->multitaskingx += avgx;
-		sc->multitaskingy += avgy;
-		sc->multitaskinggesturetick++;
-
-		if (sc->multitaskinggesturetick > 5 && !sc->multitaskingdone) {
-			if ((abs(delta_y1) + abs(delta_y2) + abs(delta_y3)) > (abs(delta_x1) + abs(delta_x2) + abs(delta_x3))) {
-				if (abs(sc->multitaskingy) > 50) {
-					BYTE shiftKeys = KBD_LGUI_BIT;
-					BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-					if (sc->multitaskingy < 0)
-						keyCodes[0] = 0x2B;
-					else
-						keyCodes[0] = 0x07;
-					update_keyboard(pDevice, shiftKeys, keyCodes);
-					shiftKeys = 0;
-					keyCodes[0] = 0x0;
-					update_keyboard(pDevice, shiftKeys, keyCodes);
-					sc->multitaskingx = 0;
-					sc->multitaskingy = 0;
-					sc->multitaskingdone = true;
-				}
-			}
-			else {
-				if (abs(sc->multitaskingx) > 50) {
-					BYTE shiftKeys = KBD_LGUI_BIT | KBD_LCONTROL_BIT;
-					BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-					if (sc->multitaskingx > 0)
-						keyCodes[0] = 0x50;
-					else
-						keyCodes[0] = 0x4F;
-					update_keyboard(pDevice, shiftKeys, keyCodes);
-					shiftKeys = 0;
-					keyCodes[0] = 0x0;
-					update_keyboard(pDevice, shiftKeys, keyCodes);
-					sc->multitaskingx = 0;
-					sc->multitaskingy = 0;
-					sc->multitaskingdone = true;
-				}
-			}
-		}
-		else if (sc->multitaskinggesturetick > 25) {
-			sc->multitaskingx = 0;
-			sc->multitaskingy = 0;
-			sc->multitaskinggesturetick = 0;
-			sc->multitaskingdone = false;
-		}
-		return true;
-	}
-	else {
-		sc->multitaskingx = 0;
-		sc->multitaskingy = 0;
-		sc->multitaskinggesturetick = 0;
-		sc->multitaskingdone = false;
-		return false;
-	}
+VOID
+ElanAcquireFrame(
+	IN PDEVICE_CONTEXT pDevice,
+	IN ULONG Source
+	)
+/*++
+
+Routine Description:
+
+This routine reads one frame from the trackpad synchronously and runs
+it through the decoder and the gesture engine. Every acquisition source
+but the pipelined timer ends up here, at PASSIVE_LEVEL. The one-shot
+poll timer is re-armed before PollLock is dropped, so the ISR and the
+poll work item never write the arm bookkeeping at the same time.
+
+Arguments:
+
+pDevice - the trackpad
+Source  - ELAN_ACQUIRE_TIMER for polls, ELAN_ACQUIRE_INTERRUPT when
+          the interrupt line signalled the frame
+
+Return Value:
+
+None
+
+--*/
+{
+	LONGLONG frameStart, readEnd;
+	NTSTATUS status;
+	ULONG nextPollMs;
+
+	WdfWaitLockAcquire(pDevice->PollLock, NULL);
+
+	frameStart = KeQueryPerformanceCounter(NULL).QuadPart;
+
+	status = SpbReadMemorySynchronously(&pDevice->I2CContext, 0,
+		pDevice->ReadFrame.Memory, ETP_MAX_REPORT_LEN);
+
+	readEnd = KeQueryPerformanceCounter(NULL).QuadPart;
+
+	nextPollMs = ElanProcessFrame(pDevice, Source, status, &pDevice->ReadFrame, frameStart, readEnd);
+
+	if (pDevice->ConnectInterrupt)
+		ElanArmPollTimer(pDevice, nextPollMs);
+
+	WdfWaitLockRelease(pDevice->PollLock);
 }
 
-void TapToClickOrDrag(PDEVICE_CONTEXT pDevice, csgesture_softc *sc, int button) {
-	sc->tickssinceclick++;
-	if (sc->mouseDownDueToTap && sc->idForMouseDown == -1) {
-		if (sc->tickssinceclick > 10) {
-			sc->mouseDownDueToTap = false;
-			sc->mousedown = false;
-			sc->buttonmask = 0;
-			//Tap Drag Timed out
-		}
+static
+VOID
+ElanPipelineReadComplete(
+	IN PVOID Context,
+	IN NTSTATUS Status
+	)
+{
+	PDEVICE_CONTEXT pDevice = (PDEVICE_CONTEXT)Context;
+	ELAN_FRAME_PIPELINE *pipeline = &pDevice->Pipeline;
+	ELAN_FRAME_SLOT *slot = &pipeline->Slots[pipeline->FillSlot];
+
+	slot->Status = Status;
+	slot->ReadTime = KeQueryPerformanceCounter(NULL).QuadPart;
+	InterlockedExchange(&slot->State, ELAN_SLOT_READY);
+
+	pipeline->FillSlot = (pipeline->FillSlot + 1) % ELAN_FRAME_SLOTS;
+
+	WdfWorkItemEnqueue(pDevice->PollWorkItem);
+}
+
+static
+VOID
+ElanPipelineIssue(
+	IN PDEVICE_CONTEXT pDevice
+	)
+/*++
+
+Routine Description:
+
+This routine starts the next report read into the slot after the last
+one filled. Called from the timer, at DISPATCH_LEVEL. The next slot is
+only read once this read completes, so reads complete in the order
+slots fill.
+
+Arguments:
+
+pDevice - the trackpad
+
+Return Value:
+
+None
+
+--*/
+{
+	ELAN_FRAME_PIPELINE *pipeline = &pDevice->Pipeline;
+	ELAN_FRAME_SLOT *slot = &pipeline->Slots[pipeline->FillSlot];
+	NTSTATUS status;
+
+	//
+	// Nothing reads register 0 while the pad boots, it holds the reset
+	// acknowledge. Issuing is raised first, so a boot that sets Booting
+	// after the check waits for this read to be queued.
+	//
+	InterlockedIncrement(&pipeline->Issuing);
+	if (pipeline->Booting){
+		InterlockedDecrement(&pipeline->Issuing);
 		return;
 	}
-	if (sc->mousedown) {
-		sc->tickssinceclick = 0;
+
+	if (InterlockedCompareExchange(&slot->State, ELAN_SLOT_READING, ELAN_SLOT_FREE) != ELAN_SLOT_FREE){
+		InterlockedDecrement(&pipeline->Issuing);
+		pDevice->Perf.PipelineStalls++;
 		return;
 	}
-	if (button == 0)
+
+	slot->IssueTime = KeQueryPerformanceCounter(NULL).QuadPart;
+
+	status = SpbReadDataAsynchronously(&pDevice->I2CContext,
+		0,
+		slot->Frame.Memory,
+		ETP_MAX_REPORT_LEN,
+		ElanPipelineReadComplete,
+		pDevice);
+
+	InterlockedDecrement(&pipeline->Issuing);
+
+	if (!NT_SUCCESS(status)){
+		InterlockedExchange(&slot->State, ELAN_SLOT_FREE);
+		pDevice->Perf.PipelineStalls++;
 		return;
-	int buttonmask = 0;
-
-	switch (button) {
-	case 1:
-		buttonmask = MOUSE_BUTTON_1;
-		break;
-	case 2:
-		buttonmask = MOUSE_BUTTON_2;
-		break;
-	case 3:
-		buttonmask = MOUSE_BUTTON_3;
-		break;
-	}
-	if (buttonmask != 0 && sc->tickssinceclick > 10 && sc->ticksincelastrelease == 0) {
-		sc->idForMouseDown = -1;
-		sc->mouseDownDueToTap = true;
-		sc->buttonmask = buttonmask;
-		sc->mousebutton = button;
-		sc->mousedown = true;
-		sc->tickssinceclick = 0;
 	}
+
+	pDevice->Perf.PipelinedReads++;
+	if (pipeline->Processing)
+		pDevice->Perf.OverlappedReads++;
 }
 
-void ClearTapDrag(PDEVICE_CONTEXT pDevice, csgesture_softc *sc, int i) {
-	if (i == sc->idForMouseDown && sc->mouseDownDueToTap == true) {
-		if (sc->tick[i] < 10) {
-			//Double Tap
-			update_relative_mouse(pDevice, 0, 0, 0, 0, 0);
-			update_relative_mouse(pDevice, sc->buttonmask, 0, 0, 0, 0);
+static
+VOID
+ElanPipelineDrain(
+	IN PDEVICE_CONTEXT pDevice
+	)
+/*++
+
+Routine Description:
+
+This routine processes the frames whose reads have completed, oldest
+first, and hands their slots back to the timer.
+
+Arguments:
+
+pDevice - the trackpad
+
+Return Value:
+
+None
+
+--*/
+{
+	ELAN_FRAME_PIPELINE *pipeline = &pDevice->Pipeline;
+
+	WdfWaitLockAcquire(pDevice->PollLock, NULL);
+
+	for (;;){
+		ELAN_FRAME_SLOT *slot = &pipeline->Slots[pipeline->ProcessSlot];
+
+		if (slot->State != ELAN_SLOT_READY)
+			break;
+
+		if (pDevice->ConnectInterrupt){
+			InterlockedExchange(&pipeline->Processing, 1);
+			ElanProcessFrame(pDevice, ELAN_ACQUIRE_TIMER, slot->Status, &slot->Frame,
+				slot->IssueTime, slot->ReadTime);
+			InterlockedExchange(&pipeline->Processing, 0);
 		}
-		sc->mouseDownDueToTap = false;
-		sc->mousedown = false;
-		sc->buttonmask = 0;
-		sc->idForMouseDown = -1;
-		//Clear Tap Drag
+
+		InterlockedExchange(&slot->State, ELAN_SLOT_FREE);
+		pipeline->ProcessSlot = (pipeline->ProcessSlot + 1) % ELAN_FRAME_SLOTS;
 	}
-}
 
-void ProcessGesture(PDEVICE_CONTEXT pDevice, csgesture_softc *sc) {
-#pragma mark reset inputs
-	sc->dx = 0;
-	sc->dy = 0;
+	WdfWaitLockRelease(pDevice->PollLock);
+}
 
-#pragma mark process touch thresholds
-	int abovethreshold = 0;
-	int recentlyadded = 0;
-	int iToUse[3] = { -1,-1,-1 };
-	int a = 0;
+static
+NTSTATUS
+ElanFrameCreate(
+	IN PDEVICE_CONTEXT pDevice,
+	OUT ELAN_FRAME *Frame
+	)
+{
+	WDF_OBJECT_ATTRIBUTES attributes;
+	NTSTATUS status;
 
-	int nfingers = 0;
-	for (int i = 0;i < MAX_FINGERS;i++) {
-		if (sc->x[i] != -1)
-			nfingers++;
-	}
-
-	int recentTicksThreshold = 20;
-	int speedThreshold = 2;
-
-	for (int i = 0;i < MAX_FINGERS;i++) {
-		if (sc->truetick[i] < recentTicksThreshold && sc->truetick[i] != 0)
-			recentlyadded++;
-		if (sc->tick[i] == 0)
-			continue;
-		if (sc->blacklistedids[i] == 1)
-			continue;
-		if (distancesq(sc->flextotalx[i], sc->flextotaly[i]) / (sc->tick[i] * sc->tick[i]) > speedThreshold) {
-			abovethreshold++;
-			iToUse[a] = i;
-			a++;
-		}
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+
+	status = WdfMemoryCreate(&attributes,
+		NonPagedPool,
+		CYAPA_POOL_TAG,
+		ETP_MAX_REPORT_LEN,
+		&Frame->Memory,
+		(PVOID *)&Frame->Report);
+	if (!NT_SUCCESS(status)){
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Error allocating frame buffer - %!STATUS!", status);
+		return status;
 	}
 
-#pragma mark process different gestures
-	bool handled = false;
-	if (!handled)
-		handled = ProcessThreeFingerSwipe(pDevice, sc, abovethreshold, iToUse);
-	if (!handled)
-		handled = ProcessScroll(sc, abovethreshold, iToUse);
-	if (!handled)
-		handled = ProcessMove(sc, abovethreshold, iToUse);
+	RtlZeroMemory(Frame->Report, ETP_MAX_REPORT_LEN);
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS
+ElanPipelineInitialize(
+	IN PDEVICE_CONTEXT pDevice
+	)
+/*++
 
-#pragma mark process clickpad press state
-	int buttonmask = 0;
+Routine Description:
 
-	sc->mousebutton = recentlyadded;
-	if (sc->mousebutton == 0)
-		sc->mousebutton = abovethreshold;
+This routine allocates the frame buffers reports are read into: the
+last valid frame, the buffer of synchronous reads, and the slots of the
+acquisition pipeline.
 
-	if (sc->mousebutton == 0) {
-		if (sc->panningActive)
-			sc->mousebutton = 1;
-		else
-			sc->mousebutton = nfingers;
-		if (sc->mousebutton == 0)
-			sc->mousebutton = 1;
-	}
-	if (sc->mousebutton > 3)
-		sc->mousebutton = 3;
-
-	if (!sc->mouseDownDueToTap) {
-		if (sc->buttondown && !sc->mousedown) {
-			sc->mousedown = true;
-			sc->tickssinceclick = 0;
-
-			switch (sc->mousebutton) {
-			case 1:
-				buttonmask = MOUSE_BUTTON_1;
-				break;
-			case 2:
-				buttonmask = MOUSE_BUTTON_2;
-				break;
-			case 3:
-				buttonmask = MOUSE_BUTTON_3;
-				break;
-			}
-			sc->buttonmask = buttonmask;
-		}
-		else if (sc->mousedown && !sc->buttondown) {
-			sc->mousedown = false;
-			sc->mousebutton = 0;
-			sc->buttonmask = 0;
+Arguments:
+
+pDevice - the trackpad
+
+Return Value:
+
+NTSTATUS Status indicating success or failure
+
+--*/
+{
+	ELAN_FRAME_PIPELINE *pipeline = &pDevice->Pipeline;
+	NTSTATUS status;
+
+	status = ElanFrameCreate(pDevice, &pDevice->LastFrame);
+	if (!NT_SUCCESS(status))
+		return status;
+
+	status = ElanFrameCreate(pDevice, &pDevice->ReadFrame);
+	if (!NT_SUCCESS(status))
+		return status;
+
+	pipeline->Requested = ElanQuerySetting(pDevice->FxDevice, L"PipelineReads", 1) != 0;
+	if (!pipeline->Requested)
+		return STATUS_SUCCESS;
+
+	for (int i = 0; i < ELAN_FRAME_SLOTS; i++){
+		status = ElanFrameCreate(pDevice, &pipeline->Slots[i].Frame);
+		if (!NT_SUCCESS(status)){
+			pipeline->Requested = FALSE;
+			break;
 		}
 	}
 
-#pragma mark shift to last
-	int releasedfingers = 0;
-
-	for (int i = 0;i < MAX_FINGERS;i++) {
-		if (sc->x[i] != -1) {
-			if (sc->lastx[i] == -1) {
-				if (sc->ticksincelastrelease < 10 && sc->mouseDownDueToTap && sc->idForMouseDown == -1) {
-					sc->idForMouseDown = i; //Associate Tap Drag
-				}
-			}
-			sc->truetick[i]++;
-			if (sc->tick[i] < 10) {
-				if (sc->lastx[i] != -1) {
-					sc->totalx[i] += abs(sc->x[i] - sc->lastx[i]);
-					sc->totaly[i] += abs(sc->y[i] - sc->lasty[i]);
-					sc->totalp[i] += sc->p[i];
-
-					sc->flextotalx[i] = sc->totalx[i];
-					sc->flextotaly[i] = sc->totaly[i];
-
-					int j = sc->tick[i];
-					sc->xhistory[i][j] = abs(sc->x[i] - sc->lastx[i]);
-					sc->yhistory[i][j] = abs(sc->y[i] - sc->lasty[i]);
-				}
-				sc->tick[i]++;
-			}
-			else if (sc->lastx[i] != -1) {
-				int absx = abs(sc->x[i] - sc->lastx[i]);
-				int absy = abs(sc->y[i] - sc->lasty[i]);
-
-				int newtotalx = sc->flextotalx[i] - sc->xhistory[i][0] + absx;
-				int newtotaly = sc->flextotaly[i] - sc->yhistory[i][0] + absy;
-
-				sc->totalx[i] += absx;
-				sc->totaly[i] += absy;
-
-				sc->flextotalx[i] -= sc->xhistory[i][0];
-				sc->flextotaly[i] -= sc->yhistory[i][0];
-				for (int j = 1;j < 10;j++) {
-					sc->xhistory[i][j - 1] = sc->xhistory[i][j];
-					sc->yhistory[i][j - 1] = sc->yhistory[i][j];
-				}
-				sc->flextotalx[i] += absx;
-				sc->flextotaly[i] += absy;
-
-				int j = 9;
-				sc->xhistory[i][j] = absx;
-				sc->yhistory[i][j] = absy;
-			}
-		}
-		if (sc->x[i] == -1) {
-			ClearTapDrag(pDevice, sc, i);
-			if (sc->lastx[i] != -1)
-				sc->ticksincelastrelease = -1;
-			for (int j = 0;j < 10;j++) {
-				sc->xhistory[i][j] = 0;
-				sc->yhistory[i][j] = 0;
-			}
-			if (sc->tick[i] < 10 && sc->tick[i] != 0) {
-				int avgp = sc->totalp[i] / sc->tick[i];
-				if (avgp > 7)
-					releasedfingers++;
-			}
-			sc->totalx[i] = 0;
-			sc->totaly[i] = 0;
-			sc->totalp[i] = 0;
-			sc->tick[i] = 0;
-			sc->truetick[i] = 0;
-
-			sc->blacklistedids[i] = 0;
-
-			if (sc->idForPanning == i) {
-				sc->panningActive = false;
-				sc->idForPanning = -1;
-			}
-		}
-		sc->lastx[i] = sc->x[i];
-		sc->lasty[i] = sc->y[i];
-		sc->lastp[i] = sc->p[i];
+	return status;
+}
+
+VOID
+ElanPipelineStart(
+	IN PDEVICE_CONTEXT pDevice
+	)
+/*++
+
+Routine Description:
+
+This routine empties the frame slots before polling starts in D0.
+
+Arguments:
+
+pDevice - the trackpad
+
+Return Value:
+
+None
+
+--*/
+{
+	ELAN_FRAME_PIPELINE *pipeline = &pDevice->Pipeline;
+
+	//
+	// Simulated transports are synchronous, they keep the plain poll
+	//
+	pipeline->Enabled = pipeline->Requested &&
+		pDevice->I2CContext.AsyncLock != NULL;
+
+	for (int i = 0; i < ELAN_FRAME_SLOTS; i++)
+		pipeline->Slots[i].State = ELAN_SLOT_FREE;
+	pipeline->FillSlot = 0;
+	pipeline->ProcessSlot = 0;
+	pipeline->Processing = 0;
+	pipeline->Booting = 0;
+	pipeline->Issuing = 0;
+}
+
+VOID
+ElanDisableInterruptLine(
+	IN PDEVICE_CONTEXT pDevice
+	)
+/*++
+
+Routine Description:
+
+This routine disables an interrupt line the self-test or the timer gave
+up on. It takes the interrupt lock, so it must be called at
+PASSIVE_LEVEL without PollLock held and never from the ISR.
+
+Arguments:
+
+pDevice - Pointer to the device context
+
+Return Value:
+
+None
+
+--*/
+{
+	ELAN_ACQUISITION *acq = &pDevice->Acquisition;
+
+	if (acq->LineDisabled || !pDevice->ConnectInterrupt)
+		return;
+
+	ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+		"Disabling interrupt line, self-test %d\n", acq->SelfTest);
+
+	acq->LineDisabled = TRUE;
+	WdfInterruptDisable(pDevice->Interrupt);
+}
+
+VOID
+ElanLineWorkItem(
+IN WDFWORKITEM  WorkItem
+)
+{
+	WDFDEVICE Device = (WDFDEVICE)WdfWorkItemGetParentObject(WorkItem);
+	PDEVICE_CONTEXT pDevice = GetDeviceContext(Device);
+
+	ElanDisableInterruptLine(pDevice);
+}
+
+VOID
+ElanResetWorkItem(
+IN WDFWORKITEM  WorkItem
+)
+{
+	WDFDEVICE Device = (WDFDEVICE)WdfWorkItemGetParentObject(WorkItem);
+	PDEVICE_CONTEXT pDevice = GetDeviceContext(Device);
+	ELAN_RECOVERY *recovery = &pDevice->Recovery;
+	NTSTATUS status;
+
+	//
+	// Boot under PollLock so that IOCTL_HID_WRITE_REPORT can't boot the
+	// pad at the same time and no synchronous frame read runs in the
+	// middle of it; BOOTTRACKPAD holds off the pipelined reads itself
+	//
+	WdfWaitLockAcquire(pDevice->PollLock, NULL);
+
+	recovery->ResetPending = FALSE;
+
+	if (pDevice->ConnectInterrupt){
+		status = ElanResetTrackpad(pDevice);
+		if (!NT_SUCCESS(status))
+			ElanPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+				"Trackpad reset failed, next after %d failures - %!STATUS!\n",
+				recovery->ResetAfter, status);
 	}
-	sc->ticksincelastrelease++;
 
-#pragma mark process tap to click
-	TapToClickOrDrag(pDevice, sc, releasedfingers);
+	WdfWaitLockRelease(pDevice->PollLock);
+}
+
+VOID
+ElanReadWriteWorkItem(
+IN WDFWORKITEM  WorkItem
+)
+{
+	WDFDEVICE Device = (WDFDEVICE)WdfWorkItemGetParentObject(WorkItem);
+	PDEVICE_CONTEXT pDevice = GetDeviceContext(Device);
+
+	if (pDevice->Pipeline.Enabled)
+		ElanPipelineDrain(pDevice);
+
+	//
+	// Only the timer's plain polls set PollBusy, completed pipelined
+	// reads just need draining
+	//
+	if (pDevice->PollBusy == 0)
+		return;
+
+	//
+	// The timer is one-shot, ElanAcquireFrame re-arms it once the poll
+	// has finished
+	//
+	if (pDevice->ConnectInterrupt)
+		ElanAcquireFrame(pDevice, ELAN_ACQUIRE_TIMER);
+
+	InterlockedExchange(&pDevice->PollBusy, 0);
+}
+
+VOID
+ElanArmPollTimer(
+	IN PDEVICE_CONTEXT pDevice,
+	IN ULONG Ms
+	)
+{
+	pDevice->Poll.ArmTime = KeQueryPerformanceCounter(NULL).QuadPart;
+	pDevice->Poll.ArmedMs = Ms;
+	WdfTimerStart(pDevice->Timer, WDF_REL_TIMEOUT_IN_MS(Ms));
+}
+
+static
+VOID
+ElanAccountTimerFire(
+	IN PDEVICE_CONTEXT pDevice
+	)
+/*++
+
+Routine Description:
+
+This routine measures how late the poll timer fired against the
+interval it was armed with, and the spacing of fires while the
+scheduler is active.
+
+Arguments:
+
+pDevice - the trackpad
+
+Return Value:
+
+None
 
-#pragma mark send to system
-	update_relative_mouse(pDevice, sc->buttonmask, sc->dx, sc->dy, sc->scrolly, sc->scrollx);
+--*/
+{
+	ELAN_POLL_SCHEDULER *poll = &pDevice->Poll;
+	ELAN_PERF_COUNTERS *perf = &pDevice->Perf;
+	LONGLONG now = KeQueryPerformanceCounter(NULL).QuadPart;
+	LONGLONG due = poll->ArmTime + (LONGLONG)poll->ArmedMs * perf->Frequency / 1000;
+	ULONGLONG jitter = (ULONGLONG)(now > due ? now - due : due - now);
+
+	perf->TimerFires++;
+	perf->TimerJitterTicks += jitter;
+	if (jitter > perf->TimerMaxJitterTicks)
+		perf->TimerMaxJitterTicks = jitter;
+
+	if (poll->State != ELAN_POLL_ACTIVE){
+		poll->LastActiveFire = 0;
+		return;
+	}
+
+	if (poll->LastActiveFire != 0){
+		perf->ActiveIntervals++;
+		perf->ActiveIntervalTicks += now - poll->LastActiveFire;
+	}
+	poll->LastActiveFire = now;
 }
 
-void TrackpadRawInput(PDEVICE_CONTEXT pDevice, struct csgesture_softc *sc, uint8_t report[ETP_MAX_REPORT_LEN], int tickinc){
-	if (report[0] == 0xff){
+void ElanTimerFunc(_In_ WDFTIMER hTimer){
+	WDFDEVICE Device = (WDFDEVICE)WdfTimerGetParentObject(hTimer);
+	PDEVICE_CONTEXT pDevice = GetDeviceContext(Device);
+
+	if (!pDevice->ConnectInterrupt)
+		return;
+
+	ElanAccountTimerFire(pDevice);
+
+	//
+	// Pipelined reads don't wait for the previous frame to be processed,
+	// so the timer keeps its own pace. Not while the line brings the
+	// frames: the ISR re-arms the timer too, and only passive callers
+	// can take PollLock around the arm.
+	//
+	if (pDevice->Pipeline.Enabled && pDevice->Acquisition.Source != ELAN_ACQUIRE_INTERRUPT){
+		ElanPipelineIssue(pDevice);
+		ElanArmPollTimer(pDevice, pDevice->Poll.NextMs);
 		return;
 	}
 
-	uint8_t *finger_data = &report[ETP_FINGER_DATA_OFFSET];
-	int i;
-	uint8_t tp_info = report[ETP_TOUCH_INFO_OFFSET];
-	uint8_t hover_info = report[ETP_HOVER_INFO_OFFSET];
-	bool contact_valid, hover_event;
-
-	int nfingers = 0;
-
-	for (int i = 0;i < 5; i++) {
-		sc->x[i] = -1;
-		sc->y[i] = -1;
-		sc->p[i] = -1;
-	}
-
-	hover_event = hover_info & 0x40;
-	for (i = 0; i < ETP_MAX_FINGERS; i++) {
-		contact_valid = tp_info & (1U << (3 + i));
-		unsigned int pos_x, pos_y;
-		unsigned int pressure, mk_x, mk_y;
-		unsigned int area_x, area_y, major, minor;
-		unsigned int scaled_pressure;
-
-		if (contact_valid) {
-			pos_x = ((finger_data[0] & 0xf0) << 4) |
-				finger_data[1];
-			pos_y = ((finger_data[0] & 0x0f) << 8) |
-				finger_data[2];
-
-			mk_x = (finger_data[3] & 0x0f);
-			mk_y = (finger_data[3] >> 4);
-			pressure = finger_data[4];
-
-			//map to cypress coordinates
-			//pos_y = 1500 - pos_y;
-			pos_y = pDevice->max_y - pos_y;
-			pos_x *= 2;
-			pos_x /= 7;
-			pos_y *= 2;
-			pos_y /= 7;
-
-
-			/*
-			* To avoid treating large finger as palm, let's reduce the
-			* width x and y per trace.
-			*/
-			area_x = mk_x;
-			area_y = mk_y;
-
-			major = max(area_x, area_y);
-			minor = min(area_x, area_y);
-
-			scaled_pressure = pressure;
-
-			if (scaled_pressure > ETP_MAX_PRESSURE)
-				scaled_pressure = ETP_MAX_PRESSURE;
-			sc->x[i] = pos_x;
-			sc->y[i] = pos_y;
-			sc->p[i] = scaled_pressure;
-		}
-		else {
-		}
+	if (InterlockedCompareExchange(&pDevice->PollBusy, 1, 0) != 0){
+		pDevice->Perf.WorkItemOverlaps++;
+		return;
+	}
 
-		if (contact_valid){
-			finger_data += ETP_FINGER_DATA_LEN;
-			nfingers++;
-		}
-		}
-	sc->buttondown = (tp_info & 0x01);
+	WdfWorkItemEnqueue(pDevice->PollWorkItem);
 
-	ProcessGesture(pDevice, sc);
+	return;
 }
\ No newline at end of file
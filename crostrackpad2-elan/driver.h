@@ -11,12 +11,41 @@ DriverEntry(
 
 EVT_WDF_DRIVER_DEVICE_ADD       OnDeviceAdd;
 EVT_WDF_OBJECT_CONTEXT_CLEANUP  OnDriverCleanup;
+EVT_WDF_OBJECT_CONTEXT_CLEANUP  OnDeviceCleanup;
 
-#define DRIVER_NAME       "ElanTP"
+//
+// Frame acquisition, see ELAN_ACQUISITION
+//
+
+VOID
+ElanAcquireFrame(
+	IN PDEVICE_CONTEXT pDevice,
+	IN ULONG Source
+	);
+
+VOID
+ElanDisableInterruptLine(
+	IN PDEVICE_CONTEXT pDevice
+	);
+
+VOID
+ElanArmPollTimer(
+	IN PDEVICE_CONTEXT pDevice,
+	IN ULONG Ms
+	);
 
-#define SIOCTL_TYPE 40000
+NTSTATUS
+ElanPipelineInitialize(
+	IN PDEVICE_CONTEXT pDevice
+	);
+
+VOID
+ElanPipelineStart(
+	IN PDEVICE_CONTEXT pDevice
+	);
+
+#define DRIVER_NAME       "ElanTP"
 
-#define IOCTL_SIOCTL_METHOD_OUT_DIRECT \
-    CTL_CODE( SIOCTL_TYPE, 0x901, METHOD_OUT_DIRECT , FILE_ANY_ACCESS  )
+#include "elanioctl.h"
 
 #endif
@@ -0,0 +1,39 @@
+#ifndef _ELANDEBUG_H_
+#define _ELANDEBUG_H_
+
+//
+// Debug output and the pool tag, apart from hiddevice.h so that the SPB
+// routines and the boot script build without the device context
+//
+
+#define DRIVERNAME                 "crostrackpad.sys: "
+
+#define CYAPA_POOL_TAG            (ULONG)'PAYC'
+
+//
+// Helper macros
+//
+
+#define DEBUG_LEVEL_ERROR   1
+#define DEBUG_LEVEL_INFO    2
+#define DEBUG_LEVEL_VERBOSE 3
+
+#define DBG_INIT  1
+#define DBG_PNP   2
+#define DBG_IOCTL 4
+
+#if 0
+#define ElanPrint(dbglevel, dbgcatagory, fmt, ...) {          \
+    if (ElanPrintDebugLevel >= dbglevel &&                         \
+        (ElanPrintDebugCatagories && dbgcatagory))                 \
+	    {                                                           \
+        DbgPrint(DRIVERNAME);                                   \
+        DbgPrint(fmt, __VA_ARGS__);                             \
+	    }                                                           \
+}
+#else
+#define ElanPrint(dbglevel, fmt, ...) {                       \
+}
+#endif
+
+#endif
@@ -0,0 +1,376 @@
+#ifndef _ELANIOCTL_H_
+#define _ELANIOCTL_H_
+
+//
+// Definitions shared with user-mode tools talking to the
+// \\.\ELANTP control device. Only fixed-size types are used here so the
+// layouts are identical for 32-bit tools on a 64-bit kernel.
+//
+
+#define SIOCTL_TYPE 40000
+
+// Returns an ELAN_STATS block
+#define IOCTL_SIOCTL_METHOD_OUT_DIRECT \
+    CTL_CODE( SIOCTL_TYPE, 0x901, METHOD_OUT_DIRECT , FILE_ANY_ACCESS  )
+
+#define IOCTL_ELAN_READ_CAPTURE \
+    CTL_CODE( SIOCTL_TYPE, 0x902, METHOD_OUT_DIRECT , FILE_ANY_ACCESS  )
+
+#define IOCTL_ELAN_READ_LATENCY \
+    CTL_CODE( SIOCTL_TYPE, 0x903, METHOD_OUT_DIRECT , FILE_ANY_ACCESS  )
+
+// 0x904 ran the gesture engine microbenchmarks, see elan-micro-bench
+
+#define IOCTL_ELAN_READ_CONTACTS \
+    CTL_CODE( SIOCTL_TYPE, 0x905, METHOD_OUT_DIRECT , FILE_ANY_ACCESS  )
+
+#define IOCTL_ELAN_READ_SPB_TRACE \
+    CTL_CODE( SIOCTL_TYPE, 0x906, METHOD_OUT_DIRECT , FILE_ANY_ACCESS  )
+
+//
+// Raw report capture format.
+//
+// IOCTL_ELAN_READ_CAPTURE drains the capture ring into an
+// ELAN_CAPTURE_HEADER followed by RecordCount ELAN_CAPTURE_RECORDs. The
+// same layout is used on disk: a tool appends the records of successive
+// reads behind one header and patches RecordCount, and a replay tool can
+// map the file and hand each Report straight to TrackpadRawInput.
+//
+
+#define ELAN_CAPTURE_MAGIC          0x50435445  // 'ETCP'
+#define ELAN_CAPTURE_VERSION        3
+#define ELAN_CAPTURE_REPORT_LEN     34
+
+#pragma pack(push, 8)
+typedef struct _ELAN_CAPTURE_HEADER
+{
+	ULONG      Magic;
+	ULONG      Version;
+	ULONG      HeaderSize;
+	ULONG      RecordSize;
+
+	ULONGLONG  RecordCount;
+
+	// Units of ELAN_CAPTURE_RECORD.Timestamp per second
+	ULONGLONG  TimestampFrequency;
+
+	// Records overwritten in the ring before they could be read
+	ULONGLONG  Overwritten;
+} ELAN_CAPTURE_HEADER;
+
+typedef struct _ELAN_CAPTURE_RECORD
+{
+	// KeQueryInterruptTime() when the report was processed
+	ULONGLONG  Timestamp;
+
+	// Milliseconds since the previous frame, handed to TrackpadRawInput
+	// with this report
+	ULONG      IntervalMs;
+
+	// FNV-1a digest and number of the HID reports the gesture engine
+	// sent for this frame, the golden output for replays
+	ULONG      OutputDigest;
+
+	UCHAR      Report[ELAN_CAPTURE_REPORT_LEN];
+
+	UCHAR      OutputCount;
+
+	UCHAR      Reserved[5];
+} ELAN_CAPTURE_RECORD;
+
+//
+// Input latency histograms.
+//
+// IOCTL_ELAN_READ_LATENCY returns an ELAN_LATENCY_STATS. Latency runs
+// from the SPB read of a frame completing to
+// ElanProcessVendorReport completing the IOCTL_HID_READ_REPORT carrying a
+// report built from it, in microseconds. Bucket 0 counts latencies under
+// 1us and bucket n those in [2^(n-1), 2^n) us; the last bucket also
+// takes everything longer.
+//
+
+#define ELAN_LATENCY_VERSION        1
+#define ELAN_LATENCY_BUCKETS        24
+
+typedef struct _ELAN_LATENCY_HISTOGRAM
+{
+	ULONGLONG  Count;
+	ULONGLONG  TotalUs;
+	ULONGLONG  MaxUs;
+	ULONGLONG  Buckets[ELAN_LATENCY_BUCKETS];
+} ELAN_LATENCY_HISTOGRAM;
+
+typedef struct _ELAN_LATENCY_STATS
+{
+	ULONG      Version;
+	ULONG      Size;
+
+	ELAN_LATENCY_HISTOGRAM  Mouse;
+	ELAN_LATENCY_HISTOGRAM  Keyboard;
+} ELAN_LATENCY_STATS;
+
+//
+// Hot-path counters.
+//
+// IOCTL_SIOCTL_METHOD_OUT_DIRECT returns an ELAN_STATS. Stage costs are
+// in PerformanceFrequency ticks per second. Newer versions only append
+// fields, so tools should check Size before reading past the end of an
+// older block.
+//
+
+#define ELAN_STATS_VERSION          11
+
+#define ELAN_SELFTEST_NOT_RUN       0   // interrupts not requested
+#define ELAN_SELFTEST_PASSED        1
+#define ELAN_SELFTEST_STUCK_LINE    2   // storm of interrupts with no data
+#define ELAN_SELFTEST_DEAD_LINE     3   // frames arrived without interrupts
+#define ELAN_SELFTEST_RUNNING       4   // watching the line, still polling
+
+typedef struct _ELAN_STAGE_TIMING
+{
+	ULONGLONG  Calls;
+	ULONGLONG  TotalTicks;
+	ULONGLONG  MaxTicks;
+} ELAN_STAGE_TIMING;
+
+#define ELAN_SPB_POOL_CLASSES       2
+
+typedef struct _ELAN_SPB_POOL_STATS
+{
+	ULONG      BufferSize;
+	ULONG      Buffers;
+	ULONG      InUse;
+	ULONG      HighWater;
+	ULONGLONG  Acquired;
+	ULONGLONG  Fallbacks;
+} ELAN_SPB_POOL_STATS;
+
+#define ELAN_BOOT_STEPS             16
+
+typedef struct _ELAN_STATS
+{
+	ULONG      Version;
+	ULONG      Size;
+
+	ULONGLONG  PerformanceFrequency;
+
+	// Polling work items run, and timer ticks skipped because the
+	// previous poll was still running
+	ULONGLONG  FramesPolled;
+	ULONGLONG  WorkItemOverlaps;
+
+	// Frames the trackpad returned with nothing to report (0xff), that
+	// failed validation, or whose read failed; all three reprocess the
+	// last good frame
+	ULONGLONG  EmptyFrames;
+	ULONGLONG  MalformedFrames;
+	ULONGLONG  SpbErrors;
+	ULONGLONG  ReprocessedFrames;
+
+	// HID reports handed to ElanProcessVendorReport, those that found
+	// no pending IOCTL_HID_READ_REPORT, and keyboard shortcuts fired
+	ULONGLONG  ReportsEmitted;
+	ULONGLONG  ReportsDropped;
+	ULONGLONG  KeyboardGestures;
+
+	ULONGLONG  OverBudgetFrames;
+
+	ELAN_STAGE_TIMING  SpbRead;
+	ELAN_STAGE_TIMING  Decode;
+	ELAN_STAGE_TIMING  Gesture;
+	ELAN_STAGE_TIMING  Frame;
+
+	// Version 2: current poll scheduler state (0 active, 1 cooldown,
+	// 2 idle) and the polls made in each state
+	ULONG      PollState;
+	ULONG      Reserved;
+	ULONGLONG  ActivePolls;
+	ULONGLONG  CooldownPolls;
+	ULONGLONG  IdlePolls;
+
+	// Version 3: frame source (0 timer, 1 interrupt), interrupt line
+	// self-test result, interrupts taken, those that found no data,
+	// and frames the line failed to signal
+	ULONG      AcquisitionSource;
+	ULONG      SelfTest;
+	ULONGLONG  Interrupts;
+	ULONGLONG  SpuriousInterrupts;
+	ULONGLONG  MissedInterrupts;
+
+	// Version 4: frames identical to the previous one that arrived with
+	// the gesture engine at rest, and only advanced its timers
+	ULONGLONG  UnchangedFrames;
+
+	// Version 5: reads started asynchronously by the timer, those that
+	// went out while the previous frame was still being processed, and
+	// ticks that found the bus busy or no free frame slot
+	ULONG      Pipelined;
+	ULONG      Reserved2;
+	ULONGLONG  PipelinedReads;
+	ULONGLONG  OverlappedReads;
+	ULONGLONG  PipelineStalls;
+
+	// Version 6: whether the poll timer is high resolution, the active
+	// poll interval asked for, and how the timer kept to it. Jitter is
+	// how far each fire was from its due time; the achieved active rate
+	// is ActiveIntervals per ActiveIntervalTicks.
+	ULONG      HighResolutionTimer;
+	ULONG      PollActiveMs;
+	ULONGLONG  TimerFires;
+	ULONGLONG  TimerJitterTicks;
+	ULONGLONG  TimerMaxJitterTicks;
+	ULONGLONG  ActiveIntervals;
+	ULONGLONG  ActiveIntervalTicks;
+
+	// Version 7: pointer prediction horizon in milliseconds (0 off), and
+	// the predictions scored once their horizon passed, with the summed
+	// squared distance from where the contact really was to the
+	// prediction and to the unpredicted position
+	ULONG      PredictionMs;
+	ULONG      Reserved3;
+	ULONGLONG  PredictionSamples;
+	ULONGLONG  PredictionErrorSq;
+	ULONGLONG  UnpredictedErrorSq;
+
+	// Version 8: register reads sent as a single write-read sequence,
+	// and as a separate write and read
+	ULONGLONG  SequenceReads;
+	ULONGLONG  SplitReads;
+
+	// Version 9: SPB transfer buffer pool, smallest class first. Each
+	// class's buffer size and count, buffers in use now and at most,
+	// buffers handed out, and transfers sized for the class that
+	// allocated because it and every larger class were in use; then
+	// transfers too large for any class.
+	ELAN_SPB_POOL_STATS  SpbPool[ELAN_SPB_POOL_CLASSES];
+	ULONGLONG  SpbPoolOversize;
+
+	// Version 10: trackpad boots run, and for the last one the steps of
+	// its script, those whose transaction failed, and the ticks spent in
+	// total and in each step
+	ULONG      Boots;
+	ULONG      BootSteps;
+	ULONG      BootFailedSteps;
+	ULONG      Reserved4;
+	ULONGLONG  BootTicks;
+	ULONGLONG  BootStepTicks[ELAN_BOOT_STEPS];
+
+	// Version 11: failed bus transfers by cause (address not
+	// acknowledged, timeout, short read, anything else), retries sent,
+	// transfers a retry rescued, and trackpad resets after a run of
+	// frames that failed to read
+	ULONGLONG  SpbNacks;
+	ULONGLONG  SpbTimeouts;
+	ULONGLONG  SpbShortReads;
+	ULONGLONG  SpbOtherErrors;
+	ULONGLONG  SpbRetries;
+	ULONGLONG  SpbRecovered;
+	ULONGLONG  TrackpadResets;
+} ELAN_STATS;
+
+//
+// Contact state.
+//
+// IOCTL_ELAN_READ_CONTACTS returns an ELAN_CONTACTS: the contacts and
+// button state the gesture engine was left with by the last frame it
+// processed. Contacts that are up have X, Y and Pressure of -1.
+//
+
+#define ELAN_CONTACTS_VERSION       1
+#define ELAN_CONTACTS_MAX           5
+
+#define ELAN_CONTACTS_BUTTON_DOWN   0x01    // clickpad pressed
+#define ELAN_CONTACTS_TAP_DRAG      0x02    // button held by a tap
+#define ELAN_CONTACTS_PANNING       0x04
+#define ELAN_CONTACTS_SCROLLING     0x08
+
+typedef struct _ELAN_CONTACT
+{
+	LONG       X;
+	LONG       Y;
+	LONG       Pressure;
+
+	// Milliseconds the contact has been down
+	ULONG      DownMs;
+} ELAN_CONTACT;
+
+typedef struct _ELAN_CONTACTS
+{
+	ULONG      Version;
+	ULONG      Size;
+
+	// KeQueryInterruptTime() when the frame was processed, and the
+	// number of frames published since the device started
+	ULONGLONG  Timestamp;
+	ULONGLONG  Frame;
+
+	ULONG      ContactCount;
+	ULONG      Flags;
+
+	// HID mouse button mask being reported
+	ULONG      Buttons;
+	ULONG      Reserved;
+
+	ELAN_CONTACT  Contacts[ELAN_CONTACTS_MAX];
+} ELAN_CONTACTS;
+
+//
+// Bus transaction trace.
+//
+// IOCTL_ELAN_READ_SPB_TRACE returns an ELAN_SPB_TRACE_HEADER followed by
+// RecordCount ELAN_SPB_TRACE_RECORDs: the bus transactions since the
+// previous read, oldest first, as many as the buffer holds. Each attempt
+// at a transaction is a record. Transactions are numbered from 1, and
+// those that left the driver's ring before a read got to them are
+// counted in Lost. Times are in TimestampFrequency ticks per second.
+// Drivers with the SpbTrace setting off fail the request with
+// STATUS_DEVICE_NOT_READY.
+//
+
+#define ELAN_SPB_TRACE_VERSION      1
+
+#define ELAN_SPB_TRACE_WRITE        0
+#define ELAN_SPB_TRACE_READ         1
+#define ELAN_SPB_TRACE_READ_BATCH   2   // several registers, one sequence
+#define ELAN_SPB_TRACE_ASYNC        0x80
+
+typedef struct _ELAN_SPB_TRACE_HEADER
+{
+	ULONG      Version;
+	ULONG      HeaderSize;
+	ULONG      RecordSize;
+	ULONG      RecordCount;
+
+	ULONGLONG  TimestampFrequency;
+
+	// Transactions traced since the device started
+	ULONGLONG  Transactions;
+	ULONGLONG  Lost;
+} ELAN_SPB_TRACE_HEADER;
+
+typedef struct _ELAN_SPB_TRACE_RECORD
+{
+	ULONGLONG  Sequence;
+
+	// When the transaction asked for the bus, how long it waited for
+	// it, and how long it held it
+	ULONGLONG  Timestamp;
+	ULONG      WaitTicks;
+	ULONG      BusTicks;
+
+	LONG       Status;
+
+	// Bytes read, or written after the register address
+	ULONG      Length;
+
+	// First register of a batch
+	USHORT     Address;
+	UCHAR      Type;
+
+	// Retries before this attempt
+	UCHAR      Attempt;
+	ULONG      Reserved;
+} ELAN_SPB_TRACE_RECORD;
+#pragma pack(pop)
+
+#endif
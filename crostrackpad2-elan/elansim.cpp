@@ -0,0 +1,449 @@
+#include <ntddk.h>
+#include <wdf.h>
+#include "elansim.h"
+
+//
+// Raw coordinates assume the default geometry of ElanSimInitialize
+// (3048 x 1672). Fields: down, up, start x/y, end x/y, jitter, pressure,
+// width in traces.
+//
+
+#define MS(ms) ((ms) * 1000)
+
+const ELAN_SIM_SCRIPT ElanSimScripts[ELAN_SIM_SCRIPT_COUNT] = {
+	// ELAN_SIM_SCRIPT_NONE
+	{ 0 },
+
+	// ELAN_SIM_SCRIPT_MOVE: one finger sweeps right
+	{ MS(600), 0, 0, 1, {
+		{ 0, MS(400), 800, 800, 2000, 900, 0, 40, 4 },
+	} },
+
+	// ELAN_SIM_SCRIPT_TAP: one short contact
+	{ MS(400), 0, 0, 1, {
+		{ MS(20), MS(70), 1500, 800, 1500, 800, 0, 40, 4 },
+	} },
+
+	// ELAN_SIM_SCRIPT_CLICK_DRAG: press the pad and drag
+	{ MS(800), MS(100), MS(500), 1, {
+		{ 0, MS(600), 1000, 1200, 1800, 1200, 0, 60, 5 },
+	} },
+
+	// ELAN_SIM_SCRIPT_SCROLL: two fingers move down together
+	{ MS(700), 0, 0, 2, {
+		{ 0, MS(500), 1200, 600, 1200, 1100, 0, 40, 4 },
+		{ 0, MS(500), 1500, 600, 1500, 1100, 0, 40, 4 },
+	} },
+
+	// ELAN_SIM_SCRIPT_PINCH: two fingers converge
+	{ MS(700), 0, 0, 2, {
+		{ 0, MS(500), 1000, 800, 1400, 800, 0, 40, 4 },
+		{ 0, MS(500), 2000, 800, 1600, 800, 0, 40, 4 },
+	} },
+
+	// ELAN_SIM_SCRIPT_SWIPE3: three fingers swipe right
+	{ MS(700), 0, 0, 3, {
+		{ 0, MS(400), 800, 800, 1800, 800, 0, 40, 4 },
+		{ 0, MS(400), 1100, 900, 2100, 900, 0, 40, 4 },
+		{ 0, MS(400), 1400, 800, 2400, 800, 0, 40, 4 },
+	} },
+
+	// ELAN_SIM_SCRIPT_SWIPE4: four fingers swipe up
+	{ MS(700), 0, 0, 4, {
+		{ 0, MS(400), 900, 1300, 900, 500, 0, 40, 4 },
+		{ 0, MS(400), 1200, 1350, 1200, 550, 0, 40, 4 },
+		{ 0, MS(400), 1500, 1350, 1500, 550, 0, 40, 4 },
+		{ 0, MS(400), 1800, 1300, 1800, 500, 0, 40, 4 },
+	} },
+
+	// ELAN_SIM_SCRIPT_PALM: resting palm while a finger moves
+	{ MS(800), 0, 0, 2, {
+		{ 0, MS(800), 300, 1400, 320, 1400, 4, 200, 15 },
+		{ MS(100), MS(600), 1500, 700, 2200, 700, 0, 40, 4 },
+	} },
+
+	// ELAN_SIM_SCRIPT_JITTER5: five noisy resting fingers
+	{ MS(500), 0, 0, 5, {
+		{ 0, MS(500), 700, 900, 700, 900, 6, 40, 4 },
+		{ 0, MS(500), 1100, 700, 1100, 700, 6, 40, 4 },
+		{ 0, MS(500), 1500, 650, 1500, 650, 6, 40, 4 },
+		{ 0, MS(500), 1900, 700, 1900, 700, 6, 40, 4 },
+		{ 0, MS(500), 2400, 1200, 2400, 1200, 6, 40, 4 },
+	} },
+};
+
+#undef MS
+
+static
+int
+ElanSimRandom(
+	IN OUT ULONG *Seed
+	)
+{
+	*Seed = *Seed * 1103515245 + 12345;
+	return (*Seed >> 16) & 0x7fff;
+}
+
+static
+int
+ElanSimInterpolate(
+	IN int Start,
+	IN int End,
+	IN ULONG Elapsed,
+	IN ULONG Span
+	)
+{
+	return Start + (int)((LONGLONG)(End - Start) * Elapsed / Span);
+}
+
+VOID
+ElanSimBuildReport(
+	IN const ELAN_SIM_SCRIPT *Script,
+	IN ULONG TimeUs,
+	IN OUT ULONG *Seed,
+	OUT uint8_t Report[ETP_MAX_REPORT_LEN]
+	)
+/*++
+
+Routine Description:
+
+This routine packs the contacts of a finger script at a point in time
+into an Elan report, laid out the way TrackpadRawInput decodes it.
+
+Arguments:
+
+Script - The finger script
+TimeUs - Microseconds since the start of the script
+Seed   - State of the jitter generator
+Report - Receives the report
+
+Return Value:
+
+None
+
+--*/
+{
+	uint8_t *finger_data = &Report[ETP_FINGER_DATA_OFFSET];
+	uint8_t tp_info = 0;
+
+	RtlZeroMemory(Report, ETP_MAX_REPORT_LEN);
+	Report[0] = ETP_I2C_REPORT_LEN;
+	Report[ETP_REPORT_ID_OFFSET] = ETP_REPORT_ID;
+
+	for (ULONG i = 0; i < Script->FingerCount && i < ETP_MAX_FINGERS; i++) {
+		const ELAN_SIM_FINGER *finger = &Script->Fingers[i];
+
+		if (TimeUs < finger->DownUs || TimeUs >= finger->UpUs)
+			continue;
+
+		ULONG elapsed = TimeUs - finger->DownUs;
+		ULONG span = finger->UpUs - finger->DownUs;
+		int x = ElanSimInterpolate(finger->StartX, finger->EndX, elapsed, span);
+		int y = ElanSimInterpolate(finger->StartY, finger->EndY, elapsed, span);
+
+		if (finger->Jitter != 0) {
+			x += ElanSimRandom(Seed) % (2 * finger->Jitter + 1) - finger->Jitter;
+			y += ElanSimRandom(Seed) % (2 * finger->Jitter + 1) - finger->Jitter;
+		}
+		x = max(0, min(x, 0xfff));
+		y = max(0, min(y, 0xfff));
+
+		finger_data[0] = ((x >> 4) & 0xf0) | ((y >> 8) & 0x0f);
+		finger_data[1] = x & 0xff;
+		finger_data[2] = y & 0xff;
+		finger_data[3] = ((finger->Width & 0x0f) << 4) | (finger->Width & 0x0f);
+		finger_data[4] = finger->Pressure;
+
+		tp_info |= 1U << (3 + i);
+		finger_data += ETP_FINGER_DATA_LEN;
+	}
+
+	if (TimeUs >= Script->ButtonDownUs && TimeUs < Script->ButtonUpUs)
+		tp_info |= 0x01;
+
+	Report[ETP_TOUCH_INFO_OFFSET] = tp_info;
+}
+
+static
+BOOLEAN
+ElanSimBeginTransfer(
+	IN ELAN_SIM_DEVICE *Sim,
+	IN ULONG Length
+	)
+{
+	ULONG latency = Sim->LatencyUs + Sim->LatencyUsPerByte * Length;
+
+	Sim->Transfers++;
+	Sim->BytesMoved += Length;
+	Sim->BusMicroseconds += latency;
+
+	if (latency != 0)
+		Sim->Clock->Stall(latency);
+
+	if (Sim->ErrorInterval != 0 && (Sim->Transfers % Sim->ErrorInterval) == 0)
+	{
+		Sim->InjectedErrors++;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static
+VOID
+ElanSimPut16(
+	OUT uint8_t *Buffer,
+	IN ULONG Length,
+	IN uint16_t Value
+	)
+{
+	if (Length > 0)
+		Buffer[0] = Value & 0xff;
+	if (Length > 1)
+		Buffer[1] = Value >> 8;
+}
+
+static
+NTSTATUS
+ElanSimWrite(
+	IN PVOID Context,
+	IN PVOID Buffer,
+	IN ULONG Length
+	)
+{
+	ELAN_SIM_DEVICE *Sim = (ELAN_SIM_DEVICE *)Context;
+	uint8_t *data = (uint8_t *)Buffer;
+
+	if (!ElanSimBeginTransfer(Sim, Length))
+		return Sim->ErrorStatus != STATUS_SUCCESS ? Sim->ErrorStatus : STATUS_IO_TIMEOUT;
+
+	//
+	// A single byte sets the pointer for report reads, two bytes select
+	// a command register for reading and four bytes write a command.
+	//
+	if (Length == 1)
+	{
+		Sim->ReportPointer = TRUE;
+		return STATUS_SUCCESS;
+	}
+
+	if (Length < 2)
+		return STATUS_INVALID_PARAMETER;
+
+	Sim->ReportPointer = FALSE;
+	Sim->Command = data[0] | (data[1] << 8);
+
+	if (Length < 4)
+		return STATUS_SUCCESS;
+
+	uint16_t value = data[2] | (data[3] << 8);
+
+	switch (Sim->Command)
+	{
+	case ETP_I2C_STAND_CMD:
+		if (value == ETP_I2C_RESET)
+		{
+			Sim->ResetPending = TRUE;
+			Sim->Awake = FALSE;
+			Sim->Mode = 0;
+		}
+		else if (value == ETP_I2C_WAKE_UP)
+			Sim->Awake = TRUE;
+		else if (value == ETP_I2C_SLEEP)
+			Sim->Awake = FALSE;
+		break;
+	case ETP_I2C_SET_CMD:
+		Sim->Mode = value;
+		break;
+	case ETP_I2C_CALIBRATE_CMD:
+		Sim->Calibrating = (value != 0);
+		break;
+	}
+	return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+ElanSimRead(
+	IN PVOID Context,
+	IN PVOID Buffer,
+	IN ULONG Length,
+	OUT ULONG_PTR *BytesRead
+	)
+{
+	ELAN_SIM_DEVICE *Sim = (ELAN_SIM_DEVICE *)Context;
+	uint8_t *data = (uint8_t *)Buffer;
+
+	*BytesRead = 0;
+
+	if (!ElanSimBeginTransfer(Sim, Length))
+	{
+		if (Sim->ErrorStatus != STATUS_SUCCESS)
+			return Sim->ErrorStatus;
+		Length /= 2;
+	}
+
+	RtlZeroMemory(data, Length);
+
+	if (Sim->ReportPointer)
+	{
+		if (Sim->ResetPending)
+		{
+			//
+			// The first read after a reset returns the 0x0000 reset
+			// acknowledge
+			//
+			Sim->ResetPending = FALSE;
+		}
+		else if (Sim->Awake && (Sim->Mode & ETP_ENABLE_ABS))
+		{
+			if (Sim->Script != NULL)
+			{
+				ULONG elapsedUs = (ULONG)((Sim->Clock->Now() - Sim->ScriptStart) / 10);
+
+				ElanSimBuildReport(Sim->Script,
+					elapsedUs % Sim->Script->DurationUs,
+					&Sim->Seed,
+					Sim->Report);
+			}
+			RtlCopyMemory(data, Sim->Report, min(Length, (ULONG)ETP_MAX_REPORT_LEN));
+		}
+		else
+			RtlFillMemory(data, Length, 0xff);
+
+		*BytesRead = Length;
+		return STATUS_SUCCESS;
+	}
+
+	switch (Sim->Command)
+	{
+	case ETP_I2C_DESC_CMD:
+		ElanSimPut16(data, Length, ETP_I2C_DESC_LENGTH);
+		if (Length >= 4)
+			ElanSimPut16(data + 2, Length - 2, 0x0100);
+		if (Length >= 6)
+			ElanSimPut16(data + 4, Length - 4, ETP_I2C_REPORT_DESC_LENGTH);
+		break;
+	case ETP_I2C_UNIQUEID_CMD:
+		ElanSimPut16(data, Length, Sim->ProductId);
+		break;
+	case ETP_I2C_FW_VERSION_CMD:
+		ElanSimPut16(data, Length, Sim->FwVersion);
+		break;
+	case ETP_I2C_FW_CHECKSUM_CMD:
+		ElanSimPut16(data, Length, Sim->FwChecksum);
+		break;
+	case ETP_I2C_SM_VERSION_CMD:
+		ElanSimPut16(data, Length, Sim->SmVersion);
+		break;
+	case ETP_I2C_IAP_VERSION_CMD:
+		ElanSimPut16(data, Length, Sim->IapVersion);
+		break;
+	case ETP_I2C_PRESSURE_CMD:
+		ElanSimPut16(data, Length, 0);
+		break;
+	case ETP_I2C_MAX_X_AXIS_CMD:
+		ElanSimPut16(data, Length, Sim->MaxX);
+		break;
+	case ETP_I2C_MAX_Y_AXIS_CMD:
+		ElanSimPut16(data, Length, Sim->MaxY);
+		break;
+	case ETP_I2C_XY_TRACENUM_CMD:
+		ElanSimPut16(data, Length, Sim->XTraces | (Sim->YTraces << 8));
+		break;
+	case ETP_I2C_CALIBRATE_CMD:
+		//
+		// Calibration completes by the time it is polled
+		//
+		Sim->Calibrating = FALSE;
+		break;
+	default:
+		//
+		// Report descriptor and unmodelled registers read as zeroes
+		//
+		break;
+	}
+
+	*BytesRead = Length;
+	return STATUS_SUCCESS;
+}
+
+const SPB_TRANSPORT ElanSimTransport = {
+	ElanSimWrite,
+	ElanSimRead
+};
+
+VOID
+ElanSimInitialize(
+	OUT ELAN_SIM_DEVICE *Sim
+	)
+/*++
+
+Routine Description:
+
+This routine resets the model to an idle trackpad with the geometry of
+the Acer C720P's Elan pad and a bus that neither stalls nor fails,
+running on ElanSimClock.
+
+Arguments:
+
+Sim - The simulated device
+
+Return Value:
+
+None
+
+--*/
+{
+	RtlZeroMemory(Sim, sizeof(*Sim));
+
+	Sim->ProductId = 0x0e;
+	Sim->FwVersion = 0x02;
+	Sim->FwChecksum = 0x3b5c;
+	Sim->SmVersion = 0x01;
+	Sim->IapVersion = 0x06;
+	Sim->MaxX = 3048;
+	Sim->MaxY = 1672;
+	Sim->XTraces = 24;
+	Sim->YTraces = 13;
+
+	Sim->Report[ETP_REPORT_ID_OFFSET] = ETP_REPORT_ID;
+
+	Sim->ErrorStatus = STATUS_IO_TIMEOUT;
+	Sim->Clock = &ElanSimClock;
+}
+
+VOID
+ElanSimRunScript(
+	IN ELAN_SIM_DEVICE *Sim,
+	IN ULONG Script
+	)
+/*++
+
+Routine Description:
+
+This routine makes report reads follow one of ElanSimScripts, looping,
+or return an idle pad for ELAN_SIM_SCRIPT_NONE.
+
+Arguments:
+
+Sim    - The simulated device
+Script - An elan_sim_script value
+
+Return Value:
+
+None
+
+--*/
+{
+	if (Script == ELAN_SIM_SCRIPT_NONE || Script >= ELAN_SIM_SCRIPT_COUNT)
+	{
+		Sim->Script = NULL;
+		RtlZeroMemory(Sim->Report, sizeof(Sim->Report));
+		Sim->Report[ETP_REPORT_ID_OFFSET] = ETP_REPORT_ID;
+		return;
+	}
+
+	Sim->Script = &ElanSimScripts[Script];
+	Sim->ScriptStart = Sim->Clock->Now();
+	Sim->Seed = 1;
+}
@@ -0,0 +1,175 @@
+#ifndef _ELANSIM_H_
+#define _ELANSIM_H_
+
+//
+// Register model of an Elan I2C trackpad, attached as an SPB_TRANSPORT.
+// Lets BOOTTRACKPAD and the polling loop run without hardware, and
+// measures how much bus time they would cost. The model itself needs
+// neither WDF nor the kernel, so it also builds as user-mode code. The
+// driver only builds it with ELAN_SIMULATOR, in Debug configurations.
+//
+
+#include "spbtransport.h"
+#include "elantp.h"
+
+typedef struct _SPB_CONTEXT SPB_CONTEXT;
+
+//
+// Where the model's time comes from. A transfer spends its latency in
+// Stall, and scripts play back against Now, in 100ns units.
+// ElanSimInitialize selects ElanSimClock, which each build of the model
+// provides; the driver's spins the processor and reads the interrupt
+// time.
+//
+
+typedef struct _ELAN_SIM_CLOCK
+{
+	VOID (*Stall)(ULONG Microseconds);
+	ULONGLONG (*Now)(VOID);
+} ELAN_SIM_CLOCK;
+
+extern const ELAN_SIM_CLOCK ElanSimClock;
+
+//
+// Parametric finger scripts. Each finger moves linearly between two
+// points in raw Elan coordinates while it is down, which covers swipes,
+// pinches (fingers converging or diverging) and taps (short contacts),
+// optionally with jitter. Palms are wide, heavy contacts.
+//
+
+typedef struct _ELAN_SIM_FINGER
+{
+	ULONG DownUs;
+	ULONG UpUs;
+
+	uint16_t StartX;
+	uint16_t StartY;
+	uint16_t EndX;
+	uint16_t EndY;
+
+	uint16_t Jitter;
+	uint8_t Pressure;
+	uint8_t Width;
+} ELAN_SIM_FINGER;
+
+typedef struct _ELAN_SIM_SCRIPT
+{
+	ULONG DurationUs;
+
+	ULONG ButtonDownUs;
+	ULONG ButtonUpUs;
+
+	ULONG FingerCount;
+	ELAN_SIM_FINGER Fingers[ETP_MAX_FINGERS];
+} ELAN_SIM_SCRIPT;
+
+enum elan_sim_script {
+	ELAN_SIM_SCRIPT_NONE = 0,
+	ELAN_SIM_SCRIPT_MOVE,
+	ELAN_SIM_SCRIPT_TAP,
+	ELAN_SIM_SCRIPT_CLICK_DRAG,
+	ELAN_SIM_SCRIPT_SCROLL,
+	ELAN_SIM_SCRIPT_PINCH,
+	ELAN_SIM_SCRIPT_SWIPE3,
+	ELAN_SIM_SCRIPT_SWIPE4,
+	ELAN_SIM_SCRIPT_PALM,
+	ELAN_SIM_SCRIPT_JITTER5,
+	ELAN_SIM_SCRIPT_COUNT
+};
+
+extern const ELAN_SIM_SCRIPT ElanSimScripts[ELAN_SIM_SCRIPT_COUNT];
+
+VOID
+ElanSimBuildReport(
+	IN const ELAN_SIM_SCRIPT *Script,
+	IN ULONG TimeUs,
+	IN OUT ULONG *Seed,
+	OUT uint8_t Report[ETP_MAX_REPORT_LEN]
+	);
+
+typedef struct _ELAN_SIM_DEVICE
+{
+	//
+	// Identity and geometry reported to BOOTTRACKPAD
+	//
+
+	uint8_t ProductId;
+	uint8_t FwVersion;
+	uint16_t FwChecksum;
+	uint8_t SmVersion;
+	uint8_t IapVersion;
+	uint16_t MaxX;
+	uint16_t MaxY;
+	uint8_t XTraces;
+	uint8_t YTraces;
+
+	//
+	// Register state
+	//
+
+	uint16_t Command;
+	BOOLEAN ReportPointer;
+	BOOLEAN ResetPending;
+	BOOLEAN Awake;
+	uint16_t Mode;
+	BOOLEAN Calibrating;
+
+	//
+	// Frame returned to report reads
+	//
+
+	uint8_t Report[ETP_MAX_REPORT_LEN];
+
+	//
+	// When set, report reads return the script's frame for the time
+	// elapsed since ScriptStart, looping over the script's duration
+	//
+
+	const ELAN_SIM_SCRIPT *Script;
+	ULONGLONG ScriptStart;
+	ULONG Seed;
+
+	//
+	// Bus behaviour: LatencyUs per transfer plus LatencyUsPerByte for
+	// each byte moved. Every ErrorInterval'th transfer fails with
+	// ErrorStatus, or returns half the bytes when ErrorStatus is
+	// STATUS_SUCCESS. An ErrorInterval of 0 never fails.
+	//
+
+	ULONG LatencyUs;
+	ULONG LatencyUsPerByte;
+	ULONG ErrorInterval;
+	NTSTATUS ErrorStatus;
+
+	const ELAN_SIM_CLOCK *Clock;
+
+	//
+	// Accounting
+	//
+
+	ULONGLONG Transfers;
+	ULONGLONG BytesMoved;
+	ULONGLONG BusMicroseconds;
+	ULONGLONG InjectedErrors;
+} ELAN_SIM_DEVICE;
+
+extern const SPB_TRANSPORT ElanSimTransport;
+
+VOID
+ElanSimInitialize(
+	OUT ELAN_SIM_DEVICE *Sim
+	);
+
+VOID
+ElanSimRunScript(
+	IN ELAN_SIM_DEVICE *Sim,
+	IN ULONG Script
+	);
+
+VOID
+ElanSimAttach(
+	IN SPB_CONTEXT *SpbContext,
+	IN ELAN_SIM_DEVICE *Sim
+	);
+
+#endif
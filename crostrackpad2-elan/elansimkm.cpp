@@ -0,0 +1,39 @@
+#include "internal.h"
+
+//
+// The register model's clock in the driver. Bus latency is spent
+// spinning, as a real transfer would keep the caller waiting.
+//
+
+static
+VOID
+ElanSimStall(
+	IN ULONG Microseconds
+	)
+{
+	KeStallExecutionProcessor(Microseconds);
+}
+
+static
+ULONGLONG
+ElanSimNow(
+	VOID
+	)
+{
+	return KeQueryInterruptTime();
+}
+
+const ELAN_SIM_CLOCK ElanSimClock = {
+	ElanSimStall,
+	ElanSimNow
+};
+
+VOID
+ElanSimAttach(
+	IN SPB_CONTEXT *SpbContext,
+	IN ELAN_SIM_DEVICE *Sim
+	)
+{
+	SpbContext->Transport = &ElanSimTransport;
+	SpbContext->TransportContext = Sim;
+}
@@ -1,3 +1,6 @@
+#ifndef _ELANTP_H_
+#define _ELANTP_H_
+
 #include <stdint.h>
 
 #ifndef __packed
@@ -82,4 +85,6 @@ struct elan_softc {
 	int multitaskingy;
 	bool multitaskingdone;
 	bool hasmoved;
-};
\ No newline at end of file
+};
+
+#endif
@@ -0,0 +1,803 @@
+#include <ntddk.h>
+#include <wdf.h>
+#include <hidport.h>
+#include "gesture.h"
+
+#define MAX_FINGERS 5
+
+//
+// The release and click timers are only compared against thresholds of
+// 100ms or less, so they stop counting past a second rather than
+// overflow after weeks without a touch
+//
+#define GESTURE_TIMER_LIMIT_MS 1000
+
+int distancesq(int delta_x, int delta_y){
+	return (delta_x * delta_x) + (delta_y*delta_y);
+}
+
+static void AgeTimer(int *ms, int intervalms){
+	if (*ms <= GESTURE_TIMER_LIMIT_MS)
+		*ms += intervalms;
+}
+
+_CYAPA_RELATIVE_MOUSE_REPORT lastreport;
+
+static void emit_report(PDEVICE_CONTEXT pDevice, csgesture_softc *sc, void *report, ULONG length){
+	//
+	// Fold every report sent this frame into an FNV-1a digest, so a
+	// replay can be compared frame by frame against recorded output
+	//
+	uint8_t *bytes = (uint8_t *)report;
+	for (ULONG i = 0; i < length; i++)
+		sc->reportdigest = (sc->reportdigest ^ bytes[i]) * 16777619U;
+	sc->reportcount++;
+
+	size_t bytesWritten;
+	ElanProcessVendorReport(pDevice, report, length, &bytesWritten);
+}
+
+static void update_relative_mouse(PDEVICE_CONTEXT pDevice, csgesture_softc *sc, BYTE button,
+	BYTE x, BYTE y, BYTE wheelPosition, BYTE wheelHPosition){
+	_CYAPA_RELATIVE_MOUSE_REPORT report;
+	report.ReportID = REPORTID_RELATIVE_MOUSE;
+	report.Button = button;
+	report.XValue = x;
+	report.YValue = y;
+	report.WheelPosition = wheelPosition;
+	report.HWheelPosition = wheelHPosition;
+	if (report.Button == lastreport.Button &&
+		report.XValue == lastreport.XValue &&
+		report.YValue == lastreport.YValue &&
+		report.WheelPosition == lastreport.WheelPosition &&
+		report.HWheelPosition == lastreport.HWheelPosition)
+		return;
+	lastreport = report;
+
+	emit_report(pDevice, sc, &report, sizeof(report));
+}
+
+static void update_keyboard(PDEVICE_CONTEXT pDevice, csgesture_softc *sc, BYTE shiftKeys, BYTE keyCodes[KBD_KEY_CODES]){
+	_CYAPA_KEYBOARD_REPORT report;
+	report.ReportID = REPORTID_KEYBOARD;
+	report.ShiftKeyFlags = shiftKeys;
+	report.Reserved = 0;
+	for (int i = 0; i < KBD_KEY_CODES; i++){
+		report.KeyCodes[i] = keyCodes[i];
+	}
+
+	emit_report(pDevice, sc, &report, sizeof(report));
+}
+
+void BlacklistTrailingFingers(csgesture_softc *sc, int i) {
+	for (int j = 0;j < MAX_FINGERS;j++) {
+		if (j != i) {
+			if (sc->blacklistedids[j] != 1) {
+				if (sc->y[j] > sc->y[i]) {
+					if (sc->downms[j] > sc->downms[i] + 150) {
+						sc->blacklistedids[j] = 1;
+					}
+				}
+			}
+		}
+	}
+}
+
+bool ProcessMove(csgesture_softc *sc, int abovethreshold, int iToUse[3]) {
+	if (abovethreshold == 1 || sc->panningActive) {
+		int i = iToUse[0];
+		if (!sc->panningActive && sc->downms[i] < 50)
+			return false;
+
+		if (sc->panningActive && i == -1)
+			i = sc->idForPanning;
+		if (i < 0 || i >= MAX_FINGERS)
+			return false;
+
+		int delta_x = (sc->x[i] + sc->predx[i]) - (sc->lastx[i] + sc->lastpredx[i]);
+		int delta_y = (sc->y[i] + sc->predy[i]) - (sc->lasty[i] + sc->lastpredy[i]);
+
+		int jumpLimit = 75 * max(sc->frameintervalms, 1);
+		if (abs(delta_x) * GESTURE_TICK_MS > jumpLimit || abs(delta_y) * GESTURE_TICK_MS > jumpLimit) {
+			delta_x = 0;
+			delta_y = 0;
+		}
+
+		BlacklistTrailingFingers(sc, i);
+
+		sc->dx = delta_x;
+		sc->dy = delta_y;
+
+		sc->panningActive = true;
+		sc->idForPanning = i;
+		return true;
+	}
+	return false;
+}
+
+int CalcScrollValue(int rawValue, int windowms) {
+	int actionThreshold = 3;
+	int invalidThreshold = 120;
+
+	int absValue = abs(rawValue);
+	int speed = absValue * GESTURE_TICK_MS / max(windowms, GESTURE_TICK_MS);
+	int step = speed > 11 ? 3 : (speed > 7 ? 4 : (speed > 4 ? 6 : 7));
+	if (absValue > invalidThreshold || absValue < actionThreshold) {
+		return 0;
+	} else {
+		return (rawValue / absValue) * ((absValue > actionThreshold && absValue < 2 * step ? 0 : 1) + (absValue - actionThreshold) / step);
+	}
+}
+
+bool ProcessScroll(csgesture_softc *sc, int abovethreshold, int iToUse[3]) {
+	sc->scrollx = 0;
+	sc->scrolly = 0;
+	if (abovethreshold == 2 || sc->scrollingActive) {
+		int i1 = iToUse[0];
+		int i2 = iToUse[1];
+		if (sc->scrollingActive) {
+			if (i1 == -1) {
+				if (i2 != sc->idsForScrolling[0])
+					i1 = sc->idsForScrolling[0];
+				else
+					i1 = sc->idsForScrolling[1];
+			}
+			if (i2 == -1) {
+				if (i1 != sc->idsForScrolling[0])
+					i2 = sc->idsForScrolling[0];
+				else
+					i2 = sc->idsForScrolling[1];
+			}
+		}
+		if (i1 < 0 || i1 >= MAX_FINGERS || i2 < 0 || i2 >= MAX_FINGERS) {
+			sc->scrollingActive = false;
+			sc->idsForScrolling[0] = -1;
+			sc->idsForScrolling[1] = -1;
+			return false;
+		}
+
+		int delta_x1 = sc->x[i1] - sc->lastx[i1];
+		int delta_y1 = sc->y[i1] - sc->lasty[i1];
+
+		int delta_x2 = sc->x[i2] - sc->lastx[i2];
+		int delta_y2 = sc->y[i2] - sc->lasty[i2];
+
+		if ((abs(delta_y1) + abs(delta_y2)) > (abs(delta_x1) + abs(delta_x2))) {
+			int avgy = (delta_y1 + delta_y2) / 2;
+			sc->scrolly = -avgy;
+		}
+		else {
+			int avgx = (delta_x1 + delta_x2) / 2;
+			sc->scrollx = -avgx;
+		}
+
+		int windowms = (sc->windowms[i1] + sc->windowms[i2]) / 2;
+		sc->scrolly = CalcScrollValue(sc->scrolly, windowms);
+		sc->scrollx = CalcScrollValue(sc->scrollx, windowms);
+
+		int fngrcount = 0;
+		int totfingers = 0;
+		for (int i = 0; i < MAX_FINGERS; i++) {
+			if (sc->x[i] != -1) {
+				totfingers++;
+				if (i == i1 || i == i2)
+					fngrcount++;
+			}
+		}
+
+		if (fngrcount == 2)
+			sc->msSinceScrolling = 0;
+		else
+			sc->msSinceScrolling += sc->frameintervalms;
+		if (fngrcount == 2 || sc->msSinceScrolling <= 50) {
+			sc->scrollingActive = true;
+			if (abovethreshold == 2) {
+				sc->idsForScrolling[0] = iToUse[0];
+				sc->idsForScrolling[1] = iToUse[1];
+			}
+		}
+		else {
+			sc->scrollingActive = false;
+			sc->idsForScrolling[0] = -1;
+			sc->idsForScrolling[1] = -1;
+		}
+		return true;
+	}
+	return false;
+}
+
+bool ProcessThreeFingerSwipe(PDEVICE_CONTEXT pDevice, csgesture_softc *sc, int abovethreshold, int iToUse[3]) {
+	if (abovethreshold == 3 || abovethreshold == 4) {
+		int i1 = iToUse[0];
+		int delta_x1 = sc->x[i1] - sc->lastx[i1];
+		int delta_y1 = sc->y[i1] - sc->lasty[i1];
+
+		int i2 = iToUse[1];
+		int delta_x2 = sc->x[i2] - sc->lastx[i2];
+		int delta_y2 = sc->y[i2] - sc->lasty[i2];
+
+		int i3 = iToUse[2];
+		int delta_x3 = sc->x[i3] - sc->lastx[i3];
+		int delta_y3 = sc->y[i3] - sc->lasty[i3];
+
+		int avgx = (delta_x1 + delta_x2 + delta_x3) / 3;
+		int avgy = (delta_y1 + delta_y2 + delta_y3) / 3;
+
+		sc->multitaskingx += avgx;
+		sc->multitaskingy += avgy;
+		sc->multitaskinggesturems += sc->frameintervalms;
+
+		if (sc->multitaskinggesturems > 50 && !sc->multitaskingdone) {
+			if ((abs(delta_y1) + abs(delta_y2) + abs(delta_y3)) > (abs(delta_x1) + abs(delta_x2) + abs(delta_x3))) {
+				if (abs(sc->multitaskingy) > 50) {
+					BYTE shiftKeys = KBD_LGUI_BIT;
+					BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+					if (sc->multitaskingy < 0)
+						keyCodes[0] = 0x2B;
+					else
+						keyCodes[0] = 0x07;
+					update_keyboard(pDevice, sc, shiftKeys, keyCodes);
+					shiftKeys = 0;
+					keyCodes[0] = 0x0;
+					update_keyboard(pDevice, sc, shiftKeys, keyCodes);
+					sc->multitaskingx = 0;
+					sc->multitaskingy = 0;
+					sc->multitaskingdone = true;
+				}
+			}
+			else {
+				if (abs(sc->multitaskingx) > 50) {
+					BYTE shiftKeys = KBD_LGUI_BIT | KBD_LCONTROL_BIT;
+					BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+					if (sc->multitaskingx > 0)
+						keyCodes[0] = 0x50;
+					else
+						keyCodes[0] = 0x4F;
+					update_keyboard(pDevice, sc, shiftKeys, keyCodes);
+					shiftKeys = 0;
+					keyCodes[0] = 0x0;
+					update_keyboard(pDevice, sc, shiftKeys, keyCodes);
+					sc->multitaskingx = 0;
+					sc->multitaskingy = 0;
+					sc->multitaskingdone = true;
+				}
+			}
+		}
+		else if (sc->multitaskinggesturems > 250) {
+			sc->multitaskingx = 0;
+			sc->multitaskingy = 0;
+			sc->multitaskinggesturems = 0;
+			sc->multitaskingdone = false;
+		}
+		return true;
+	}
+	else {
+		sc->multitaskingx = 0;
+		sc->multitaskingy = 0;
+		sc->multitaskinggesturems = 0;
+		sc->multitaskingdone = false;
+		return false;
+	}
+}
+
+void TapToClickOrDrag(PDEVICE_CONTEXT pDevice, csgesture_softc *sc, int button) {
+	AgeTimer(&sc->mssinceclick, sc->frameintervalms);
+	if (sc->mouseDownDueToTap && sc->idForMouseDown == -1) {
+		if (sc->mssinceclick > 100) {
+			sc->mouseDownDueToTap = false;
+			sc->mousedown = false;
+			sc->buttonmask = 0;
+			//Tap Drag Timed out
+		}
+		return;
+	}
+	if (sc->mousedown) {
+		sc->mssinceclick = 0;
+		return;
+	}
+	if (button == 0)
+		return;
+	int buttonmask = 0;
+
+	switch (button) {
+	case 1:
+		buttonmask = MOUSE_BUTTON_1;
+		break;
+	case 2:
+		buttonmask = MOUSE_BUTTON_2;
+		break;
+	case 3:
+		buttonmask = MOUSE_BUTTON_3;
+		break;
+	}
+	if (buttonmask != 0 && sc->mssinceclick > 100 && sc->mssincelastrelease == 0) {
+		sc->idForMouseDown = -1;
+		sc->mouseDownDueToTap = true;
+		sc->buttonmask = buttonmask;
+		sc->mousebutton = button;
+		sc->mousedown = true;
+		sc->mssinceclick = 0;
+	}
+}
+
+void ClearTapDrag(PDEVICE_CONTEXT pDevice, csgesture_softc *sc, int i) {
+	if (i == sc->idForMouseDown && sc->mouseDownDueToTap == true) {
+		if (sc->downms[i] < 100) {
+			//Double Tap
+			update_relative_mouse(pDevice, sc, 0, 0, 0, 0, 0);
+			update_relative_mouse(pDevice, sc, sc->buttonmask, 0, 0, 0, 0);
+		}
+		sc->mouseDownDueToTap = false;
+		sc->mousedown = false;
+		sc->buttonmask = 0;
+		sc->idForMouseDown = -1;
+		//Clear Tap Drag
+	}
+}
+
+void ShiftHistory(csgesture_softc *sc, int i) {
+	int absx = abs(sc->x[i] - sc->lastx[i]);
+	int absy = abs(sc->y[i] - sc->lasty[i]);
+
+	sc->totalx[i] += absx;
+	sc->totaly[i] += absy;
+
+	sc->flextotalx[i] -= sc->xhistory[i][0];
+	sc->flextotaly[i] -= sc->yhistory[i][0];
+	sc->windowms[i] -= sc->mshistory[i][0];
+	for (int j = 1;j < 10;j++) {
+		sc->xhistory[i][j - 1] = sc->xhistory[i][j];
+		sc->yhistory[i][j - 1] = sc->yhistory[i][j];
+		sc->mshistory[i][j - 1] = sc->mshistory[i][j];
+	}
+	sc->flextotalx[i] += absx;
+	sc->flextotaly[i] += absy;
+	sc->windowms[i] += sc->frameintervalms;
+
+	int j = 9;
+	sc->xhistory[i][j] = absx;
+	sc->yhistory[i][j] = absy;
+	sc->mshistory[i][j] = sc->frameintervalms;
+}
+
+static int PredictAxis(csgesture_softc *sc, int delta, int lastoffset, int flextotal, int windowms) {
+	//stopped, or turning back against the lead given last frame
+	if (delta == 0 || (delta > 0 && lastoffset < 0) || (delta < 0 && lastoffset > 0))
+		return 0;
+
+	//the slower of the window's average speed and this frame's speed, so
+	//a decelerating finger isn't carried past where it stops
+	int offset = min(flextotal * sc->predictms / windowms,
+		abs(delta) * sc->predictms / max(sc->frameintervalms, 1));
+	return delta > 0 ? offset : -offset;
+}
+
+static void PredictContacts(csgesture_softc *sc) {
+	for (int i = 0;i < MAX_FINGERS;i++) {
+		sc->predx[i] = 0;
+		sc->predy[i] = 0;
+
+		if (sc->predictms == 0 || sc->x[i] == -1 || sc->lastx[i] == -1) {
+			sc->predpending[i] = false;
+			continue;
+		}
+
+		if (sc->predpending[i]) {
+			sc->predagems[i] += sc->frameintervalms;
+			if (sc->predagems[i] >= sc->predictms) {
+				sc->predictsamples++;
+				sc->predicterrorsq += distancesq(sc->x[i] - sc->predtargetx[i], sc->y[i] - sc->predtargety[i]);
+				sc->unpredictederrorsq += distancesq(sc->x[i] - sc->predoriginx[i], sc->y[i] - sc->predoriginy[i]);
+				sc->predpending[i] = false;
+			}
+		}
+
+		//just touched down, or lifting off with the pressure falling away
+		if (sc->tick[i] < GESTURE_PREDICT_MIN_SAMPLES || sc->windowms[i] == 0)
+			continue;
+		if (sc->p[i] * 4 < sc->lastp[i] * 3)
+			continue;
+
+		sc->predx[i] = PredictAxis(sc, sc->x[i] - sc->lastx[i], sc->lastpredx[i], sc->flextotalx[i], sc->windowms[i]);
+		sc->predy[i] = PredictAxis(sc, sc->y[i] - sc->lasty[i], sc->lastpredy[i], sc->flextotaly[i], sc->windowms[i]);
+
+		if (!sc->predpending[i]) {
+			sc->predpending[i] = true;
+			sc->predagems[i] = 0;
+			sc->predtargetx[i] = sc->x[i] + sc->predx[i];
+			sc->predtargety[i] = sc->y[i] + sc->predy[i];
+			sc->predoriginx[i] = sc->x[i];
+			sc->predoriginy[i] = sc->y[i];
+		}
+	}
+}
+
+static void BeginFrame(csgesture_softc *sc) {
+	sc->reportdigest = 2166136261U;
+	sc->reportcount = 0;
+
+	if (sc->frameintervalms < 0)
+		sc->frameintervalms = 0;
+	if (sc->frameintervalms > GESTURE_MAX_FRAME_MS)
+		sc->frameintervalms = GESTURE_MAX_FRAME_MS;
+}
+
+void ProcessGesture(PDEVICE_CONTEXT pDevice, csgesture_softc *sc) {
+#pragma mark reset inputs
+	sc->dx = 0;
+	sc->dy = 0;
+
+	BeginFrame(sc);
+
+#pragma mark process touch thresholds
+	int abovethreshold = 0;
+	int recentlyadded = 0;
+	int iToUse[3] = { -1,-1,-1 };
+	int a = 0;
+
+	int nfingers = 0;
+	for (int i = 0;i < MAX_FINGERS;i++) {
+		if (sc->x[i] != -1)
+			nfingers++;
+	}
+
+	int recentMsThreshold = 200;
+	int speedThreshold = 2;
+
+	for (int i = 0;i < MAX_FINGERS;i++) {
+		if (sc->downms[i] < recentMsThreshold && sc->downms[i] != 0)
+			recentlyadded++;
+		if (sc->tick[i] == 0 || sc->windowms[i] == 0)
+			continue;
+		if (sc->blacklistedids[i] == 1)
+			continue;
+		//squared speed in units per GESTURE_TICK_MS
+		if ((LONGLONG)distancesq(sc->flextotalx[i], sc->flextotaly[i]) * (GESTURE_TICK_MS * GESTURE_TICK_MS) /
+			((LONGLONG)sc->windowms[i] * sc->windowms[i]) > speedThreshold) {
+			abovethreshold++;
+			if (a < 3) {
+				iToUse[a] = i;
+				a++;
+			}
+		}
+	}
+
+#pragma mark predict pointer motion
+	PredictContacts(sc);
+
+#pragma mark process different gestures
+	bool handled = false;
+	if (!handled)
+		handled = ProcessThreeFingerSwipe(pDevice, sc, abovethreshold, iToUse);
+	if (!handled)
+		handled = ProcessScroll(sc, abovethreshold, iToUse);
+	if (!handled)
+		handled = ProcessMove(sc, abovethreshold, iToUse);
+
+#pragma mark process clickpad press state
+	int buttonmask = 0;
+
+	sc->mousebutton = recentlyadded;
+	if (sc->mousebutton == 0)
+		sc->mousebutton = abovethreshold;
+
+	if (sc->mousebutton == 0) {
+		if (sc->panningActive)
+			sc->mousebutton = 1;
+		else
+			sc->mousebutton = nfingers;
+		if (sc->mousebutton == 0)
+			sc->mousebutton = 1;
+	}
+	if (sc->mousebutton > 3)
+		sc->mousebutton = 3;
+
+	if (!sc->mouseDownDueToTap) {
+		if (sc->buttondown && !sc->mousedown) {
+			sc->mousedown = true;
+			sc->mssinceclick = 0;
+
+			switch (sc->mousebutton) {
+			case 1:
+				buttonmask = MOUSE_BUTTON_1;
+				break;
+			case 2:
+				buttonmask = MOUSE_BUTTON_2;
+				break;
+			case 3:
+				buttonmask = MOUSE_BUTTON_3;
+				break;
+			}
+			sc->buttonmask = buttonmask;
+		}
+		else if (sc->mousedown && !sc->buttondown) {
+			sc->mousedown = false;
+			sc->mousebutton = 0;
+			sc->buttonmask = 0;
+		}
+	}
+
+#pragma mark shift to last
+	int releasedfingers = 0;
+
+	for (int i = 0;i < MAX_FINGERS;i++) {
+		if (sc->x[i] != -1) {
+			if (sc->lastx[i] == -1) {
+				if (sc->mssincelastrelease < 100 && sc->mouseDownDueToTap && sc->idForMouseDown == -1) {
+					sc->idForMouseDown = i; //Associate Tap Drag
+				}
+			}
+			sc->downms[i] += sc->frameintervalms;
+			if (sc->tick[i] < 10) {
+				if (sc->lastx[i] != -1) {
+					sc->totalx[i] += abs(sc->x[i] - sc->lastx[i]);
+					sc->totaly[i] += abs(sc->y[i] - sc->lasty[i]);
+					sc->totalp[i] += sc->p[i];
+
+					sc->flextotalx[i] = sc->totalx[i];
+					sc->flextotaly[i] = sc->totaly[i];
+
+					int j = sc->tick[i];
+					sc->xhistory[i][j] = abs(sc->x[i] - sc->lastx[i]);
+					sc->yhistory[i][j] = abs(sc->y[i] - sc->lasty[i]);
+				}
+				sc->mshistory[i][sc->tick[i]] = sc->frameintervalms;
+				sc->windowms[i] += sc->frameintervalms;
+				sc->tick[i]++;
+			}
+			else if (sc->lastx[i] != -1) {
+				ShiftHistory(sc, i);
+			}
+		}
+		if (sc->x[i] == -1) {
+			ClearTapDrag(pDevice, sc, i);
+			if (sc->lastx[i] != -1)
+				sc->mssincelastrelease = -sc->frameintervalms;
+			for (int j = 0;j < 10;j++) {
+				sc->xhistory[i][j] = 0;
+				sc->yhistory[i][j] = 0;
+				sc->mshistory[i][j] = 0;
+			}
+			if (sc->downms[i] < 100 && sc->downms[i] != 0) {
+				int avgp = sc->totalp[i] / sc->tick[i];
+				if (avgp > 7)
+					releasedfingers++;
+			}
+			sc->totalx[i] = 0;
+			sc->totaly[i] = 0;
+			sc->totalp[i] = 0;
+			sc->tick[i] = 0;
+			sc->downms[i] = 0;
+			sc->windowms[i] = 0;
+
+			sc->blacklistedids[i] = 0;
+
+			if (sc->idForPanning == i) {
+				sc->panningActive = false;
+				sc->idForPanning = -1;
+			}
+		}
+		sc->lastx[i] = sc->x[i];
+		sc->lasty[i] = sc->y[i];
+		sc->lastp[i] = sc->p[i];
+		sc->lastpredx[i] = sc->predx[i];
+		sc->lastpredy[i] = sc->predy[i];
+	}
+	AgeTimer(&sc->mssincelastrelease, sc->frameintervalms);
+
+#pragma mark process tap to click
+	TapToClickOrDrag(pDevice, sc, releasedfingers);
+
+#pragma mark send to system
+	update_relative_mouse(pDevice, sc, sc->buttonmask, sc->dx, sc->dy, sc->scrolly, sc->scrollx);
+}
+
+int ElanClassifyReport(uint8_t report[ETP_MAX_REPORT_LEN]){
+	if (report[0] == 0xff)
+		return ELAN_FRAME_EMPTY;
+	if (report[ETP_REPORT_ID_OFFSET] != ETP_REPORT_ID)
+		return ELAN_FRAME_MALFORMED;
+	return ELAN_FRAME_VALID;
+}
+
+int ElanDecodeReport(struct csgesture_softc *sc, uint8_t report[ETP_MAX_REPORT_LEN]){
+	int frame = ElanClassifyReport(report);
+	if (frame != ELAN_FRAME_VALID){
+		return frame;
+	}
+
+	uint8_t *finger_data = &report[ETP_FINGER_DATA_OFFSET];
+	int i;
+	uint8_t tp_info = report[ETP_TOUCH_INFO_OFFSET];
+	uint8_t hover_info = report[ETP_HOVER_INFO_OFFSET];
+	bool contact_valid, hover_event;
+
+	int nfingers = 0;
+
+	for (int i = 0;i < 5; i++) {
+		sc->x[i] = -1;
+		sc->y[i] = -1;
+		sc->p[i] = -1;
+	}
+
+	hover_event = hover_info & 0x40;
+	for (i = 0; i < ETP_MAX_FINGERS; i++) {
+		contact_valid = tp_info & (1U << (3 + i));
+		unsigned int pos_x, pos_y;
+		unsigned int pressure, mk_x, mk_y;
+		unsigned int area_x, area_y, major, minor;
+		unsigned int scaled_pressure;
+
+		if (contact_valid) {
+			pos_x = ((finger_data[0] & 0xf0) << 4) |
+				finger_data[1];
+			pos_y = ((finger_data[0] & 0x0f) << 8) |
+				finger_data[2];
+
+			mk_x = (finger_data[3] & 0x0f);
+			mk_y = (finger_data[3] >> 4);
+			pressure = finger_data[4];
+
+			//map to cypress coordinates
+			//pos_y = 1500 - pos_y;
+			if (pos_y > (unsigned int)sc->resy)
+				pos_y = sc->resy;
+			pos_y = sc->resy - pos_y;
+			pos_x *= 2;
+			pos_x /= 7;
+			pos_y *= 2;
+			pos_y /= 7;
+
+
+			/*
+			* To avoid treating large finger as palm, let's reduce the
+			* width x and y per trace.
+			*/
+			area_x = mk_x;
+			area_y = mk_y;
+
+			major = max(area_x, area_y);
+			minor = min(area_x, area_y);
+
+			scaled_pressure = pressure;
+
+			if (scaled_pressure > ETP_MAX_PRESSURE)
+				scaled_pressure = ETP_MAX_PRESSURE;
+			sc->x[i] = pos_x;
+			sc->y[i] = pos_y;
+			sc->p[i] = scaled_pressure;
+		}
+		else {
+		}
+
+		if (contact_valid){
+			finger_data += ETP_FINGER_DATA_LEN;
+			nfingers++;
+		}
+		}
+	sc->buttondown = (tp_info & 0x01);
+	return ELAN_FRAME_VALID;
+}
+
+static bool GestureAtRest(csgesture_softc *sc) {
+	//
+	// Nothing down, no button or tap pending and nothing left to send:
+	// another frame without contacts only moves the release and click
+	// timers on
+	//
+	if (sc->buttondown || sc->mousedown || sc->mouseDownDueToTap ||
+		sc->scrollingActive || sc->panningActive)
+		return false;
+	if (sc->buttonmask != 0 || sc->dx != 0 || sc->dy != 0 ||
+		sc->scrollx != 0 || sc->scrolly != 0)
+		return false;
+	for (int i = 0; i < MAX_FINGERS; i++) {
+		if (sc->x[i] != -1 || sc->lastx[i] != -1)
+			return false;
+	}
+	return true;
+}
+
+bool ElanSkipUnchangedFrame(struct csgesture_softc *sc, uint8_t report[ETP_MAX_REPORT_LEN]){
+	//
+	// Only the contact and button bits and the finger data of the
+	// contacts present reach the gesture engine; hover and the unused
+	// trailing bytes are left out
+	//
+	uint8_t tp_info = report[ETP_TOUCH_INFO_OFFSET];
+	uint8_t *finger_data = &report[ETP_FINGER_DATA_OFFSET];
+	int length = 0;
+
+	for (int i = 0; i < ETP_MAX_FINGERS; i++) {
+		if (tp_info & (1U << (3 + i)))
+			length += ETP_FINGER_DATA_LEN;
+	}
+
+	if (tp_info != sc->lastframe[0] ||
+		!RtlEqualMemory(finger_data, &sc->lastframe[1], length) ||
+		!GestureAtRest(sc)) {
+		sc->lastframe[0] = tp_info;
+		RtlCopyMemory(&sc->lastframe[1], finger_data, length);
+		return false;
+	}
+
+	//
+	// Exactly what ProcessGesture would change for this frame
+	//
+	BeginFrame(sc);
+	sc->multitaskingx = 0;
+	sc->multitaskingy = 0;
+	sc->multitaskinggesturems = 0;
+	sc->multitaskingdone = false;
+	sc->mousebutton = 1;
+	AgeTimer(&sc->mssincelastrelease, sc->frameintervalms);
+	AgeTimer(&sc->mssinceclick, sc->frameintervalms);
+	return true;
+}
+
+void TrackpadRawInput(PDEVICE_CONTEXT pDevice, struct csgesture_softc *sc, uint8_t report[ETP_MAX_REPORT_LEN], int intervalms){
+	if (ElanClassifyReport(report) != ELAN_FRAME_VALID)
+		return;
+
+	sc->frameintervalms = intervalms;
+
+	if (ElanSkipUnchangedFrame(sc, report))
+		return;
+
+	ElanDecodeReport(sc, report);
+	ProcessGesture(pDevice, sc);
+}
+
+uint8_t *ElanCaptureRecords(const void *capture, size_t length, ULONG *recordsize, ULONGLONG *count){
+	//
+	// Checks a capture (see elanioctl.h) and returns its first record, or
+	// NULL when it isn't one. A capture cut short only yields the records
+	// it holds in full.
+	//
+	const ELAN_CAPTURE_HEADER *header = (const ELAN_CAPTURE_HEADER *)capture;
+
+	if (length < sizeof(ELAN_CAPTURE_HEADER) ||
+		header->Magic != ELAN_CAPTURE_MAGIC ||
+		header->Version != ELAN_CAPTURE_VERSION ||
+		header->HeaderSize < sizeof(ELAN_CAPTURE_HEADER) ||
+		header->RecordSize < sizeof(ELAN_CAPTURE_RECORD) ||
+		header->HeaderSize > length)
+		return NULL;
+
+	*count = (length - header->HeaderSize) / header->RecordSize;
+	if (*count > header->RecordCount)
+		*count = header->RecordCount;
+	*recordsize = header->RecordSize;
+	return (uint8_t *)capture + header->HeaderSize;
+}
+
+ULONGLONG ElanReplayCapture(PDEVICE_CONTEXT pDevice, struct csgesture_softc *sc, const void *capture, size_t length, ULONGLONG *mismatches){
+	//
+	// Feeds a capture through the engine in place; the records are not
+	// copied, so a mapped capture file can be passed directly. Frames
+	// whose HID output differs from the output recorded with them are
+	// counted in mismatches. Returns the number of records replayed.
+	// With predictms set on sc, the replayed positions are the ground
+	// truth its predictions are scored against, in predictsamples,
+	// predicterrorsq and unpredictederrorsq; the output then won't match
+	// a capture made without prediction.
+	//
+	ULONG recordsize;
+	ULONGLONG count;
+
+	*mismatches = 0;
+
+	const uint8_t *next = ElanCaptureRecords(capture, length, &recordsize, &count);
+	if (next == NULL)
+		return 0;
+
+	for (ULONGLONG i = 0; i < count; i++) {
+		ELAN_CAPTURE_RECORD *record = (ELAN_CAPTURE_RECORD *)next;
+		TrackpadRawInput(pDevice, sc, record->Report, record->IntervalMs);
+		if (sc->reportdigest != record->OutputDigest ||
+			sc->reportcount != record->OutputCount)
+			(*mismatches)++;
+		next += recordsize;
+	}
+	return count;
+}
\ No newline at end of file
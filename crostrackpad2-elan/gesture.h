@@ -0,0 +1,87 @@
+#ifndef _GESTURE_H_
+#define _GESTURE_H_
+
+//
+// The report decoder and gesture engine only depend on the report
+// layouts and on ElanProcessVendorReport as a sink for the HID reports
+// they produce, so they can be built outside of the driver against a
+// stubbed sink.
+//
+
+#include "elantp.h"
+#include "gesturerec.h"
+#include "hidcommon.h"
+#include "elanioctl.h"
+
+typedef struct _DEVICE_CONTEXT  DEVICE_CONTEXT,  *PDEVICE_CONTEXT;
+
+NTSTATUS
+ElanProcessVendorReport(
+IN PDEVICE_CONTEXT DevContext,
+IN PVOID ReportBuffer,
+IN ULONG ReportBufferLen,
+OUT size_t* BytesWritten
+);
+
+//
+// Gesture timing is in milliseconds. Thresholds were tuned against a
+// 10 ms poll, so velocities are normalized to GESTURE_TICK_MS. Frame
+// intervals are clamped to GESTURE_MAX_FRAME_MS, so the first frame
+// after an idle stretch counts as a single fast frame. Above 1 kHz the
+// caller carries the time under a millisecond over to the next frame,
+// so a frame can have an interval of 0; per-frame speeds then count it
+// as 1 ms.
+//
+
+#define GESTURE_TICK_MS         10
+#define GESTURE_MAX_FRAME_MS    25
+
+//
+// Pointer motion can be led by up to GESTURE_MAX_PREDICT_MS of
+// extrapolation to hide poll and bus latency. A contact is only
+// predicted once its history holds GESTURE_PREDICT_MIN_SAMPLES frames.
+//
+
+#define GESTURE_MAX_PREDICT_MS      50
+#define GESTURE_PREDICT_MIN_SAMPLES 3
+
+//
+// Frames are classified before decoding; only valid frames reach the
+// gesture engine
+//
+
+enum elan_frame {
+	ELAN_FRAME_VALID = 0,
+	ELAN_FRAME_EMPTY,
+	ELAN_FRAME_MALFORMED
+};
+
+int ElanClassifyReport(uint8_t report[ETP_MAX_REPORT_LEN]);
+int ElanDecodeReport(struct csgesture_softc *sc, uint8_t report[ETP_MAX_REPORT_LEN]);
+void ProcessGesture(PDEVICE_CONTEXT pDevice, struct csgesture_softc *sc);
+
+//
+// A frame identical to the last one (the pad returning 0xff replays the
+// last good frame) while no contact, button, tap or scroll is in
+// progress only advances the engine's timers. ElanSkipUnchangedFrame
+// does that and returns true; otherwise it remembers the frame and
+// returns false, and the frame goes through ElanDecodeReport and
+// ProcessGesture. frameintervalms must be set first.
+//
+
+bool ElanSkipUnchangedFrame(struct csgesture_softc *sc, uint8_t report[ETP_MAX_REPORT_LEN]);
+void TrackpadRawInput(PDEVICE_CONTEXT pDevice, struct csgesture_softc *sc, uint8_t report[ETP_MAX_REPORT_LEN], int intervalms);
+uint8_t *ElanCaptureRecords(const void *capture, size_t length, ULONG *recordsize, ULONGLONG *count);
+ULONGLONG ElanReplayCapture(PDEVICE_CONTEXT pDevice, struct csgesture_softc *sc, const void *capture, size_t length, ULONGLONG *mismatches);
+
+//
+// Primitives of the engine, exposed for the benchmarks in
+// host/microbench.cpp
+//
+
+int distancesq(int delta_x, int delta_y);
+int CalcScrollValue(int rawValue, int windowms);
+void ShiftHistory(struct csgesture_softc *sc, int i);
+void BlacklistTrailingFingers(struct csgesture_softc *sc, int i);
+
+#endif
@@ -1,4 +1,5 @@
 #include "stdint.h"
+#include "elantp.h"
 
 struct csgesture_softc {
 	//hardware input
@@ -23,13 +24,17 @@ struct csgesture_softc {
 
 	int buttonmask;
 
+	//digest and count of the HID reports sent for the last frame
+	unsigned int reportdigest;
+	int reportcount;
+
 	//used internally in driver
 	int panningActive;
 	int idForPanning;
 
 	int scrollingActive;
 	int idsForScrolling[2];
-	int ticksSinceScrolling;
+	int msSinceScrolling;
 
 	int blacklistedids[15];
 
@@ -45,6 +50,10 @@ struct csgesture_softc {
 	int xhistory[15][10];
 	int yhistory[15][10];
 
+	//milliseconds covered by each history sample, and by the window
+	int mshistory[15][10];
+	int windowms[15];
+
 	int flextotalx[15];
 	int flextotaly[15];
 
@@ -54,11 +63,39 @@ struct csgesture_softc {
 
 	int multitaskingx;
 	int multitaskingy;
-	int multitaskinggesturetick;
+	int multitaskinggesturems;
 	bool multitaskingdone;
 
+	//samples in the history window, and milliseconds each contact has been down
 	int tick[15];
-	int truetick[15];
-	int ticksincelastrelease;
-	int tickssinceclick;
+	int downms[15];
+	int mssincelastrelease;
+	int mssinceclick;
+
+	//milliseconds since the previous frame
+	int frameintervalms;
+
+	//contact and button bits, then the finger data, of the previous frame
+	uint8_t lastframe[1 + ETP_MAX_FINGERS * ETP_FINGER_DATA_LEN];
+
+	//prediction horizon in milliseconds (0 disables), and the offset
+	//ProcessMove leads each contact by this frame and the previous one
+	int predictms;
+	int predx[15];
+	int predy[15];
+	int lastpredx[15];
+	int lastpredy[15];
+
+	//each contact's prediction waiting for its horizon to pass, and the
+	//squared errors of the predictions and of the positions they were
+	//made from, against where the contact really was
+	bool predpending[15];
+	int predagems[15];
+	int predtargetx[15];
+	int predtargety[15];
+	int predoriginx[15];
+	int predoriginy[15];
+	uint64_t predictsamples;
+	uint64_t predicterrorsq;
+	uint64_t unpredictederrorsq;
 };
\ No newline at end of file
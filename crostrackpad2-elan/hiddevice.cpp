@@ -297,6 +297,11 @@ OUT size_t* BytesWritten
 	ElanPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL,
 		"ElanProcessVendorReport Entry\n");
 
+	DevContext->Perf.ReportsEmitted++;
+	if (*(PUCHAR)ReportBuffer == REPORTID_KEYBOARD &&
+		((ElanKeyboardReport *)ReportBuffer)->ShiftKeyFlags != 0)
+		DevContext->Perf.KeyboardGestures++;
+
 	status = WdfIoQueueRetrieveNextRequest(DevContext->ReportQueue,
 		&reqRead);
 
@@ -330,6 +335,11 @@ OUT size_t* BytesWritten
 				status,
 				bytesReturned);
 
+			ElanLatencyRecord(&DevContext->Latency,
+				*(PUCHAR)ReportBuffer,
+				DevContext->FrameReadTime,
+				DevContext->Perf.Frequency);
+
 			ElanPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
 				"ElanProcessVendorReport %d bytes returned\n", bytesReturned);
 
@@ -353,6 +363,7 @@ OUT size_t* BytesWritten
 	}
 	else
 	{
+		DevContext->Perf.ReportsDropped++;
 		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
 			"WdfIoQueueRetrieveNextRequest failed Status 0x%x\n", status);
 	}
@@ -17,14 +17,12 @@
 #include <hidport.h>
 
 #include "hidcommon.h"
+#include "elandebug.h"
 
 //
 // String definitions
 //
 
-#define DRIVERNAME                 "crostrackpad.sys: "
-
-#define CYAPA_POOL_TAG            (ULONG)'PAYC'
 #define CYAPA_HARDWARE_IDS        L"ACPI\\CYAP0000\0\0"
 #define CYAPA_HARDWARE_IDS_LENGTH sizeof(CYAPA_HARDWARE_IDS)
 
@@ -233,30 +231,4 @@ DbgHidInternalIoctlString(
 IN ULONG        IoControlCode
 );
 
-//
-// Helper macros
-//
-
-#define DEBUG_LEVEL_ERROR   1
-#define DEBUG_LEVEL_INFO    2
-#define DEBUG_LEVEL_VERBOSE 3
-
-#define DBG_INIT  1
-#define DBG_PNP   2
-#define DBG_IOCTL 4
-
-#if 0
-#define ElanPrint(dbglevel, dbgcatagory, fmt, ...) {          \
-    if (ElanPrintDebugLevel >= dbglevel &&                         \
-        (ElanPrintDebugCatagories && dbgcatagory))                 \
-	    {                                                           \
-        DbgPrint(DRIVERNAME);                                   \
-        DbgPrint(fmt, __VA_ARGS__);                             \
-	    }                                                           \
-}
-#else
-#define ElanPrint(dbglevel, fmt, ...) {                       \
-}
-#endif
-
 #endif
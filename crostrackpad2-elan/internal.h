@@ -27,6 +27,235 @@
 
 #include "elantp.h"
 #include "gesturerec.h"
+#include "capture.h"
+#include "latency.h"
+#include "snapshot.h"
+#include "elansim.h"
+#include "boot.h"
+#include "acquire.h"
+
+//
+// Poll scheduler. Polls run every ActiveMs while contacts or a tap-drag
+// are pending, then every CooldownMs for CooldownPolls more polls, and
+// every IdleMs once the pad has gone quiet until a contact shows up.
+//
+// In timer mode a touch-down waits up to IdleMs to be seen, and a tap
+// shorter than that can be missed altogether, so IdleMs defaults to
+// 25ms: close to the old fixed 10ms poll for taps, at 40 wakeups a
+// second instead of 100 while idle. With the interrupt line in use
+// the pad signals the touch-down, and IdleMs only paces the fallback.
+//
+// ActiveMs is kept within ELAN_POLL_MIN_MS..ELAN_POLL_MAX_MS. The
+// default system clock ticks every 15.6ms, so shorter intervals need
+// the HighResolutionTimer setting: a high resolution WDFTIMER on KMDF
+// 1.13, or the system timer resolution raised while in D0 on older
+// frameworks.
+//
+
+#define ELAN_POLL_MIN_MS    2
+#define ELAN_POLL_MAX_MS    20
+
+enum elan_poll_state {
+	ELAN_POLL_ACTIVE = 0,
+	ELAN_POLL_COOLDOWN,
+	ELAN_POLL_IDLE,
+	ELAN_POLL_STATES
+};
+
+typedef struct _ELAN_POLL_SCHEDULER
+{
+	ULONG State;
+
+	ULONG ActiveMs;
+	ULONG CooldownMs;
+	ULONG IdleMs;
+
+	ULONG CooldownPolls;
+	ULONG CooldownLeft;
+
+	// Interval picked after the last frame
+	ULONG NextMs;
+
+	BOOLEAN HighResolution;
+
+	// Resolution set by ExSetTimerResolution in D0, 0 when not raised
+	ULONG TimerResolution;
+
+	//
+	// When the timer was last armed and for how long, and when it last
+	// fired in the active state (0 after any other state)
+	//
+
+	LONGLONG ArmTime;
+	ULONG ArmedMs;
+	LONGLONG LastActiveFire;
+} ELAN_POLL_SCHEDULER;
+
+//
+// Pipelined acquisition. With the PipelineReads setting on the I/O
+// target, the timer starts each report read asynchronously into a free
+// slot and re-arms itself at once; the poll work item processes slots
+// as their reads complete. The next read is on the bus while the
+// previous frame is decoded and sent up, and a slot is only reused once
+// its frame has been processed. Slots fill and drain in turn.
+//
+
+#define ELAN_FRAME_SLOTS    2
+
+//
+// Buffer a report is read into. Reads land in it directly, and a valid
+// frame is kept by trading buffers with the last one rather than
+// copying it.
+//
+
+typedef struct _ELAN_FRAME
+{
+	WDFMEMORY Memory;
+	uint8_t *Report;
+} ELAN_FRAME;
+
+enum elan_slot_state {
+	ELAN_SLOT_FREE = 0,
+	ELAN_SLOT_READING,
+	ELAN_SLOT_READY
+};
+
+typedef struct _ELAN_FRAME_SLOT
+{
+	ELAN_FRAME Frame;
+
+	volatile LONG State;
+	NTSTATUS Status;
+
+	//
+	// KeQueryPerformanceCounter() when the read was started and when
+	// it completed
+	//
+
+	LONGLONG IssueTime;
+	LONGLONG ReadTime;
+} ELAN_FRAME_SLOT;
+
+typedef struct _ELAN_FRAME_PIPELINE
+{
+	BOOLEAN Requested;
+	BOOLEAN Enabled;
+
+	ELAN_FRAME_SLOT Slots[ELAN_FRAME_SLOTS];
+
+	ULONG FillSlot;
+	ULONG ProcessSlot;
+
+	// The work item is processing a frame
+	volatile LONG Processing;
+
+	//
+	// BOOTTRACKPAD sets Booting under PollLock, which keeps the timer
+	// from starting reads; Issuing counts timers between checking it
+	// and queueing their read, so the boot can wait them out
+	//
+
+	volatile LONG Booting;
+	volatile LONG Issuing;
+} ELAN_FRAME_PIPELINE;
+
+//
+// Recovery from a trackpad that stops answering. When ResetAfter frames
+// in a row fail to read, after the bus has retried each of them, the
+// trackpad is reset and booted again. A reset that doesn't bring it
+// back doubles ResetAfter, up to ELAN_RESET_MAX_FAILURES, so a pad that
+// is gone isn't reset every few polls. Resets counts the resets that
+// booted the pad again; one that didn't sets ResetFailed, so the pad is
+// reset again after the next run although it is no longer loaded. A
+// failed first boot from IOCTL_HID_WRITE_REPORT sets it too.
+// The boot takes a while, so it runs on ResetWorkItem rather than in
+// the ISR or the poll that saw the failures; ResetPending keeps the
+// polls in the meantime from queueing it again. All of it under
+// PollLock.
+//
+
+#define ELAN_RESET_FAILURES         8
+#define ELAN_RESET_MAX_FAILURES     1024
+
+typedef struct _ELAN_RECOVERY
+{
+	ULONG FailureStreak;
+	ULONG ResetAfter;
+
+	ULONGLONG Resets;
+	BOOLEAN ResetFailed;
+
+	WDFWORKITEM ResetWorkItem;
+	BOOLEAN ResetPending;
+} ELAN_RECOVERY;
+
+//
+// Counters for the polling hot path. Stage costs accumulate in
+// ELAN_STAGE_TIMINGs, in KeQueryPerformanceCounter ticks.
+//
+
+typedef struct _ELAN_PERF_COUNTERS
+{
+	LONGLONG Frequency;
+
+	ELAN_STAGE_TIMING SpbRead;
+	ELAN_STAGE_TIMING Decode;
+	ELAN_STAGE_TIMING Gesture;
+	ELAN_STAGE_TIMING Frame;
+
+	//
+	// Frames whose decode and gesture processing took longer than
+	// FrameBudgetTicks
+	//
+
+	LONGLONG FrameBudgetTicks;
+	ULONGLONG OverBudgetFrames;
+
+	//
+	// Frame and report counters, see ELAN_STATS
+	//
+
+	ULONGLONG FramesPolled;
+	ULONGLONG WorkItemOverlaps;
+
+	ULONGLONG EmptyFrames;
+	ULONGLONG MalformedFrames;
+	ULONGLONG SpbErrors;
+	ULONGLONG ReprocessedFrames;
+	ULONGLONG UnchangedFrames;
+
+	ULONGLONG ReportsEmitted;
+	ULONGLONG ReportsDropped;
+	ULONGLONG KeyboardGestures;
+
+	ULONGLONG StatePolls[ELAN_POLL_STATES];
+
+	ULONGLONG PipelinedReads;
+	ULONGLONG OverlappedReads;
+	ULONGLONG PipelineStalls;
+
+	ULONGLONG TimerFires;
+	ULONGLONG TimerJitterTicks;
+	ULONGLONG TimerMaxJitterTicks;
+	ULONGLONG ActiveIntervals;
+	ULONGLONG ActiveIntervalTicks;
+} ELAN_PERF_COUNTERS;
+
+FORCEINLINE
+VOID
+ElanStageAccumulate(
+	_Inout_ ELAN_STAGE_TIMING *Stage,
+	_In_ LONGLONG Start,
+	_In_ LONGLONG End
+	)
+{
+	ULONGLONG ticks = (ULONGLONG)(End - Start);
+
+	Stage->Calls++;
+	Stage->TotalTicks += ticks;
+	if (ticks > Stage->MaxTicks)
+		Stage->MaxTicks = ticks;
+}
 
 //
 // Forward Declarations
@@ -89,17 +318,104 @@ struct _DEVICE_CONTEXT
 
 	WDFTIMER Timer;
 
+	ELAN_POLL_SCHEDULER Poll;
+
+	//
+	// Work item running each poll, and whether it is queued or running;
+	// the timer skips a tick rather than queue it again
+	//
+
+	WDFWORKITEM PollWorkItem;
+
+	LONG PollBusy;
+
+	//
+	// Serializes frame processing between the poll work item and the
+	// interrupt
+	//
+
+	WDFWAITLOCK PollLock;
+
+	ELAN_ACQUISITION Acquisition;
+
+	ELAN_FRAME_PIPELINE Pipeline;
+
+	ELAN_RECOVERY Recovery;
+
 	WDFQUEUE ReportQueue;
 
 	BYTE DeviceMode;
 
+	//
+	// Interrupt time the gesture engine's clock has reached; it trails
+	// the last frame by the part of a millisecond not yet handed on
+	//
+
 	ULONGLONG LastInterruptTime;
 
+	//
+	// Gesture engine state, only touched under PollLock, and the copy of
+	// its contacts published for lock-free readers
+	//
+
 	csgesture_softc sc;
 
-	uint16_t max_y;
+	ELAN_CONTACT_SNAPSHOT Contacts;
+
+	//
+	// Last valid frame, reprocessed when a read comes back empty, and
+	// the buffer synchronous reads land in. Both under PollLock.
+	//
+
+	ELAN_FRAME LastFrame;
+
+	ELAN_FRAME ReadFrame;
+
+	//
+	// Per-stage cost of the polling hot path
+	//
+
+	ELAN_PERF_COUNTERS Perf;
+
+	//
+	// KeQueryPerformanceCounter() when the frame being processed was
+	// read, 0 outside the polling path, and the latency from there to
+	// the HID read completions it produced
+	//
+
+	LONGLONG FrameReadTime;
+
+	ELAN_LATENCY Latency;
+
+	//
+	// Optional raw report capture
+	//
+
+	ELAN_CAPTURE_RING Capture;
+
+	//
+	// Control device for user-mode diagnostics
+	//
+
+	WDFDEVICE ControlDevice;
+
+#ifdef ELAN_SIMULATOR
+	//
+	// Register model standing in for the trackpad when the
+	// SimulatedTarget setting is non-zero. Only built with
+	// ELAN_SIMULATOR, which the Release configurations leave out.
+	//
+
+	ELAN_SIM_DEVICE Simulator;
+#endif
+
+	//
+	// What the trackpad reported at boot, and what booting it cost
+	//
+
+	ELAN_DEVICE_INFO Info;
 
-	uint8_t lastreport[ETP_MAX_REPORT_LEN];
+	ELAN_BOOT_TIMING Boot;
 };
 
 struct _REQUEST_CONTEXT
@@ -0,0 +1,140 @@
+#include "internal.h"
+#include "hidcommon.h"
+#include "latency.h"
+
+static ULONG ElanPrintDebugLevel = 100;
+static ULONG ElanPrintDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+VOID
+ElanLatencyRecord(
+	IN ELAN_LATENCY *Latency,
+	IN UCHAR ReportId,
+	IN LONGLONG ReadTime,
+	IN LONGLONG Frequency
+	)
+/*++
+
+Routine Description:
+
+This routine adds the latency of a just completed HID read to the
+histogram of its report type. Called from the polling path, under
+PollLock.
+
+Arguments:
+
+Latency   - The latency histograms
+ReportId  - Report ID of the report that completed the read
+ReadTime  - KeQueryPerformanceCounter() when the frame was read, 0 when
+            the report did not come from a polled frame
+Frequency - KeQueryPerformanceCounter() ticks per second
+
+Return Value:
+
+None
+
+--*/
+{
+	ELAN_LATENCY_HISTOGRAM *histogram;
+	ULONGLONG us;
+	ULONG bucket;
+
+	if (ReadTime == 0 || Frequency == 0)
+		return;
+
+	switch (ReportId)
+	{
+	case REPORTID_RELATIVE_MOUSE:
+		histogram = &Latency->Stats.Mouse;
+		break;
+	case REPORTID_KEYBOARD:
+		histogram = &Latency->Stats.Keyboard;
+		break;
+	default:
+		return;
+	}
+
+	us = (ULONGLONG)(KeQueryPerformanceCounter(NULL).QuadPart - ReadTime) * 1000000 / Frequency;
+
+	bucket = 0;
+	while (bucket < ELAN_LATENCY_BUCKETS - 1 && (1ULL << bucket) <= us)
+		bucket++;
+
+	InterlockedIncrement(&Latency->Sequence);
+
+	histogram->Count++;
+	histogram->TotalUs += us;
+	if (us > histogram->MaxUs)
+		histogram->MaxUs = us;
+	histogram->Buckets[bucket]++;
+
+	InterlockedIncrement(&Latency->Sequence);
+}
+
+NTSTATUS
+ElanReadLatency(
+	IN ELAN_LATENCY *Latency,
+	IN WDFREQUEST Request,
+	OUT size_t *BytesReturned
+	)
+/*++
+
+Routine Description:
+
+This routine copies the latency histograms into the output buffer of an
+IOCTL_ELAN_READ_LATENCY request. It retries while a latency is being
+recorded, so the copy is consistent without blocking the polling path.
+
+Arguments:
+
+Latency       - The latency histograms
+Request       - Handle to the IOCTL request
+BytesReturned - Receives the number of bytes written to the output buffer
+
+Return Value:
+
+NTSTATUS Status indicating success or failure
+
+--*/
+{
+	ELAN_LATENCY_STATS *out;
+	NTSTATUS status;
+	LONG sequence;
+
+	*BytesReturned = 0;
+
+	status = WdfRequestRetrieveOutputBuffer(Request,
+		sizeof(ELAN_LATENCY_STATS),
+		(PVOID *)&out,
+		NULL);
+
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+			"ElanReadLatency WdfRequestRetrieveOutputBuffer failed 0x%x\n", status);
+		return status;
+	}
+
+	for (;;)
+	{
+		sequence = Latency->Sequence;
+		KeMemoryBarrier();
+
+		if ((sequence & 1) == 0)
+		{
+			*out = Latency->Stats;
+			KeMemoryBarrier();
+
+			if (Latency->Sequence == sequence)
+				break;
+		}
+
+		YieldProcessor();
+	}
+
+	out->Version = ELAN_LATENCY_VERSION;
+	out->Size = sizeof(ELAN_LATENCY_STATS);
+
+	*BytesReturned = sizeof(ELAN_LATENCY_STATS);
+
+	return STATUS_SUCCESS;
+}
@@ -0,0 +1,37 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include "elanioctl.h"
+
+//
+// Log-bucketed latency from the SPB read of a frame to the completion of
+// the HID reads it produced, kept per report type. Only the polling
+// path records, under PollLock, so there is a single writer; it updates
+// the histograms under a sequence lock, as snapshot.h publishes
+// contacts, and readers retry if a record landed while they copied.
+//
+
+typedef struct _ELAN_LATENCY
+{
+	// Odd while the writer is updating Stats
+	volatile LONG Sequence;
+
+	ELAN_LATENCY_STATS Stats;
+} ELAN_LATENCY;
+
+VOID
+ElanLatencyRecord(
+	IN ELAN_LATENCY *Latency,
+	IN UCHAR ReportId,
+	IN LONGLONG ReadTime,
+	IN LONGLONG Frequency
+	);
+
+NTSTATUS
+ElanReadLatency(
+	IN ELAN_LATENCY *Latency,
+	IN WDFREQUEST Request,
+	OUT size_t *BytesReturned
+	);
+
+#endif
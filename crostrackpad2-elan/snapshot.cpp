@@ -0,0 +1,163 @@
+#include "internal.h"
+#include "snapshot.h"
+
+static ULONG ElanPrintDebugLevel = 100;
+static ULONG ElanPrintDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+C_ASSERT(ELAN_CONTACTS_MAX == ETP_MAX_FINGERS);
+
+VOID
+ElanPublishContacts(
+	IN ELAN_CONTACT_SNAPSHOT *Snapshot,
+	IN struct csgesture_softc *sc,
+	IN ULONGLONG Timestamp
+	)
+/*++
+
+Routine Description:
+
+This routine publishes the contact state the gesture engine was left
+with by a frame. It is only called from the polling path, under
+PollLock, so there is a single writer.
+
+Arguments:
+
+Snapshot  - The published snapshot
+sc        - Gesture engine state after the frame
+Timestamp - KeQueryInterruptTime() when the frame was processed
+
+Return Value:
+
+None
+
+--*/
+{
+	ELAN_CONTACTS *contacts = &Snapshot->Contacts;
+	ULONG count = 0;
+	ULONG flags = 0;
+
+	InterlockedIncrement(&Snapshot->Sequence);
+
+	contacts->Timestamp = Timestamp;
+	contacts->Frame++;
+
+	for (int i = 0; i < ELAN_CONTACTS_MAX; i++)
+	{
+		contacts->Contacts[i].X = sc->x[i];
+		contacts->Contacts[i].Y = sc->y[i];
+		contacts->Contacts[i].Pressure = sc->p[i];
+		contacts->Contacts[i].DownMs = sc->downms[i];
+		if (sc->x[i] != -1)
+			count++;
+	}
+	contacts->ContactCount = count;
+
+	if (sc->buttondown)
+		flags |= ELAN_CONTACTS_BUTTON_DOWN;
+	if (sc->mouseDownDueToTap)
+		flags |= ELAN_CONTACTS_TAP_DRAG;
+	if (sc->panningActive)
+		flags |= ELAN_CONTACTS_PANNING;
+	if (sc->scrollingActive)
+		flags |= ELAN_CONTACTS_SCROLLING;
+	contacts->Flags = flags;
+	contacts->Buttons = sc->buttonmask;
+
+	InterlockedIncrement(&Snapshot->Sequence);
+}
+
+VOID
+ElanSnapshotContacts(
+	IN ELAN_CONTACT_SNAPSHOT *Snapshot,
+	OUT ELAN_CONTACTS *Contacts
+	)
+/*++
+
+Routine Description:
+
+This routine takes a consistent copy of the published contact state
+without blocking the polling path. It retries while a frame is being
+published.
+
+Arguments:
+
+Snapshot - The published snapshot
+Contacts - Receives the copy
+
+Return Value:
+
+None
+
+--*/
+{
+	LONG sequence;
+
+	for (;;)
+	{
+		sequence = Snapshot->Sequence;
+		KeMemoryBarrier();
+
+		if ((sequence & 1) == 0)
+		{
+			*Contacts = Snapshot->Contacts;
+			KeMemoryBarrier();
+
+			if (Snapshot->Sequence == sequence)
+				break;
+		}
+
+		YieldProcessor();
+	}
+
+	Contacts->Version = ELAN_CONTACTS_VERSION;
+	Contacts->Size = sizeof(ELAN_CONTACTS);
+}
+
+NTSTATUS
+ElanReadContacts(
+	IN ELAN_CONTACT_SNAPSHOT *Snapshot,
+	IN WDFREQUEST Request,
+	OUT size_t *BytesReturned
+	)
+/*++
+
+Routine Description:
+
+This routine copies the published contact state into the output buffer
+of an IOCTL_ELAN_READ_CONTACTS request.
+
+Arguments:
+
+Snapshot      - The published snapshot
+Request       - Handle to the IOCTL request
+BytesReturned - Receives the number of bytes written to the output buffer
+
+Return Value:
+
+NTSTATUS Status indicating success or failure
+
+--*/
+{
+	ELAN_CONTACTS *out;
+	NTSTATUS status;
+
+	*BytesReturned = 0;
+
+	status = WdfRequestRetrieveOutputBuffer(Request,
+		sizeof(ELAN_CONTACTS),
+		(PVOID *)&out,
+		NULL);
+
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+			"ElanReadContacts WdfRequestRetrieveOutputBuffer failed 0x%x\n", status);
+		return status;
+	}
+
+	ElanSnapshotContacts(Snapshot, out);
+
+	*BytesReturned = sizeof(ELAN_CONTACTS);
+
+	return STATUS_SUCCESS;
+}
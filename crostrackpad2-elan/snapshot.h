@@ -0,0 +1,40 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include "elanioctl.h"
+
+//
+// Contact state published by the polling path after each frame under a
+// sequence lock. The poll path is the only writer and never waits;
+// readers retry if a frame was published while they copied.
+//
+
+typedef struct _ELAN_CONTACT_SNAPSHOT
+{
+	// Odd while the writer is updating Contacts
+	volatile LONG Sequence;
+
+	ELAN_CONTACTS Contacts;
+} ELAN_CONTACT_SNAPSHOT;
+
+VOID
+ElanPublishContacts(
+	IN ELAN_CONTACT_SNAPSHOT *Snapshot,
+	IN struct csgesture_softc *sc,
+	IN ULONGLONG Timestamp
+	);
+
+VOID
+ElanSnapshotContacts(
+	IN ELAN_CONTACT_SNAPSHOT *Snapshot,
+	OUT ELAN_CONTACTS *Contacts
+	);
+
+NTSTATUS
+ElanReadContacts(
+	IN ELAN_CONTACT_SNAPSHOT *Snapshot,
+	IN WDFREQUEST Request,
+	OUT size_t *BytesReturned
+	);
+
+#endif
@@ -18,239 +18,1839 @@ Revision History:
 
 --*/
 
-#include "internal.h"
-#include "hiddevice.h"
+#include <ntddk.h>
+#include <wdf.h>
+
+#define RESHUB_USE_HELPER_ROUTINES
+#include <reshub.h>
+
+#include "elandebug.h"
+#include <spb.h>
 #include "spb.h"
 
-static ULONG ElanPrintDebugLevel = 100;
-static ULONG ElanPrintDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+static ULONG ElanPrintDebugLevel = 100;
+static ULONG ElanPrintDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+//
+// Buffer sizes of the pool classes, smallest first. The larger class
+// holds the report descriptor read by BOOTTRACKPAD.
+//
+
+static const ULONG SpbPoolBufferSizes[SPB_POOL_CLASSES] = {
+	DEFAULT_SPB_BUFFER_SIZE,
+	256
+};
+
+C_ASSERT(SPB_POOL_BUFFERS <= 32);
+
+static
+NTSTATUS
+SpbBufferAcquire(
+	IN SPB_CONTEXT *SpbContext,
+	IN ULONG Length,
+	OUT SPB_BUFFER *Buffer
+	)
+/*++
+
+	Routine Description:
+
+	This helper routine hands out a nonpaged transfer buffer of at
+	least Length bytes, from the pool if a class it fits has a free
+	buffer. It doesn't take a lock and can be called at
+	DISPATCH_LEVEL.
+
+	Arguments:
+
+	SpbContext - Pointer to the current device context
+	Length     - The number of bytes needed
+	Buffer     - Receives the buffer, to be returned with SpbBufferRelease
+
+	Return Value:
+
+	NTSTATUS Status indicating success or failure
+
+	--*/
+{
+	SPB_POOL_CLASS *fit = NULL;
+	NTSTATUS status;
+
+	Buffer->Data = NULL;
+	Buffer->Class = -1;
+	Buffer->Index = 0;
+	Buffer->Memory = NULL;
+
+	for (LONG c = 0; c < SPB_POOL_CLASSES; c++)
+	{
+		SPB_POOL_CLASS *pool = &SpbContext->Pool[c];
+		LONG mask, inUse, highWater;
+		ULONG index;
+
+		if (pool->Buffers == NULL || Length > pool->BufferSize)
+		{
+			continue;
+		}
+
+		if (fit == NULL)
+		{
+			fit = pool;
+		}
+
+		for (;;)
+		{
+			mask = pool->FreeMask;
+			if (!BitScanForward(&index, (ULONG)mask))
+			{
+				break;
+			}
+
+			if (InterlockedCompareExchange(&pool->FreeMask, mask & ~(1L << index), mask) == mask)
+			{
+				inUse = InterlockedIncrement(&pool->InUse);
+				do
+				{
+					highWater = pool->HighWater;
+				} while (inUse > highWater &&
+					InterlockedCompareExchange(&pool->HighWater, inUse, highWater) != highWater);
+
+				InterlockedIncrement64(&pool->Acquired);
+
+				Buffer->Data = pool->Buffers + index * pool->BufferSize;
+				Buffer->Class = c;
+				Buffer->Index = index;
+				return STATUS_SUCCESS;
+			}
+		}
+	}
+
+	if (fit != NULL)
+	{
+		InterlockedIncrement64(&fit->Fallbacks);
+	}
+	else
+	{
+		InterlockedIncrement64(&SpbContext->PoolOversize);
+	}
+
+	status = WdfMemoryCreate(
+		WDF_NO_OBJECT_ATTRIBUTES,
+		NonPagedPool,
+		CYAPA_POOL_TAG,
+		Length,
+		&Buffer->Memory,
+		(PVOID *)&Buffer->Data);
+
+	if (!NT_SUCCESS(status))
+	{
+		Buffer->Memory = NULL;
+	}
+
+	return status;
+}
+
+static
+VOID
+SpbBufferRelease(
+	IN SPB_CONTEXT *SpbContext,
+	IN SPB_BUFFER *Buffer
+	)
+{
+	if (Buffer->Class >= 0)
+	{
+		SPB_POOL_CLASS *pool = &SpbContext->Pool[Buffer->Class];
+
+		InterlockedDecrement(&pool->InUse);
+		InterlockedOr(&pool->FreeMask, 1L << Buffer->Index);
+	}
+	else if (Buffer->Memory != NULL)
+	{
+		WdfObjectDelete(Buffer->Memory);
+	}
+
+	Buffer->Data = NULL;
+	Buffer->Class = -1;
+	Buffer->Memory = NULL;
+}
+
+static
+NTSTATUS
+SpbSendWrite(
+	IN SPB_CONTEXT *SpbContext,
+	IN PWDF_MEMORY_DESCRIPTOR MemoryDescriptor,
+	IN PVOID Buffer,
+	IN ULONG Length
+	)
+/*++
+
+	Routine Description:
+
+	This helper routine sends a complete write transfer either to
+	the Spb I/O target or to the transport replacing it.
+
+	Arguments:
+
+	SpbContext       - Pointer to the current device context
+	MemoryDescriptor - Describes Buffer for the I/O target
+	Buffer           - The bytes to put on the bus
+	Length           - The number of bytes in Buffer
+
+	Return Value:
+
+	NTSTATUS Status indicating success or failure
+
+	--*/
+{
+	if (SpbContext->Transport != NULL)
+	{
+		return SpbContext->Transport->Write(
+			SpbContext->TransportContext,
+			Buffer,
+			Length);
+	}
+
+	return WdfIoTargetSendWriteSynchronously(
+		SpbContext->SpbIoTarget,
+		NULL,
+		MemoryDescriptor,
+		NULL,
+		NULL,
+		NULL);
+}
+
+static
+NTSTATUS
+SpbSendRead(
+	IN SPB_CONTEXT *SpbContext,
+	IN PWDF_MEMORY_DESCRIPTOR MemoryDescriptor,
+	IN PVOID Buffer,
+	IN ULONG Length,
+	OUT ULONG_PTR *BytesRead
+	)
+/*++
+
+	Routine Description:
+
+	This helper routine receives a read transfer either from
+	the Spb I/O target or from the transport replacing it.
+
+	Arguments:
+
+	SpbContext       - Pointer to the current device context
+	MemoryDescriptor - Describes Buffer for the I/O target
+	Buffer           - Receives the bytes read from the bus
+	Length           - The number of bytes to read
+	BytesRead        - Receives the number of bytes actually read
+
+	Return Value:
+
+	NTSTATUS Status indicating success or failure
+
+	--*/
+{
+	if (SpbContext->Transport != NULL)
+	{
+		return SpbContext->Transport->Read(
+			SpbContext->TransportContext,
+			Buffer,
+			Length,
+			BytesRead);
+	}
+
+	return WdfIoTargetSendReadSynchronously(
+		SpbContext->SpbIoTarget,
+		NULL,
+		MemoryDescriptor,
+		NULL,
+		NULL,
+		BytesRead);
+}
+
+//
+// Address write and read of a register read, sent as one SPB sequence,
+// and the same for each read of a batch
+//
+
+typedef SPB_TRANSFER_LIST_AND_ENTRIES(2) SPB_WRITE_READ_SEQUENCE;
+typedef SPB_TRANSFER_LIST_AND_ENTRIES(2 * SPB_READ_BATCH_MAX) SPB_READ_BATCH_SEQUENCE;
+
+static
+VOID
+SpbFormatSequence(
+	OUT SPB_WRITE_READ_SEQUENCE *Sequence,
+	IN PVOID Address,
+	IN ULONG AddressLength,
+	IN PVOID Buffer,
+	IN ULONG Length
+	)
+{
+	SPB_TRANSFER_LIST_INIT(&Sequence->List, 2);
+
+	Sequence->List.Transfers[0] = SPB_TRANSFER_LIST_ENTRY_INIT_SIMPLE(
+		SpbTransferDirectionToDevice,
+		0,
+		Address,
+		AddressLength);
+
+	Sequence->List.Transfers[1] = SPB_TRANSFER_LIST_ENTRY_INIT_SIMPLE(
+		SpbTransferDirectionFromDevice,
+		0,
+		Buffer,
+		Length);
+}
+
+static
+BOOLEAN
+SpbSequenceRejected(
+	IN SPB_CONTEXT *SpbContext,
+	IN NTSTATUS Status
+	)
+/*++
+
+	Routine Description:
+
+	This helper routine switches register reads to a separate write
+	and read when the controller doesn't implement
+	IOCTL_SPB_EXECUTE_SEQUENCE.
+
+	Arguments:
+
+	SpbContext - Pointer to the current device context
+	Status     - Outcome of the sequence
+
+	Return Value:
+
+	TRUE if the sequence was rejected and the read should be retried
+	as a separate write and read
+
+	--*/
+{
+	if (Status != STATUS_NOT_SUPPORTED &&
+		Status != STATUS_NOT_IMPLEMENTED &&
+		Status != STATUS_INVALID_DEVICE_REQUEST)
+	{
+		return FALSE;
+	}
+
+	ElanPrint(
+		DEBUG_LEVEL_ERROR,
+		DBG_IOCTL,
+		"Spb controller rejected sequence, using split reads - %!STATUS!",
+		Status);
+
+	SpbContext->UseSequence = FALSE;
+
+	return TRUE;
+}
+
+static
+ULONG
+SpbCountError(
+	IN SPB_CONTEXT *SpbContext,
+	IN NTSTATUS Status
+	)
+/*++
+
+	Routine Description:
+
+	This helper routine classifies a failed transfer and counts it.
+	SPB controllers fail a transfer whose address the device didn't
+	acknowledge with STATUS_NO_SUCH_DEVICE; reads that came back
+	short are failed here with STATUS_DEVICE_PROTOCOL_ERROR.
+	Cancelled transfers aren't counted.
+
+	Arguments:
+
+	SpbContext - Pointer to the current device context
+	Status     - Outcome of the transfer
+
+	Return Value:
+
+	The spb_error class of the failure
+
+	--*/
+{
+	ULONG error;
+
+	switch (Status)
+	{
+	case STATUS_NO_SUCH_DEVICE:
+		error = SPB_ERROR_NACK;
+		break;
+	case STATUS_IO_TIMEOUT:
+		error = SPB_ERROR_TIMEOUT;
+		break;
+	case STATUS_DEVICE_PROTOCOL_ERROR:
+		error = SPB_ERROR_SHORT;
+		break;
+	default:
+		error = SPB_ERROR_OTHER;
+		break;
+	}
+
+	if (Status != STATUS_CANCELLED)
+		InterlockedIncrement64(&SpbContext->Errors[error]);
+
+	return error;
+}
+
+static
+BOOLEAN
+SpbRetryTransfer(
+	IN SPB_CONTEXT *SpbContext,
+	IN NTSTATUS Status,
+	IN ULONG Attempt
+	)
+/*++
+
+	Routine Description:
+
+	This helper routine decides whether a synchronous transfer is
+	sent again. NACKs, timeouts and short reads are retried up to
+	RetryCount times, after a backoff that doubles each attempt up
+	to SPB_RETRY_MAX_BACKOFF_US; other failures are final. Called with the bus released, so
+	queued asynchronous transfers go in between.
+
+	Arguments:
+
+	SpbContext - Pointer to the current device context
+	Status     - Outcome of the attempt
+	Attempt    - Attempts made before this one
+
+	Return Value:
+
+	TRUE if the transfer should be sent again
+
+	--*/
+{
+	if (NT_SUCCESS(Status))
+	{
+		if (Attempt != 0)
+			InterlockedIncrement64(&SpbContext->Recovered);
+		return FALSE;
+	}
+
+	if (SpbCountError(SpbContext, Status) == SPB_ERROR_OTHER ||
+		Attempt >= SpbContext->RetryCount)
+	{
+		return FALSE;
+	}
+
+	InterlockedIncrement64(&SpbContext->Retries);
+
+	KeStallExecutionProcessor(min(SPB_RETRY_MAX_BACKOFF_US,
+		SPB_RETRY_BACKOFF_US << min(Attempt, SPB_RETRY_LIMIT)));
+
+	return TRUE;
+}
+
+static
+LONGLONG
+SpbTraceClock(
+	IN SPB_CONTEXT *SpbContext
+	)
+{
+	if (!SpbContext->Trace.Enabled)
+		return 0;
+
+	return KeQueryPerformanceCounter(NULL).QuadPart;
+}
+
+static
+VOID
+SpbTraceRecord(
+	IN SPB_CONTEXT *SpbContext,
+	IN UCHAR Type,
+	IN USHORT Address,
+	IN ULONG Length,
+	IN NTSTATUS Status,
+	IN ULONG Attempt,
+	IN LONGLONG Start,
+	IN LONGLONG Acquired,
+	IN LONGLONG End
+	)
+/*++
+
+	Routine Description:
+
+	This helper routine adds a transaction to the trace ring. Callable
+	at any IRQL <= DISPATCH_LEVEL, from any number of threads.
+
+	Arguments:
+
+	SpbContext - Pointer to the current device context
+	Type       - spb_trace_type of the transaction
+	Address    - The register address
+	Length     - The number of bytes read, or written after the address
+	Status     - Outcome of the transaction
+	Attempt    - Attempts made before this one
+	Start      - SpbTraceClock() when the transaction asked for the bus
+	Acquired   - SpbTraceClock() when it got the bus
+	End        - SpbTraceClock() when it was done with the bus
+
+	Return Value:
+
+	None
+
+	--*/
+{
+	SPB_TRACE *trace = &SpbContext->Trace;
+	SPB_TRACE_RECORD *record;
+	LONG64 sequence;
+
+	if (!trace->Enabled)
+		return;
+
+	sequence = InterlockedIncrement64(&trace->Next);
+	record = &trace->Records[(sequence - 1) & (SPB_TRACE_RECORDS - 1)];
+
+	InterlockedExchange64(&record->Sequence, 0);
+
+	record->Timestamp = Start;
+	record->WaitTicks = (ULONG)min(Acquired - Start, (LONGLONG)MAXULONG);
+	record->BusTicks = (ULONG)min(End - Acquired, (LONGLONG)MAXULONG);
+	record->Status = Status;
+	record->Length = Length;
+	record->Address = Address;
+	record->Type = Type;
+	record->Attempt = (UCHAR)min(Attempt, (ULONG)MAXUCHAR);
+
+	InterlockedExchange64(&record->Sequence, sequence);
+}
+
+BOOLEAN
+SpbTraceGet(
+	_In_ SPB_CONTEXT *SpbContext,
+	_In_ ULONGLONG Sequence,
+	_Out_ SPB_TRACE_RECORD *Record
+	)
+/*++
+
+	Routine Description:
+
+	This routine copies the trace record of a transaction out of the
+	ring.
+
+	Arguments:
+
+	SpbContext - Pointer to the current device context
+	Sequence   - Number of the transaction, from 1
+	Record     - Receives the record
+
+	Return Value:
+
+	FALSE if the record was overwritten by a later transaction or is
+	still being written
+
+	--*/
+{
+	SPB_TRACE_RECORD *record = &SpbContext->Trace.Records[(Sequence - 1) & (SPB_TRACE_RECORDS - 1)];
+
+	if (record->Sequence != (LONG64)Sequence)
+		return FALSE;
+
+	KeMemoryBarrier();
+
+	RtlCopyMemory(Record, record, sizeof(SPB_TRACE_RECORD));
+
+	KeMemoryBarrier();
+
+	return record->Sequence == (LONG64)Sequence;
+}
+
+static
+NTSTATUS
+SpbSendWriteRead(
+	IN SPB_CONTEXT *SpbContext,
+	IN PUCHAR Buffer,
+	IN ULONG AddressLength,
+	IN ULONG Length,
+	OUT ULONG_PTR *BytesRead
+	)
+/*++
+
+	Routine Description:
+
+	This helper routine writes a register address pointer and reads
+	the data behind it: as one sequence with a repeated start when
+	the controller supports it, otherwise as a write then a read.
+	Called with the bus owned.
+
+	Arguments:
+
+	SpbContext    - Pointer to the current device context
+	Buffer        - The register address bytes, followed by room for
+	                the data read
+	AddressLength - The number of address bytes
+	Length        - The number of bytes to read
+	BytesRead     - Receives the number of bytes actually read
+
+	Return Value:
+
+	NTSTATUS Status indicating success or failure
+
+	--*/
+{
+	SPB_WRITE_READ_SEQUENCE sequence;
+	WDF_MEMORY_DESCRIPTOR addressDescriptor;
+	WDF_MEMORY_DESCRIPTOR dataDescriptor;
+	WDF_MEMORY_DESCRIPTOR sequenceDescriptor;
+	PUCHAR data = Buffer + AddressLength;
+	ULONG_PTR bytesTransferred;
+	NTSTATUS status;
+
+	*BytesRead = 0;
+
+	if (SpbContext->UseSequence)
+	{
+		SpbFormatSequence(&sequence, Buffer, AddressLength, data, Length);
+
+		WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
+			&sequenceDescriptor,
+			&sequence,
+			sizeof(sequence));
+
+		bytesTransferred = 0;
+
+		status = WdfIoTargetSendIoctlSynchronously(
+			SpbContext->SpbIoTarget,
+			NULL,
+			IOCTL_SPB_EXECUTE_SEQUENCE,
+			&sequenceDescriptor,
+			NULL,
+			NULL,
+			&bytesTransferred);
+
+		if (!SpbSequenceRejected(SpbContext, status))
+		{
+			InterlockedIncrement64(&SpbContext->SequenceReads);
+
+			//
+			// The sequence counts the bytes moved in both directions
+			//
+			if (bytesTransferred > AddressLength)
+				*BytesRead = bytesTransferred - AddressLength;
+
+			return status;
+		}
+	}
+
+	InterlockedIncrement64(&SpbContext->SplitReads);
+
+	WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
+		&addressDescriptor,
+		(PVOID)Buffer,
+		AddressLength);
+
+	status = SpbSendWrite(
+		SpbContext,
+		&addressDescriptor,
+		Buffer,
+		AddressLength);
+
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(
+			DEBUG_LEVEL_ERROR,
+			DBG_IOCTL,
+			"Error setting address pointer for Spb read - %!STATUS!",
+			status);
+		return status;
+	}
+
+	WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
+		&dataDescriptor,
+		(PVOID)data,
+		Length);
+
+	return SpbSendRead(
+		SpbContext,
+		&dataDescriptor,
+		data,
+		Length,
+		BytesRead);
+}
+
+static EVT_WDF_REQUEST_COMPLETION_ROUTINE SpbAsyncWriteCompletion;
+static EVT_WDF_REQUEST_COMPLETION_ROUTINE SpbAsyncReadCompletion;
+static EVT_WDF_REQUEST_COMPLETION_ROUTINE SpbAsyncSequenceCompletion;
+
+static
+VOID
+SpbAsyncKick(
+	IN SPB_CONTEXT *SpbContext
+	);
+
+static
+VOID
+SpbAcquireBus(
+	IN SPB_CONTEXT *SpbContext
+	)
+/*++
+
+	Routine Description:
+
+	This helper routine waits for the transaction on the bus, if any,
+	to complete and takes the bus for a synchronous transaction. Only
+	the compare-exchange on BusOwned takes the bus; a wake from
+	BusIdle is just a cue to try again. Called at PASSIVE_LEVEL.
+
+	Arguments:
+
+	SpbContext - Pointer to the current device context
+
+	Return Value:
+
+	None
+
+	--*/
+{
+	while (InterlockedCompareExchange(&SpbContext->BusOwned, 1, 0) != 0)
+	{
+		KeWaitForSingleObject(
+			&SpbContext->BusIdle,
+			Executive,
+			KernelMode,
+			FALSE,
+			NULL);
+	}
+}
+
+static
+VOID
+SpbReleaseBus(
+	IN SPB_CONTEXT *SpbContext
+	)
+{
+	//
+	// Wakes one waiter, or the next to wait if there is none yet
+	//
+	InterlockedExchange(&SpbContext->BusOwned, 0);
+	KeSetEvent(&SpbContext->BusIdle, IO_NO_INCREMENT, FALSE);
+
+	//
+	// Hand the bus on to the oldest queued transfer
+	//
+	SpbAsyncKick(SpbContext);
+}
+
+VOID
+SpbWaitForIdle(
+	_In_ SPB_CONTEXT *SpbContext
+	)
+/*++
+
+	Routine Description:
+
+	This routine waits for every queued asynchronous transfer to
+	complete.
+
+	Arguments:
+
+	SpbContext - Pointer to the current device context
+
+	Return Value:
+
+	None
+
+	--*/
+{
+	BOOLEAN drained;
+
+	do
+	{
+		SpbAcquireBus(SpbContext);
+		drained = (SpbContext->AsyncCount == 0);
+		SpbReleaseBus(SpbContext);
+	} while (!drained);
+}
+
+static
+VOID
+SpbAsyncFinish(
+	IN SPB_CONTEXT *SpbContext,
+	IN NTSTATUS Status
+	)
+/*++
+
+	Routine Description:
+
+	This helper routine retires the transfer on the bus: it takes the
+	transfer off the queue, calls its completion, then releases the
+	bus to the next one.
+
+	Arguments:
+
+	SpbContext - Pointer to the current device context
+	Status     - Outcome of the transfer
+
+	Return Value:
+
+	None
+
+	--*/
+{
+	SPB_ASYNC_TRANSFER *transfer = &SpbContext->AsyncTransfers[SpbContext->AsyncHead];
+	SPB_COMPLETION completion = transfer->Completion;
+	PVOID context = transfer->Context;
+	PUCHAR address;
+	USHORT registerAddress = 0;
+
+	if (SpbContext->Trace.Enabled)
+	{
+		address = (PUCHAR)WdfMemoryGetBuffer(transfer->WriteMemory, NULL);
+		RtlCopyMemory(&registerAddress, address, min(transfer->AddressLength, sizeof(registerAddress)));
+
+		SpbTraceRecord(SpbContext,
+			(UCHAR)(SPB_TRACE_ASYNC | (transfer->ReadMemory != NULL ? SPB_TRACE_READ : SPB_TRACE_WRITE)),
+			registerAddress,
+			transfer->ReadMemory != NULL ?
+				transfer->ReadLength : transfer->WriteLength - transfer->AddressLength,
+			Status,
+			0,
+			transfer->QueueTime,
+			transfer->StartTime,
+			SpbTraceClock(SpbContext));
+	}
+
+	if (!NT_SUCCESS(Status) && Status != STATUS_CANCELLED)
+	{
+		ElanPrint(
+			DEBUG_LEVEL_ERROR,
+			DBG_IOCTL,
+			"Error in asynchronous Spb transfer - %!STATUS!",
+			Status);
+
+		SpbCountError(SpbContext, Status);
+	}
+
+	WdfSpinLockAcquire(SpbContext->AsyncLock);
+	SpbContext->AsyncHead = (SpbContext->AsyncHead + 1) % SPB_ASYNC_TRANSFERS;
+	SpbContext->AsyncCount--;
+	SpbContext->AsyncActive = FALSE;
+	WdfSpinLockRelease(SpbContext->AsyncLock);
+
+	completion(context, Status);
+
+	SpbReleaseBus(SpbContext);
+}
+
+static
+VOID
+SpbAsyncStart(
+	IN SPB_CONTEXT *SpbContext
+	)
+/*++
+
+	Routine Description:
+
+	This helper routine sends the oldest queued transfer, which owns
+	the bus. A read goes out as one sequence when the controller
+	supports it, otherwise its address is written first and
+	SpbAsyncWriteCompletion sends the read.
+
+	Arguments:
+
+	SpbContext - Pointer to the current device context
+
+	Return Value:
+
+	None
+
+	--*/
+{
+	SPB_ASYNC_TRANSFER *transfer = &SpbContext->AsyncTransfers[SpbContext->AsyncHead];
+	WDF_REQUEST_REUSE_PARAMS reuseParams;
+	WDFMEMORY_OFFSET offset;
+	NTSTATUS status;
+
+	transfer->StartTime = SpbTraceClock(SpbContext);
+
+	WDF_REQUEST_REUSE_PARAMS_INIT(&reuseParams, WDF_REQUEST_REUSE_NO_FLAGS, STATUS_SUCCESS);
+	WdfRequestReuse(transfer->Request, &reuseParams);
+
+	if (transfer->ReadMemory != NULL && SpbContext->UseSequence)
+	{
+		SpbFormatSequence(
+			(SPB_WRITE_READ_SEQUENCE *)WdfMemoryGetBuffer(transfer->SequenceMemory, NULL),
+			WdfMemoryGetBuffer(transfer->WriteMemory, NULL),
+			transfer->AddressLength,
+			WdfMemoryGetBuffer(transfer->ReadMemory, NULL),
+			transfer->ReadLength);
+
+		status = WdfIoTargetFormatRequestForIoctl(
+			SpbContext->SpbIoTarget,
+			transfer->Request,
+			IOCTL_SPB_EXECUTE_SEQUENCE,
+			transfer->SequenceMemory,
+			NULL,
+			NULL,
+			NULL);
+
+		if (!NT_SUCCESS(status))
+		{
+			goto exit;
+		}
+
+		WdfRequestSetCompletionRoutine(
+			transfer->Request,
+			SpbAsyncSequenceCompletion,
+			SpbContext);
+
+		InterlockedIncrement64(&SpbContext->SequenceReads);
+	}
+	else
+	{
+		offset.BufferOffset = 0;
+		offset.BufferLength = transfer->WriteLength;
+
+		status = WdfIoTargetFormatRequestForWrite(
+			SpbContext->SpbIoTarget,
+			transfer->Request,
+			transfer->WriteMemory,
+			&offset,
+			NULL);
+
+		if (!NT_SUCCESS(status))
+		{
+			goto exit;
+		}
+
+		WdfRequestSetCompletionRoutine(
+			transfer->Request,
+			SpbAsyncWriteCompletion,
+			SpbContext);
+
+		if (transfer->ReadMemory != NULL)
+		{
+			InterlockedIncrement64(&SpbContext->SplitReads);
+		}
+	}
+
+	if (!WdfRequestSend(transfer->Request, SpbContext->SpbIoTarget, WDF_NO_SEND_OPTIONS))
+	{
+		status = WdfRequestGetStatus(transfer->Request);
+		goto exit;
+	}
+
+	return;
+
+exit:
+
+	SpbAsyncFinish(SpbContext, status);
+}
+
+static
+VOID
+SpbAsyncKick(
+	IN SPB_CONTEXT *SpbContext
+	)
+/*++
+
+	Routine Description:
+
+	This helper routine starts the oldest queued transfer if nothing
+	owns the bus.
+
+	Arguments:
+
+	SpbContext - Pointer to the current device context
+
+	Return Value:
+
+	None
+
+	--*/
+{
+	BOOLEAN start = FALSE;
+
+	if (SpbContext->AsyncLock == NULL)
+	{
+		return;
+	}
+
+	WdfSpinLockAcquire(SpbContext->AsyncLock);
+	if (!SpbContext->AsyncActive &&
+		SpbContext->AsyncCount != 0 &&
+		InterlockedCompareExchange(&SpbContext->BusOwned, 1, 0) == 0)
+	{
+		SpbContext->AsyncActive = TRUE;
+		start = TRUE;
+	}
+	WdfSpinLockRelease(SpbContext->AsyncLock);
+
+	if (start)
+	{
+		SpbAsyncStart(SpbContext);
+	}
+}
+
+static
+VOID
+SpbAsyncReadCompletion(
+	IN WDFREQUEST Request,
+	IN WDFIOTARGET Target,
+	IN PWDF_REQUEST_COMPLETION_PARAMS Params,
+	IN WDFCONTEXT Context
+	)
+{
+	SPB_CONTEXT *SpbContext = (SPB_CONTEXT *)Context;
+	SPB_ASYNC_TRANSFER *transfer = &SpbContext->AsyncTransfers[SpbContext->AsyncHead];
+	NTSTATUS status = Params->IoStatus.Status;
+
+	UNREFERENCED_PARAMETER(Request);
+	UNREFERENCED_PARAMETER(Target);
+
+	//
+	// A short read leaves the caller's buffer incomplete
+	//
+	if (NT_SUCCESS(status) &&
+		Params->IoStatus.Information != transfer->ReadLength)
+	{
+		status = STATUS_DEVICE_PROTOCOL_ERROR;
+	}
+
+	SpbAsyncFinish(SpbContext, status);
+}
+
+static
+VOID
+SpbAsyncSequenceCompletion(
+	IN WDFREQUEST Request,
+	IN WDFIOTARGET Target,
+	IN PWDF_REQUEST_COMPLETION_PARAMS Params,
+	IN WDFCONTEXT Context
+	)
+{
+	SPB_CONTEXT *SpbContext = (SPB_CONTEXT *)Context;
+	SPB_ASYNC_TRANSFER *transfer = &SpbContext->AsyncTransfers[SpbContext->AsyncHead];
+	NTSTATUS status = Params->IoStatus.Status;
+
+	UNREFERENCED_PARAMETER(Request);
+	UNREFERENCED_PARAMETER(Target);
+
+	//
+	// A rejected sequence fails this read only, the next one is split.
+	// The sequence counts the address bytes along with the data.
+	//
+	if (!SpbSequenceRejected(SpbContext, status) &&
+		NT_SUCCESS(status) &&
+		Params->IoStatus.Information != transfer->AddressLength + transfer->ReadLength)
+	{
+		status = STATUS_DEVICE_PROTOCOL_ERROR;
+	}
+
+	SpbAsyncFinish(SpbContext, status);
+}
+
+static
+VOID
+SpbAsyncWriteCompletion(
+	IN WDFREQUEST Request,
+	IN WDFIOTARGET Target,
+	IN PWDF_REQUEST_COMPLETION_PARAMS Params,
+	IN WDFCONTEXT Context
+	)
+{
+	SPB_CONTEXT *SpbContext = (SPB_CONTEXT *)Context;
+	SPB_ASYNC_TRANSFER *transfer = &SpbContext->AsyncTransfers[SpbContext->AsyncHead];
+	WDF_REQUEST_REUSE_PARAMS reuseParams;
+	WDFMEMORY_OFFSET offset;
+	NTSTATUS status = Params->IoStatus.Status;
+
+	UNREFERENCED_PARAMETER(Target);
+
+	if (!NT_SUCCESS(status) || transfer->ReadMemory == NULL)
+	{
+		goto exit;
+	}
+
+	if (SpbContext->AsyncCancelling)
+	{
+		status = STATUS_CANCELLED;
+		goto exit;
+	}
+
+	//
+	// The address pointer is set, read the data
+	//
+	WDF_REQUEST_REUSE_PARAMS_INIT(&reuseParams, WDF_REQUEST_REUSE_NO_FLAGS, STATUS_SUCCESS);
+	WdfRequestReuse(Request, &reuseParams);
+
+	offset.BufferOffset = 0;
+	offset.BufferLength = transfer->ReadLength;
+
+	status = WdfIoTargetFormatRequestForRead(
+		SpbContext->SpbIoTarget,
+		Request,
+		transfer->ReadMemory,
+		&offset,
+		NULL);
+
+	if (!NT_SUCCESS(status))
+	{
+		goto exit;
+	}
+
+	WdfRequestSetCompletionRoutine(
+		Request,
+		SpbAsyncReadCompletion,
+		SpbContext);
+
+	if (!WdfRequestSend(Request, SpbContext->SpbIoTarget, WDF_NO_SEND_OPTIONS))
+	{
+		status = WdfRequestGetStatus(Request);
+		goto exit;
+	}
+
+	return;
+
+exit:
+
+	SpbAsyncFinish(SpbContext, status);
+}
+
+static
+NTSTATUS
+SpbQueueTransfer(
+	IN SPB_CONTEXT *SpbContext,
+	IN PVOID Address,
+	IN ULONG AddressLength,
+	IN PVOID Data,
+	IN ULONG DataLength,
+	IN WDFMEMORY ReadMemory,
+	IN ULONG ReadLength,
+	IN SPB_COMPLETION Completion,
+	IN PVOID Context
+	)
+/*++
+
+	Routine Description:
+
+	This helper routine copies a transfer into a free slot, queues it
+	and starts it if the bus is free.
+
+	Arguments:
+
+	SpbContext    - Pointer to the current device context
+	Address       - The register address bytes
+	AddressLength - The number of address bytes
+	Data          - Payload written after the address, NULL for a read
+	DataLength    - The number of payload bytes
+	ReadMemory    - Receives the data of a read, NULL for a write
+	ReadLength    - The amount of data to be read
+	Completion    - Called with the outcome unless this routine fails
+	Context       - Passed to Completion
+
+	Return Value:
+
+	STATUS_SUCCESS when Completion will be called, STATUS_DEVICE_BUSY
+	when every slot is in use, STATUS_CANCELLED while transfers are
+	being cancelled, STATUS_NOT_SUPPORTED on a transport other than
+	the I/O target
+
+	--*/
+{
+	SPB_ASYNC_TRANSFER *transfer;
+	PUCHAR buffer;
+
+	if (SpbContext->AsyncLock == NULL)
+	{
+		return STATUS_NOT_SUPPORTED;
+	}
+
+	if (AddressLength + DataLength > DEFAULT_SPB_BUFFER_SIZE)
+	{
+		return STATUS_INVALID_PARAMETER;
+	}
+
+	WdfSpinLockAcquire(SpbContext->AsyncLock);
+
+	if (SpbContext->AsyncCancelling)
+	{
+		WdfSpinLockRelease(SpbContext->AsyncLock);
+		return STATUS_CANCELLED;
+	}
+
+	if (SpbContext->AsyncCount == SPB_ASYNC_TRANSFERS)
+	{
+		WdfSpinLockRelease(SpbContext->AsyncLock);
+		return STATUS_DEVICE_BUSY;
+	}
+
+	transfer = &SpbContext->AsyncTransfers[
+		(SpbContext->AsyncHead + SpbContext->AsyncCount) % SPB_ASYNC_TRANSFERS];
+
+	buffer = (PUCHAR)WdfMemoryGetBuffer(transfer->WriteMemory, NULL);
+	RtlCopyMemory(buffer, Address, AddressLength);
+	if (DataLength != 0)
+	{
+		RtlCopyMemory(buffer + AddressLength, Data, DataLength);
+	}
+
+	transfer->AddressLength = AddressLength;
+	transfer->WriteLength = AddressLength + DataLength;
+	transfer->ReadMemory = ReadMemory;
+	transfer->ReadLength = ReadLength;
+	transfer->Completion = Completion;
+	transfer->Context = Context;
+	transfer->QueueTime = SpbTraceClock(SpbContext);
+	transfer->StartTime = transfer->QueueTime;
+
+	SpbContext->AsyncCount++;
+
+	WdfSpinLockRelease(SpbContext->AsyncLock);
+
+	SpbAsyncKick(SpbContext);
+
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS
+SpbReadDataAsynchronously(
+	_In_ SPB_CONTEXT *SpbContext,
+	_In_ UCHAR Address,
+	_In_ WDFMEMORY Memory,
+	_In_ ULONG Length,
+	_In_ SPB_COMPLETION Completion,
+	_In_ PVOID Context
+	)
+/*++
+
+	Routine Description:
+
+	This routine queues a read transaction (address write, then read,
+	as one sequence when the controller supports it) on the Spb I/O
+	target without waiting for it. It can be called at DISPATCH_LEVEL.
+
+	Arguments:
+
+	SpbContext - Pointer to the current device context
+	Address    - The I2C register address to read from
+	Memory     - Receives the data, at least Length bytes
+	Length     - The amount of data to be read from the above address
+	Completion - Called with the outcome unless this routine fails
+	Context    - Passed to Completion
+
+	Return Value:
+
+	See SpbQueueTransfer
+
+	--*/
+{
+	return SpbQueueTransfer(
+		SpbContext,
+		&Address,
+		sizeof(Address),
+		NULL,
+		0,
+		Memory,
+		Length,
+		Completion,
+		Context);
+}
+
+NTSTATUS
+SpbReadDataAsynchronously16(
+	_In_ SPB_CONTEXT *SpbContext,
+	_In_ UINT16 Address,
+	_In_ WDFMEMORY Memory,
+	_In_ ULONG Length,
+	_In_ SPB_COMPLETION Completion,
+	_In_ PVOID Context
+	)
+{
+	return SpbQueueTransfer(
+		SpbContext,
+		&Address,
+		sizeof(Address),
+		NULL,
+		0,
+		Memory,
+		Length,
+		Completion,
+		Context);
+}
+
+NTSTATUS
+SpbWriteDataAsynchronously(
+	_In_ SPB_CONTEXT *SpbContext,
+	_In_ UCHAR Address,
+	_In_reads_bytes_(Length) PVOID Data,
+	_In_ ULONG Length,
+	_In_ SPB_COMPLETION Completion,
+	_In_ PVOID Context
+	)
+/*++
+
+	Routine Description:
+
+	This routine queues a write transaction (address, then Data) on
+	the Spb I/O target without waiting for it. Data is copied, so the
+	caller's buffer can be reused as soon as this returns. It can be
+	called at DISPATCH_LEVEL.
+
+	Arguments:
+
+	SpbContext - Pointer to the current device context
+	Address    - The I2C register address to write to
+	Data       - The bytes to write after the address
+	Length     - The number of bytes in Data
+	Completion - Called with the outcome unless this routine fails
+	Context    - Passed to Completion
+
+	Return Value:
+
+	See SpbQueueTransfer
+
+	--*/
+{
+	return SpbQueueTransfer(
+		SpbContext,
+		&Address,
+		sizeof(Address),
+		Data,
+		Length,
+		NULL,
+		0,
+		Completion,
+		Context);
+}
 
 NTSTATUS
-SpbDoWriteDataSynchronously16(
-	IN SPB_CONTEXT *SpbContext,
-	IN UINT16 Address,
-	IN PVOID Data,
-	IN ULONG Length
+SpbWriteDataAsynchronously16(
+	_In_ SPB_CONTEXT *SpbContext,
+	_In_ UINT16 Address,
+	_In_reads_bytes_(Length) PVOID Data,
+	_In_ ULONG Length,
+	_In_ SPB_COMPLETION Completion,
+	_In_ PVOID Context
 	)
-	/*++
+{
+	return SpbQueueTransfer(
+		SpbContext,
+		&Address,
+		sizeof(Address),
+		Data,
+		Length,
+		NULL,
+		0,
+		Completion,
+		Context);
+}
+
+VOID
+SpbCancelAsynchronous(
+	_In_ SPB_CONTEXT *SpbContext
+	)
+/*++
 
 	Routine Description:
 
-	This helper routine abstracts creating and sending an I/O
-	request (I2C Write) to the Spb I/O target.
+	This routine cancels every queued asynchronous transfer and waits
+	for the one on the bus to finish. Transfers that hadn't started
+	complete with STATUS_CANCELLED. Called at PASSIVE_LEVEL, e.g. from
+	D0Exit once nothing queues new transfers.
 
 	Arguments:
 
 	SpbContext - Pointer to the current device context
-	Address    - The I2C register address to write to
-	Data       - A buffer to receive the data at at the above address
-	Length     - The amount of data to be read from the above address
 
 	Return Value:
 
-	NTSTATUS Status indicating success or failure
+	None
 
 	--*/
 {
-	PUCHAR buffer;
-	ULONG length;
-	WDFMEMORY memory;
-	WDF_MEMORY_DESCRIPTOR memoryDescriptor;
-	NTSTATUS status;
+	SPB_ASYNC_TRANSFER cancelled[SPB_ASYNC_TRANSFERS];
+	WDFREQUEST active = NULL;
+	ULONG count = 0;
+
+	if (SpbContext->AsyncLock == NULL)
+	{
+		return;
+	}
+
+	WdfSpinLockAcquire(SpbContext->AsyncLock);
+
+	SpbContext->AsyncCancelling = TRUE;
 
 	//
-	// The address pointer and data buffer must be combined
-	// into one contiguous buffer representing the write transaction.
+	// Take the transfers that haven't started off the queue, newest
+	// first, and note the one on the bus
 	//
-	length = Length + 2;
-	memory = NULL;
+	while (SpbContext->AsyncCount > (SpbContext->AsyncActive ? 1UL : 0UL))
+	{
+		SpbContext->AsyncCount--;
+		cancelled[count++] = SpbContext->AsyncTransfers[
+			(SpbContext->AsyncHead + SpbContext->AsyncCount) % SPB_ASYNC_TRANSFERS];
+	}
 
-	if (length > DEFAULT_SPB_BUFFER_SIZE)
+	if (SpbContext->AsyncActive)
 	{
-		status = WdfMemoryCreate(
-			WDF_NO_OBJECT_ATTRIBUTES,
-			NonPagedPool,
-			CYAPA_POOL_TAG,
-			length,
-			&memory,
-			(PVOID *)&buffer);
+		active = SpbContext->AsyncTransfers[SpbContext->AsyncHead].Request;
+	}
 
-		if (!NT_SUCCESS(status))
-		{
-			ElanPrint(
-				DEBUG_LEVEL_ERROR,
-				DBG_IOCTL,
-				"Error allocating memory for Spb write - %!STATUS!",
-				status);
-			goto exit;
-		}
+	WdfSpinLockRelease(SpbContext->AsyncLock);
 
-		WDF_MEMORY_DESCRIPTOR_INIT_HANDLE(
-			&memoryDescriptor,
-			memory,
-			NULL);
+	//
+	// Ask the target to give back the one on the bus. The controller
+	// may complete it inline, and SpbAsyncFinish takes AsyncLock, so
+	// the lock must be dropped first. The request is preallocated and
+	// nothing new starts while AsyncCancelling is set, so it stays
+	// valid even if it finished in the meantime.
+	//
+	if (active != NULL)
+	{
+		WdfRequestCancelSentRequest(active);
 	}
-	else
+
+	//
+	// Complete them oldest first
+	//
+	while (count != 0)
+	{
+		count--;
+		cancelled[count].Completion(cancelled[count].Context, STATUS_CANCELLED);
+	}
+
+	SpbWaitForIdle(SpbContext);
+
+	WdfSpinLockAcquire(SpbContext->AsyncLock);
+	SpbContext->AsyncCancelling = FALSE;
+	WdfSpinLockRelease(SpbContext->AsyncLock);
+}
+
+static
+NTSTATUS
+SpbDoReadMemorySynchronously(
+	_In_ SPB_CONTEXT *SpbContext,
+	_In_ UCHAR Address,
+	_In_ WDFMEMORY Memory,
+	_In_ ULONG Length,
+	_Out_ ULONG_PTR *BytesRead
+	)
+	/*++
+
+	Routine Description:
+
+	This helper routine reads a register straight into the caller's
+	memory object, with no transfer buffer in between. Called with
+	the bus owned.
+
+	Arguments:
+
+	SpbContext - Pointer to the current device context
+	Address    - The I2C register address to read from
+	Memory     - Receives the data at the above address
+	Length     - The amount of data to be read from the above address
+	BytesRead  - Receives the number of bytes actually read
+
+	Return Value:
+
+	NTSTATUS Status indicating success or failure
+
+	--*/
+{
+	SPB_WRITE_READ_SEQUENCE sequence;
+	WDF_MEMORY_DESCRIPTOR addressDescriptor;
+	WDF_MEMORY_DESCRIPTOR dataDescriptor;
+	WDF_MEMORY_DESCRIPTOR sequenceDescriptor;
+	WDFMEMORY_OFFSET offset;
+	ULONG_PTR bytesTransferred;
+	PUCHAR data;
+	size_t size;
+	NTSTATUS status;
+
+	*BytesRead = 0;
+
+	data = (PUCHAR)WdfMemoryGetBuffer(Memory, &size);
+
+	if (size < Length)
+		return STATUS_BUFFER_TOO_SMALL;
+
+	if (SpbContext->UseSequence)
 	{
-		buffer = (PUCHAR)WdfMemoryGetBuffer(SpbContext->WriteMemory, NULL);
+		SpbFormatSequence(&sequence, &Address, sizeof(Address), data, Length);
 
 		WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
-			&memoryDescriptor,
-			(PVOID)buffer,
-			length);
-	}
+			&sequenceDescriptor,
+			&sequence,
+			sizeof(sequence));
+
+		bytesTransferred = 0;
+
+		status = WdfIoTargetSendIoctlSynchronously(
+			SpbContext->SpbIoTarget,
+			NULL,
+			IOCTL_SPB_EXECUTE_SEQUENCE,
+			&sequenceDescriptor,
+			NULL,
+			NULL,
+			&bytesTransferred);
+
+		if (!SpbSequenceRejected(SpbContext, status))
+		{
+			InterlockedIncrement64(&SpbContext->SequenceReads);
 
-	UINT16 AddressBuffer[] = {
-		Address
-	};
+			//
+			// The sequence counts the bytes moved in both directions
+			//
+			if (bytesTransferred > sizeof(Address))
+				*BytesRead = bytesTransferred - sizeof(Address);
 
-	//
-	// Transaction starts by specifying the address bytes
-	//
-	RtlCopyMemory(buffer, (UCHAR *)&AddressBuffer, sizeof(AddressBuffer));
+			return status;
+		}
+	}
+
+	InterlockedIncrement64(&SpbContext->SplitReads);
 
 	//
-	// Address is followed by the data payload
+	// Read transactions start by writing an address pointer
 	//
-	RtlCopyMemory((buffer + sizeof(AddressBuffer)), Data, length - sizeof(AddressBuffer));
+	WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
+		&addressDescriptor,
+		&Address,
+		sizeof(Address));
 
-	status = WdfIoTargetSendWriteSynchronously(
-		SpbContext->SpbIoTarget,
-		NULL,
-		&memoryDescriptor,
-		NULL,
-		NULL,
-		NULL);
+	status = SpbSendWrite(
+		SpbContext,
+		&addressDescriptor,
+		&Address,
+		sizeof(Address));
 
 	if (!NT_SUCCESS(status))
 	{
 		ElanPrint(
 			DEBUG_LEVEL_ERROR,
 			DBG_IOCTL,
-			"Error writing to Spb - %!STATUS!",
+			"Error setting address pointer for Spb read - %!STATUS!",
 			status);
-		goto exit;
+		return status;
 	}
 
-exit:
+	offset.BufferOffset = 0;
+	offset.BufferLength = Length;
+
+	WDF_MEMORY_DESCRIPTOR_INIT_HANDLE(
+		&dataDescriptor,
+		Memory,
+		&offset);
+
+	return SpbSendRead(
+		SpbContext,
+		&dataDescriptor,
+		data,
+		Length,
+		BytesRead);
+}
+
+//
+// What a synchronous transfer sends, and what its buffer holds
+//
+
+enum spb_sync_transfer {
+	SPB_SYNC_WRITE = 0,     // address bytes, then the data
+	SPB_SYNC_READ,          // address bytes, then room for the data
+	SPB_SYNC_READ_MEMORY,   // WDFMEMORY the data is read into
+	SPB_SYNC_READ_BATCH     // SPB_READ_BATCH_SEQUENCE, see SpbReadBatchSynchronously16
+};
+
+static
+NTSTATUS
+SpbTransferWithRetry(
+	IN SPB_CONTEXT *SpbContext,
+	IN ULONG Type,
+	IN USHORT Address,
+	IN PVOID Buffer,
+	IN ULONG AddressLength,
+	IN ULONG Length
+	)
+/*++
+
+	Routine Description:
 
-	if (NULL != memory)
+	This helper routine sends a synchronous transfer, owning the bus
+	for each attempt, traces every attempt and retries failed ones as
+	SpbRetryTransfer decides. A read that comes back short fails with
+	STATUS_DEVICE_PROTOCOL_ERROR, so it is retried like a NACK and the
+	caller never sees part of a register.
+
+	Arguments:
+
+	SpbContext    - Pointer to the current device context
+	Type          - spb_sync_transfer, which says what Buffer holds
+	Address       - The register address, or the first of a batch
+	Buffer        - The transfer
+	AddressLength - The number of address bytes written, all of a
+	                batch's. A memory read writes one.
+	Length        - The number of data bytes written or read
+
+	Return Value:
+
+	NTSTATUS Status indicating success or failure. A batch the
+	controller rejected as a sequence fails at once, with UseSequence
+	cleared, to be read register by register.
+
+	--*/
+{
+	LONGLONG start, acquired, end;
+	WDF_MEMORY_DESCRIPTOR memoryDescriptor;
+	ULONG_PTR bytesRead;
+	UCHAR traceType;
+	NTSTATUS status;
+
+	switch (Type)
+	{
+	case SPB_SYNC_WRITE:
+		traceType = SPB_TRACE_WRITE;
+		break;
+	case SPB_SYNC_READ_BATCH:
+		traceType = SPB_TRACE_READ_BATCH;
+		break;
+	default:
+		traceType = SPB_TRACE_READ;
+		break;
+	}
+
+	for (ULONG attempt = 0;; attempt++)
 	{
-		WdfObjectDelete(memory);
+		bytesRead = 0;
+
+		start = SpbTraceClock(SpbContext);
+		SpbAcquireBus(SpbContext);
+		acquired = SpbTraceClock(SpbContext);
+
+		switch (Type)
+		{
+		case SPB_SYNC_WRITE:
+			WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
+				&memoryDescriptor,
+				Buffer,
+				AddressLength + Length);
+
+			status = SpbSendWrite(
+				SpbContext,
+				&memoryDescriptor,
+				Buffer,
+				AddressLength + Length);
+			break;
+
+		case SPB_SYNC_READ:
+			status = SpbSendWriteRead(
+				SpbContext,
+				(PUCHAR)Buffer,
+				AddressLength,
+				Length,
+				&bytesRead);
+			break;
+
+		case SPB_SYNC_READ_MEMORY:
+			status = SpbDoReadMemorySynchronously(
+				SpbContext,
+				(UCHAR)Address,
+				(WDFMEMORY)Buffer,
+				Length,
+				&bytesRead);
+			break;
+
+		default:
+			WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
+				&memoryDescriptor,
+				Buffer,
+				sizeof(SPB_READ_BATCH_SEQUENCE));
+
+			status = WdfIoTargetSendIoctlSynchronously(
+				SpbContext->SpbIoTarget,
+				NULL,
+				IOCTL_SPB_EXECUTE_SEQUENCE,
+				&memoryDescriptor,
+				NULL,
+				NULL,
+				&bytesRead);
+
+			//
+			// The sequence counts the bytes moved in both directions
+			//
+			bytesRead = bytesRead > AddressLength ? bytesRead - AddressLength : 0;
+			break;
+		}
+
+		end = SpbTraceClock(SpbContext);
+		SpbReleaseBus(SpbContext);
+
+		if (Type == SPB_SYNC_READ_BATCH)
+		{
+			if (SpbSequenceRejected(SpbContext, status))
+				return status;
+
+			InterlockedAdd64(&SpbContext->SequenceReads, AddressLength / sizeof(UINT16));
+		}
+
+		if (NT_SUCCESS(status) && Type != SPB_SYNC_WRITE && bytesRead != Length)
+			status = STATUS_DEVICE_PROTOCOL_ERROR;
+
+		SpbTraceRecord(SpbContext, traceType, Address, Length,
+			status, attempt, start, acquired, end);
+
+		if (!SpbRetryTransfer(SpbContext, status, attempt))
+			break;
 	}
 
 	return status;
 }
 
+static
 NTSTATUS
-SpbDoWriteDataSynchronously(
-IN SPB_CONTEXT *SpbContext,
-IN UCHAR Address,
-IN PVOID Data,
-IN ULONG Length
-)
+SpbWriteRegister(
+	IN SPB_CONTEXT *SpbContext,
+	IN USHORT Address,
+	IN ULONG AddressLength,
+	IN PVOID Data,
+	IN ULONG Length
+	)
 /*++
 
-Routine Description:
+	Routine Description:
 
-This helper routine abstracts creating and sending an I/O
-request (I2C Write) to the Spb I/O target.
+	This helper routine writes a register with an 8 or 16 bit address.
 
-Arguments:
+	Arguments:
 
-SpbContext - Pointer to the current device context
-Address    - The I2C register address to write to
-Data       - A buffer to receive the data at at the above address
-Length     - The amount of data to be read from the above address
+	SpbContext    - Pointer to the current device context
+	Address       - The I2C register address to write to
+	AddressLength - The number of address bytes, 1 or 2
+	Data          - The data to write at the above address
+	Length        - The amount of data to write
 
-Return Value:
+	Return Value:
 
-NTSTATUS Status indicating success or failure
+	NTSTATUS Status indicating success or failure
 
---*/
+	--*/
 {
-	PUCHAR buffer;
-	ULONG length;
-	WDFMEMORY memory;
-	WDF_MEMORY_DESCRIPTOR memoryDescriptor;
+	SPB_BUFFER transfer;
 	NTSTATUS status;
 
 	//
 	// The address pointer and data buffer must be combined
 	// into one contiguous buffer representing the write transaction.
 	//
-	length = Length + 1;
-	memory = NULL;
+	status = SpbBufferAcquire(SpbContext, AddressLength + Length, &transfer);
 
-	if (length > DEFAULT_SPB_BUFFER_SIZE)
+	if (!NT_SUCCESS(status))
 	{
-		status = WdfMemoryCreate(
-			WDF_NO_OBJECT_ATTRIBUTES,
-			NonPagedPool,
-			CYAPA_POOL_TAG,
-			length,
-			&memory,
-			(PVOID *)&buffer);
+		ElanPrint(
+			DEBUG_LEVEL_ERROR,
+			DBG_IOCTL,
+			"Error allocating memory for Spb write - %!STATUS!",
+			status);
+		return status;
+	}
 
-		if (!NT_SUCCESS(status))
-		{
-			ElanPrint(
-				DEBUG_LEVEL_ERROR,
-				DBG_IOCTL,
-				"Error allocating memory for Spb write - %!STATUS!",
-				status);
-			goto exit;
-		}
+	//
+	// Little endian, low byte first, as the address goes on the bus
+	//
+	RtlCopyMemory(transfer.Data, &Address, AddressLength);
+	RtlCopyMemory(transfer.Data + AddressLength, Data, Length);
 
-		WDF_MEMORY_DESCRIPTOR_INIT_HANDLE(
-			&memoryDescriptor,
-			memory,
-			NULL);
-	}
-	else
-	{
-		buffer = (PUCHAR)WdfMemoryGetBuffer(SpbContext->WriteMemory, NULL);
+	status = SpbTransferWithRetry(
+		SpbContext,
+		SPB_SYNC_WRITE,
+		Address,
+		transfer.Data,
+		AddressLength,
+		Length);
 
-		WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
-			&memoryDescriptor,
-			(PVOID)buffer,
-			length);
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(
+			DEBUG_LEVEL_ERROR,
+			DBG_IOCTL,
+			"Error writing to Spb - %!STATUS!",
+			status);
 	}
 
-	//
-	// Transaction starts by specifying the address bytes
-	//
-	RtlCopyMemory(buffer, &Address, sizeof(Address));
+	SpbBufferRelease(SpbContext, &transfer);
+
+	return status;
+}
+
+static
+NTSTATUS
+SpbReadRegister(
+	IN SPB_CONTEXT *SpbContext,
+	IN USHORT Address,
+	IN ULONG AddressLength,
+	OUT PVOID Data,
+	IN ULONG Length
+	)
+/*++
+
+	Routine Description:
+
+	This helper routine reads a register with an 8 or 16 bit address
+	through a transfer buffer, so a failed or short read leaves the
+	caller's buffer untouched.
+
+	Arguments:
+
+	SpbContext    - Pointer to the current device context
+	Address       - The I2C register address to read from
+	AddressLength - The number of address bytes, 1 or 2
+	Data          - A buffer to receive the data at the above address
+	Length        - The amount of data to be read from the above address
+
+	Return Value:
+
+	NTSTATUS Status indicating success or failure
+
+	--*/
+{
+	SPB_BUFFER transfer;
+	NTSTATUS status;
 
 	//
-	// Address is followed by the data payload
+	// The buffer holds the address pointer followed by the data read
 	//
-	RtlCopyMemory((buffer + sizeof(Address)), Data, length - sizeof(Address));
+	status = SpbBufferAcquire(SpbContext, AddressLength + Length, &transfer);
 
-	status = WdfIoTargetSendWriteSynchronously(
-		SpbContext->SpbIoTarget,
-		NULL,
-		&memoryDescriptor,
-		NULL,
-		NULL,
-		NULL);
+	if (!NT_SUCCESS(status))
+	{
+		ElanPrint(
+			DEBUG_LEVEL_ERROR,
+			DBG_IOCTL,
+			"Error allocating memory for Spb read - %!STATUS!",
+			status);
+		return status;
+	}
+
+	RtlCopyMemory(transfer.Data, &Address, AddressLength);
+
+	status = SpbTransferWithRetry(
+		SpbContext,
+		SPB_SYNC_READ,
+		Address,
+		transfer.Data,
+		AddressLength,
+		Length);
 
 	if (!NT_SUCCESS(status))
 	{
 		ElanPrint(
 			DEBUG_LEVEL_ERROR,
 			DBG_IOCTL,
-			"Error writing to Spb - %!STATUS!",
+			"Error reading from Spb - %!STATUS!",
 			status);
 		goto exit;
 	}
 
+	//
+	// Copy back to the caller's buffer
+	//
+	RtlCopyMemory(Data, transfer.Data + AddressLength, Length);
+
 exit:
 
-	if (NULL != memory)
-	{
-		WdfObjectDelete(memory);
-	}
+	SpbBufferRelease(SpbContext, &transfer);
 
 	return status;
 }
@@ -266,16 +1866,15 @@ IN ULONG Length
 
 Routine Description:
 
-This routine abstracts creating and sending an I/O
-request (I2C Write) to the Spb I/O target and utilizes
-a helper routine to do work inside of locked code.
+This routine writes a register with an 8 bit address, owning the bus
+for each attempt and retrying failed ones.
 
 Arguments:
 
 SpbContext - Pointer to the current device context
 Address    - The I2C register address to write to
-Data       - A buffer to receive the data at at the above address
-Length     - The amount of data to be read from the above address
+Data       - The data to write at the above address
+Length     - The amount of data to write
 
 Return Value:
 
@@ -283,19 +1882,7 @@ NTSTATUS Status indicating success or failure
 
 --*/
 {
-	NTSTATUS status;
-
-	WdfWaitLockAcquire(SpbContext->SpbLock, NULL);
-
-	status = SpbDoWriteDataSynchronously(
-		SpbContext,
-		Address,
-		Data,
-		Length);
-
-	WdfWaitLockRelease(SpbContext->SpbLock);
-
-	return status;
+	return SpbWriteRegister(SpbContext, Address, sizeof(Address), Data, Length);
 }
 
 NTSTATUS
@@ -309,36 +1896,12 @@ SpbWriteDataSynchronously16(
 
 	Routine Description:
 
-	This routine abstracts creating and sending an I/O
-	request (I2C Write) to the Spb I/O target and utilizes
-	a helper routine to do work inside of locked code.
-
-	Arguments:
-
-	SpbContext - Pointer to the current device context
-	Address    - The I2C register address to write to
-	Data       - A buffer to receive the data at at the above address
-	Length     - The amount of data to be read from the above address
-
-	Return Value:
-
-	NTSTATUS Status indicating success or failure
+	This routine is SpbWriteDataSynchronously for registers with a
+	16 bit address.
 
 	--*/
 {
-	NTSTATUS status;
-
-	WdfWaitLockAcquire(SpbContext->SpbLock, NULL);
-
-	status = SpbDoWriteDataSynchronously16(
-		SpbContext,
-		Address,
-		Data,
-		Length);
-
-	WdfWaitLockRelease(SpbContext->SpbLock);
-
-	return status;
+	return SpbWriteRegister(SpbContext, Address, sizeof(Address), Data, Length);
 }
 
 NTSTATUS
@@ -352,8 +1915,8 @@ _In_ ULONG Length
 
 Routine Description:
 
-This helper routine abstracts creating and sending an I/O
-request (I2C Read) to the Spb I/O target.
+This routine reads a register with an 8 bit address, owning the bus
+for each attempt and retrying failed and short ones.
 
 Arguments:
 
@@ -364,109 +1927,63 @@ Length     - The amount of data to be read from the above address
 
 Return Value:
 
-NTSTATUS Status indicating success or failure
+NTSTATUS Status indicating success or failure. A failed read leaves
+Data untouched.
 
 --*/
 {
-	PUCHAR buffer;
-	WDFMEMORY memory;
-	WDF_MEMORY_DESCRIPTOR memoryDescriptor;
-	NTSTATUS status;
-	ULONG_PTR bytesRead;
-
-	WdfWaitLockAcquire(SpbContext->SpbLock, NULL);
+	return SpbReadRegister(SpbContext, Address, sizeof(Address), Data, Length);
+}
 
-	memory = NULL;
-	status = STATUS_INVALID_PARAMETER;
-	bytesRead = 0;
+NTSTATUS
+SpbReadMemorySynchronously(
+	_In_ SPB_CONTEXT *SpbContext,
+	_In_ UCHAR Address,
+	_In_ WDFMEMORY Memory,
+	_In_ ULONG Length
+	)
+	/*++
 
-	//
-	// Read transactions start by writing an address pointer
-	//
-	status = SpbDoWriteDataSynchronously(
-		SpbContext,
-		Address,
-		NULL,
-		0);
+	Routine Description:
 
-	if (!NT_SUCCESS(status))
-	{
-		ElanPrint(
-			DEBUG_LEVEL_ERROR,
-			DBG_IOCTL,
-			"Error setting address pointer for Spb read - %!STATUS!",
-			status);
-		goto exit;
-	}
+	This routine reads a register straight into the caller's memory
+	object, with no transfer buffer in between. Meant for buffers
+	that are reused for every read, like the frame buffers reports
+	are polled into.
 
-	if (Length > DEFAULT_SPB_BUFFER_SIZE)
-	{
-		status = WdfMemoryCreate(
-			WDF_NO_OBJECT_ATTRIBUTES,
-			NonPagedPool,
-			CYAPA_POOL_TAG,
-			Length,
-			&memory,
-			(PVOID *)&buffer);
+	Arguments:
 
-		if (!NT_SUCCESS(status))
-		{
-			ElanPrint(
-				DEBUG_LEVEL_ERROR,
-				DBG_IOCTL,
-				"Error allocating memory for Spb read - %!STATUS!",
-				status);
-			goto exit;
-		}
+	SpbContext - Pointer to the current device context
+	Address    - The I2C register address to read from
+	Memory     - Receives the data at the above address
+	Length     - The amount of data to be read from the above address
 
-		WDF_MEMORY_DESCRIPTOR_INIT_HANDLE(
-			&memoryDescriptor,
-			memory,
-			NULL);
-	}
-	else
-	{
-		buffer = (PUCHAR)WdfMemoryGetBuffer(SpbContext->ReadMemory, NULL);
+	Return Value:
 
-		WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
-			&memoryDescriptor,
-			(PVOID)buffer,
-			Length);
-	}
+	NTSTATUS Status indicating success or failure. Unlike the copying
+	reads, a failed or short read may have overwritten part of Memory.
 
+	--*/
+{
+	NTSTATUS status;
 
-	status = WdfIoTargetSendReadSynchronously(
-		SpbContext->SpbIoTarget,
-		NULL,
-		&memoryDescriptor,
-		NULL,
-		NULL,
-		&bytesRead);
+	status = SpbTransferWithRetry(
+		SpbContext,
+		SPB_SYNC_READ_MEMORY,
+		Address,
+		Memory,
+		sizeof(Address),
+		Length);
 
-	if (!NT_SUCCESS(status) ||
-		bytesRead != Length)
+	if (!NT_SUCCESS(status))
 	{
 		ElanPrint(
 			DEBUG_LEVEL_ERROR,
 			DBG_IOCTL,
 			"Error reading from Spb - %!STATUS!",
 			status);
-		goto exit;
-	}
-
-	//
-	// Copy back to the caller's buffer
-	//
-	RtlCopyMemory(Data, buffer, Length);
-
-exit:
-	if (NULL != memory)
-	{
-		WdfObjectDelete(memory);
 	}
 
-	WdfWaitLockRelease(SpbContext->SpbLock);
-
 	return status;
 }
 
@@ -481,122 +1998,151 @@ SpbReadDataSynchronously16(
 
 	Routine Description:
 
-	This helper routine abstracts creating and sending an I/O
-	request (I2C Read) to the Spb I/O target.
+	This routine is SpbReadDataSynchronously for registers with a
+	16 bit address.
+
+	--*/
+{
+	return SpbReadRegister(SpbContext, Address, sizeof(Address), Data, Length);
+}
+
+NTSTATUS
+SpbReadBatchSynchronously16(
+	_In_ SPB_CONTEXT *SpbContext,
+	_In_reads_(Count) const SPB_READ_BATCH_ENTRY *Entries,
+	_In_ ULONG Count
+	)
+	/*++
+
+	Routine Description:
+
+	This helper routine reads a set of independent registers in one
+	bus transaction: a single IOCTL_SPB_EXECUTE_SEQUENCE holding the
+	address write and read of each, separated by repeated starts.
+	Without sequence support each register is read on its own.
 
 	Arguments:
 
 	SpbContext - Pointer to the current device context
-	Address    - The I2C register address to read from
-	Data       - A buffer to receive the data at at the above address
-	Length     - The amount of data to be read from the above address
+	Entries    - The registers to read and the buffers receiving them
+	Count      - The number of entries, at most SPB_READ_BATCH_MAX
 
 	Return Value:
 
-	NTSTATUS Status indicating success or failure
+	NTSTATUS Status indicating success or failure. On failure no
+	caller buffer is written by the sequence, though a split batch
+	may have filled the entries before the one that failed.
 
 	--*/
 {
-	PUCHAR buffer;
-	WDFMEMORY memory;
-	WDF_MEMORY_DESCRIPTOR memoryDescriptor;
+	SPB_READ_BATCH_SEQUENCE sequence;
+	SPB_BUFFER transfer;
+	ULONG total = 0;
+	ULONG offset;
 	NTSTATUS status;
-	ULONG_PTR bytesRead;
 
-	WdfWaitLockAcquire(SpbContext->SpbLock, NULL);
+	if (Count == 0 || Count > SPB_READ_BATCH_MAX)
+		return STATUS_INVALID_PARAMETER;
+
+	if (!SpbContext->UseSequence)
+		goto split;
 
-	memory = NULL;
-	status = STATUS_INVALID_PARAMETER;
-	bytesRead = 0;
+	for (ULONG i = 0; i < Count; i++)
+		total += sizeof(UINT16) + Entries[i].Length;
 
 	//
-	// Read transactions start by writing an address pointer
+	// The buffer holds each address pointer followed by its data
 	//
-	status = SpbDoWriteDataSynchronously16(
-		SpbContext,
-		Address,
-		NULL,
-		0);
+	status = SpbBufferAcquire(SpbContext, total, &transfer);
 
 	if (!NT_SUCCESS(status))
 	{
 		ElanPrint(
 			DEBUG_LEVEL_ERROR,
 			DBG_IOCTL,
-			"Error setting address pointer for Spb read - %!STATUS!",
+			"Error allocating memory for Spb batch - %!STATUS!",
 			status);
-		goto exit;
+		return status;
 	}
 
-	if (Length > DEFAULT_SPB_BUFFER_SIZE)
+	SPB_TRANSFER_LIST_INIT(&sequence.List, 2 * Count);
+
+	offset = 0;
+	for (ULONG i = 0; i < Count; i++)
 	{
-		status = WdfMemoryCreate(
-			WDF_NO_OBJECT_ATTRIBUTES,
-			NonPagedPool,
-			CYAPA_POOL_TAG,
-			Length,
-			&memory,
-			(PVOID *)&buffer);
+		RtlCopyMemory(transfer.Data + offset, &Entries[i].Address, sizeof(UINT16));
 
-		if (!NT_SUCCESS(status))
-		{
-			ElanPrint(
-				DEBUG_LEVEL_ERROR,
-				DBG_IOCTL,
-				"Error allocating memory for Spb read - %!STATUS!",
-				status);
-			goto exit;
-		}
+		sequence.List.Transfers[2 * i] = SPB_TRANSFER_LIST_ENTRY_INIT_SIMPLE(
+			SpbTransferDirectionToDevice,
+			0,
+			transfer.Data + offset,
+			sizeof(UINT16));
 
-		WDF_MEMORY_DESCRIPTOR_INIT_HANDLE(
-			&memoryDescriptor,
-			memory,
-			NULL);
-	}
-	else
-	{
-		buffer = (PUCHAR)WdfMemoryGetBuffer(SpbContext->ReadMemory, NULL);
+		sequence.List.Transfers[2 * i + 1] = SPB_TRANSFER_LIST_ENTRY_INIT_SIMPLE(
+			SpbTransferDirectionFromDevice,
+			0,
+			transfer.Data + offset + sizeof(UINT16),
+			Entries[i].Length);
 
-		WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
-			&memoryDescriptor,
-			(PVOID)buffer,
-			Length);
+		offset += sizeof(UINT16) + Entries[i].Length;
 	}
 
+	status = SpbTransferWithRetry(
+		SpbContext,
+		SPB_SYNC_READ_BATCH,
+		Entries[0].Address,
+		&sequence,
+		Count * sizeof(UINT16),
+		total - Count * sizeof(UINT16));
 
-	status = WdfIoTargetSendReadSynchronously(
-		SpbContext->SpbIoTarget,
-		NULL,
-		&memoryDescriptor,
-		NULL,
-		NULL,
-		&bytesRead);
+	if (!SpbContext->UseSequence)
+	{
+		SpbBufferRelease(SpbContext, &transfer);
+		goto split;
+	}
 
-	if (!NT_SUCCESS(status) ||
-		bytesRead != Length)
+	if (!NT_SUCCESS(status))
 	{
 		ElanPrint(
 			DEBUG_LEVEL_ERROR,
 			DBG_IOCTL,
-			"Error reading from Spb - %!STATUS!",
+			"Error reading batch from Spb - %!STATUS!",
 			status);
 		goto exit;
 	}
 
-	//
-	// Copy back to the caller's buffer
-	//
-	RtlCopyMemory(Data, buffer, Length);
-
-exit:
-	if (NULL != memory)
+	offset = 0;
+	for (ULONG i = 0; i < Count; i++)
 	{
-		WdfObjectDelete(memory);
+		RtlCopyMemory(
+			Entries[i].Data,
+			transfer.Data + offset + sizeof(UINT16),
+			Entries[i].Length);
+
+		offset += sizeof(UINT16) + Entries[i].Length;
 	}
 
-	WdfWaitLockRelease(SpbContext->SpbLock);
+exit:
+
+	SpbBufferRelease(SpbContext, &transfer);
 
 	return status;
+
+split:
+
+	for (ULONG i = 0; i < Count; i++)
+	{
+		status = SpbReadDataSynchronously16(
+			SpbContext,
+			Entries[i].Address,
+			Entries[i].Data,
+			Entries[i].Length);
+
+		if (!NT_SUCCESS(status))
+			return status;
+	}
+
+	return STATUS_SUCCESS;
 }
 
 VOID
@@ -629,19 +2175,45 @@ NTSTATUS Status indicating success or failure
 	//
 	// Free any SPB_CONTEXT allocations here
 	//
-	if (SpbContext->SpbLock != NULL)
+	for (ULONG i = 0; i < SPB_ASYNC_TRANSFERS; i++)
 	{
-		WdfObjectDelete(SpbContext->SpbLock);
+		SPB_ASYNC_TRANSFER *transfer = &SpbContext->AsyncTransfers[i];
+
+		if (transfer->Request != NULL)
+		{
+			WdfObjectDelete(transfer->Request);
+			transfer->Request = NULL;
+		}
+
+		if (transfer->WriteMemory != NULL)
+		{
+			WdfObjectDelete(transfer->WriteMemory);
+			transfer->WriteMemory = NULL;
+		}
+
+		if (transfer->SequenceMemory != NULL)
+		{
+			WdfObjectDelete(transfer->SequenceMemory);
+			transfer->SequenceMemory = NULL;
+		}
 	}
 
-	if (SpbContext->ReadMemory != NULL)
+	if (SpbContext->AsyncLock != NULL)
 	{
-		WdfObjectDelete(SpbContext->ReadMemory);
+		WdfObjectDelete(SpbContext->AsyncLock);
+		SpbContext->AsyncLock = NULL;
 	}
 
-	if (SpbContext->WriteMemory != NULL)
+	for (ULONG c = 0; c < SPB_POOL_CLASSES; c++)
 	{
-		WdfObjectDelete(SpbContext->WriteMemory);
+		SPB_POOL_CLASS *pool = &SpbContext->Pool[c];
+
+		if (pool->Memory != NULL)
+		{
+			WdfObjectDelete(pool->Memory);
+			pool->Memory = NULL;
+			pool->Buffers = NULL;
+		}
 	}
 }
 
@@ -678,6 +2250,18 @@ NTSTATUS Status indicating success or failure
 	WDF_OBJECT_ATTRIBUTES_INIT(&objectAttributes);
 	objectAttributes.ParentObject = FxDevice;
 
+	SpbContext->BusOwned = 0;
+	KeInitializeEvent(&SpbContext->BusIdle, SynchronizationEvent, TRUE);
+
+	//
+	// A transport replaces the I/O target, only the buffers are needed
+	//
+	if (SpbContext->Transport != NULL)
+	{
+		SpbContext->UseSequence = FALSE;
+		goto allocate;
+	}
+
 	status = WdfIoTargetCreate(
 		FxDevice,
 		&objectAttributes,
@@ -736,59 +2320,93 @@ NTSTATUS Status indicating success or failure
 		goto exit;
 	}
 
+allocate:
+
 	//
-	// Allocate some fixed-size buffers from NonPagedPool for typical
-	// Spb transaction sizes to avoid pool fragmentation in most cases
+	// Allocate the transfer buffer pool from NonPagedPool up front, one
+	// block per size class, so typical transfers never allocate
 	//
-	status = WdfMemoryCreate(
-		WDF_NO_OBJECT_ATTRIBUTES,
-		NonPagedPool,
-		CYAPA_POOL_TAG,
-		DEFAULT_SPB_BUFFER_SIZE,
-		&SpbContext->WriteMemory,
-		NULL);
-
-	if (!NT_SUCCESS(status))
+	for (ULONG c = 0; c < SPB_POOL_CLASSES; c++)
 	{
-		ElanPrint(
-			DEBUG_LEVEL_ERROR,
-			DBG_IOCTL,
-			"Error allocating default memory for Spb write - %!STATUS!",
-			status);
-		goto exit;
-	}
+		SPB_POOL_CLASS *pool = &SpbContext->Pool[c];
 
-	status = WdfMemoryCreate(
-		WDF_NO_OBJECT_ATTRIBUTES,
-		NonPagedPool,
-		CYAPA_POOL_TAG,
-		DEFAULT_SPB_BUFFER_SIZE,
-		&SpbContext->ReadMemory,
-		NULL);
+		status = WdfMemoryCreate(
+			WDF_NO_OBJECT_ATTRIBUTES,
+			NonPagedPool,
+			CYAPA_POOL_TAG,
+			SpbPoolBufferSizes[c] * SPB_POOL_BUFFERS,
+			&pool->Memory,
+			(PVOID *)&pool->Buffers);
 
-	if (!NT_SUCCESS(status))
+		if (!NT_SUCCESS(status))
+		{
+			ElanPrint(
+				DEBUG_LEVEL_ERROR,
+				DBG_IOCTL,
+				"Error allocating Spb buffer pool - %!STATUS!",
+				status);
+			goto exit;
+		}
+
+		pool->BufferSize = SpbPoolBufferSizes[c];
+		pool->FreeMask = (LONG)((1UL << SPB_POOL_BUFFERS) - 1);
+		pool->InUse = 0;
+	}
+
+	if (SpbContext->Transport != NULL)
 	{
-		ElanPrint(
-			DEBUG_LEVEL_ERROR,
-			DBG_IOCTL,
-			"Error allocating default memory for Spb read - %!STATUS!",
-			status);
 		goto exit;
 	}
 
 	//
-	// Allocate a waitlock to guard access to the default buffers
+	// Requests and buffers of the asynchronous transfers are allocated
+	// once, so queueing a transfer never allocates
 	//
-	status = WdfWaitLockCreate(
-		WDF_NO_OBJECT_ATTRIBUTES,
-		&SpbContext->SpbLock);
+	for (ULONG i = 0; i < SPB_ASYNC_TRANSFERS && NT_SUCCESS(status); i++)
+	{
+		SPB_ASYNC_TRANSFER *transfer = &SpbContext->AsyncTransfers[i];
+
+		status = WdfRequestCreate(
+			&objectAttributes,
+			SpbContext->SpbIoTarget,
+			&transfer->Request);
+
+		if (NT_SUCCESS(status))
+		{
+			status = WdfMemoryCreate(
+				WDF_NO_OBJECT_ATTRIBUTES,
+				NonPagedPool,
+				CYAPA_POOL_TAG,
+				DEFAULT_SPB_BUFFER_SIZE,
+				&transfer->WriteMemory,
+				NULL);
+		}
+
+		if (NT_SUCCESS(status))
+		{
+			status = WdfMemoryCreate(
+				WDF_NO_OBJECT_ATTRIBUTES,
+				NonPagedPool,
+				CYAPA_POOL_TAG,
+				sizeof(SPB_WRITE_READ_SEQUENCE),
+				&transfer->SequenceMemory,
+				NULL);
+		}
+	}
+
+	if (NT_SUCCESS(status))
+	{
+		status = WdfSpinLockCreate(
+			&objectAttributes,
+			&SpbContext->AsyncLock);
+	}
 
 	if (!NT_SUCCESS(status))
 	{
 		ElanPrint(
 			DEBUG_LEVEL_ERROR,
 			DBG_IOCTL,
-			"Error creating Spb Waitlock - %!STATUS!",
+			"Error allocating Spb asynchronous transfers - %!STATUS!",
 			status);
 		goto exit;
 	}
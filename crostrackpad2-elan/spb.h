@@ -22,9 +22,170 @@ Revision History:
 
 #include <wdm.h>
 #include <wdf.h>
+#include "spbtransport.h"
 
 #define DEFAULT_SPB_BUFFER_SIZE 64
 
+//
+// Called at IRQL <= DISPATCH_LEVEL when an asynchronous transfer is
+// done, while the transfer still owns the bus
+//
+
+typedef VOID (*SPB_COMPLETION)(PVOID Context, NTSTATUS Status);
+
+//
+// Asynchronous transfers are queued into a fixed set of preallocated
+// slots and go on the bus in the order they were queued. Each slot has
+// its own request, a buffer for the address and any write payload, and
+// the sequence list of a combined read.
+//
+
+#define SPB_ASYNC_TRANSFERS 4
+
+typedef struct _SPB_ASYNC_TRANSFER
+{
+	WDFREQUEST Request;
+	WDFMEMORY WriteMemory;
+	WDFMEMORY SequenceMemory;
+	ULONG AddressLength;
+	ULONG WriteLength;
+
+	// Caller's memory receiving a read, NULL for a write
+	WDFMEMORY ReadMemory;
+	ULONG ReadLength;
+
+	SPB_COMPLETION Completion;
+	PVOID Context;
+
+	// Trace clock when the transfer was queued and went on the bus
+	LONGLONG QueueTime;
+	LONGLONG StartTime;
+} SPB_ASYNC_TRANSFER;
+
+//
+// Transfer buffers of the synchronous routines come from a fixed pool
+// of size classes, each a bitmap of free buffers claimed and returned
+// with interlocked operations. A transfer takes a buffer from the
+// smallest class it fits, then from larger ones, and only allocates
+// when they are all in use or it fits none.
+//
+
+#define SPB_POOL_CLASSES 2
+#define SPB_POOL_BUFFERS 4
+
+typedef struct _SPB_POOL_CLASS
+{
+	ULONG BufferSize;
+	WDFMEMORY Memory;
+	PUCHAR Buffers;
+	volatile LONG FreeMask;
+
+	//
+	// Buffers in use now and at most, buffers handed out, and transfers
+	// sized for this class that had to allocate
+	//
+
+	volatile LONG InUse;
+	volatile LONG HighWater;
+	volatile LONG64 Acquired;
+	volatile LONG64 Fallbacks;
+} SPB_POOL_CLASS;
+
+typedef struct _SPB_BUFFER
+{
+	PUCHAR Data;
+
+	// Pool class and index, or a class of -1 and the allocation
+	LONG Class;
+	ULONG Index;
+	WDFMEMORY Memory;
+} SPB_BUFFER;
+
+//
+// One register read of SpbReadBatchSynchronously16
+//
+
+#define SPB_READ_BATCH_MAX 10
+
+typedef struct _SPB_READ_BATCH_ENTRY
+{
+	UINT16 Address;
+	PVOID Data;
+	ULONG Length;
+} SPB_READ_BATCH_ENTRY;
+
+//
+// Causes of a failed transfer: the device didn't acknowledge its
+// address, the controller timed out, the device sent fewer bytes than
+// asked for, or anything else. Synchronous transfers retry all but the
+// last, up to SPB_RETRY_LIMIT times, backing off SPB_RETRY_BACKOFF_US
+// and doubling each attempt up to SPB_RETRY_MAX_BACKOFF_US. The backoff
+// spins, often with PollLock held, so it stays short.
+//
+
+enum spb_error {
+	SPB_ERROR_NACK = 0,
+	SPB_ERROR_TIMEOUT,
+	SPB_ERROR_SHORT,
+	SPB_ERROR_OTHER,
+	SPB_ERROR_CLASSES
+};
+
+#define SPB_RETRY_LIMIT          5
+#define SPB_RETRY_BACKOFF_US     10
+#define SPB_RETRY_MAX_BACKOFF_US 50
+
+//
+// Trace of bus transactions, one record per attempt: the register,
+// how long the transaction waited for the bus and how long it held it,
+// in KeQueryPerformanceCounter() ticks, and how it ended. Records go
+// into a fixed ring without a lock. A writer claims the next record
+// by incrementing Next, clears its Sequence while filling it and then
+// publishes its transaction number there, so a reader can tell a
+// record it copied was neither overwritten nor half written.
+//
+
+#define SPB_TRACE_RECORDS   256
+
+C_ASSERT((SPB_TRACE_RECORDS & (SPB_TRACE_RECORDS - 1)) == 0);
+
+enum spb_trace_type {
+	SPB_TRACE_WRITE = 0,
+	SPB_TRACE_READ,
+	SPB_TRACE_READ_BATCH,
+
+	// Or'd in for transfers queued asynchronously
+	SPB_TRACE_ASYNC = 0x80
+};
+
+typedef struct _SPB_TRACE_RECORD
+{
+	volatile LONG64 Sequence;
+
+	LONGLONG Timestamp;
+	ULONG WaitTicks;
+	ULONG BusTicks;
+	NTSTATUS Status;
+
+	// Bytes read, or written after the address
+	ULONG Length;
+
+	USHORT Address;
+	UCHAR Type;
+	UCHAR Attempt;
+} SPB_TRACE_RECORD;
+
+typedef struct _SPB_TRACE
+{
+	BOOLEAN Enabled;
+
+	// Transactions traced so far, and the first one not yet dumped
+	volatile LONG64 Next;
+	ULONGLONG ReadCursor;
+
+	SPB_TRACE_RECORD Records[SPB_TRACE_RECORDS];
+} SPB_TRACE;
+
 //
 // SPB (I2C) context
 //
@@ -33,9 +194,71 @@ typedef struct _SPB_CONTEXT
 {
 	WDFIOTARGET SpbIoTarget;
 	LARGE_INTEGER I2cResHubId;
-	WDFMEMORY WriteMemory;
-	WDFMEMORY ReadMemory;
-	WDFWAITLOCK SpbLock;
+	const SPB_TRANSPORT *Transport;
+	PVOID TransportContext;
+
+	//
+	// Register reads go out as one IOCTL_SPB_EXECUTE_SEQUENCE (address
+	// write, repeated start, read) while UseSequence is set, and as a
+	// separate write and read otherwise. Set before SpbTargetInitialize;
+	// cleared there for a transport, and when the controller rejects
+	// the sequence. SequenceReads and SplitReads count each kind.
+	//
+
+	BOOLEAN UseSequence;
+	volatile LONG64 SequenceReads;
+	volatile LONG64 SplitReads;
+
+	//
+	// Times a failed synchronous transfer is retried, set before
+	// SpbTargetInitialize. Failures by spb_error class, retries sent,
+	// and transfers that succeeded on a retry.
+	//
+
+	ULONG RetryCount;
+	volatile LONG64 Errors[SPB_ERROR_CLASSES];
+	volatile LONG64 Retries;
+	volatile LONG64 Recovered;
+
+	//
+	// Transfer buffer pool, and transfers too large for any class
+	//
+
+	SPB_POOL_CLASS Pool[SPB_POOL_CLASSES];
+	volatile LONG64 PoolOversize;
+
+	//
+	// Transaction trace, recorded while Trace.Enabled is set
+	//
+
+	SPB_TRACE Trace;
+
+	//
+	// The bus belongs to one transaction at a time, either a synchronous
+	// one or the oldest queued asynchronous transfer: whoever swaps
+	// BusOwned from 0 to 1. BusIdle is an auto-reset event set on every
+	// release, so each release wakes one waiter to try for the bus
+	// again. No one clears it, so a release can't be lost to a race;
+	// a signal left over while the bus is owned costs a waiter one
+	// more wait.
+	//
+
+	volatile LONG BusOwned;
+	KEVENT BusIdle;
+
+	//
+	// Queue of asynchronous transfers, guarded by AsyncLock: AsyncCount
+	// slots from AsyncHead, the first of them on the bus while
+	// AsyncActive. AsyncCancelling refuses new transfers while
+	// SpbCancelAsynchronous runs. Only available on the I/O target.
+	//
+
+	WDFSPINLOCK AsyncLock;
+	SPB_ASYNC_TRANSFER AsyncTransfers[SPB_ASYNC_TRANSFERS];
+	ULONG AsyncHead;
+	ULONG AsyncCount;
+	BOOLEAN AsyncActive;
+	BOOLEAN AsyncCancelling;
 } SPB_CONTEXT;
 
 NTSTATUS
@@ -46,6 +269,64 @@ _In_reads_bytes_(Length) PVOID Data,
 _In_ ULONG Length
 );
 
+NTSTATUS
+SpbReadMemorySynchronously(
+	_In_ SPB_CONTEXT *SpbContext,
+	_In_ UCHAR Address,
+	_In_ WDFMEMORY Memory,
+	_In_ ULONG Length
+	);
+
+NTSTATUS
+SpbReadDataAsynchronously(
+	_In_ SPB_CONTEXT *SpbContext,
+	_In_ UCHAR Address,
+	_In_ WDFMEMORY Memory,
+	_In_ ULONG Length,
+	_In_ SPB_COMPLETION Completion,
+	_In_ PVOID Context
+	);
+
+NTSTATUS
+SpbReadDataAsynchronously16(
+	_In_ SPB_CONTEXT *SpbContext,
+	_In_ UINT16 Address,
+	_In_ WDFMEMORY Memory,
+	_In_ ULONG Length,
+	_In_ SPB_COMPLETION Completion,
+	_In_ PVOID Context
+	);
+
+NTSTATUS
+SpbWriteDataAsynchronously(
+	_In_ SPB_CONTEXT *SpbContext,
+	_In_ UCHAR Address,
+	_In_reads_bytes_(Length) PVOID Data,
+	_In_ ULONG Length,
+	_In_ SPB_COMPLETION Completion,
+	_In_ PVOID Context
+	);
+
+NTSTATUS
+SpbWriteDataAsynchronously16(
+	_In_ SPB_CONTEXT *SpbContext,
+	_In_ UINT16 Address,
+	_In_reads_bytes_(Length) PVOID Data,
+	_In_ ULONG Length,
+	_In_ SPB_COMPLETION Completion,
+	_In_ PVOID Context
+	);
+
+VOID
+SpbWaitForIdle(
+	_In_ SPB_CONTEXT *SpbContext
+	);
+
+VOID
+SpbCancelAsynchronous(
+	_In_ SPB_CONTEXT *SpbContext
+	);
+
 NTSTATUS
 SpbReadDataSynchronously16(
 	_In_ SPB_CONTEXT *SpbContext,
@@ -54,6 +335,20 @@ SpbReadDataSynchronously16(
 	_In_ ULONG Length
 	);
 
+NTSTATUS
+SpbReadBatchSynchronously16(
+	_In_ SPB_CONTEXT *SpbContext,
+	_In_reads_(Count) const SPB_READ_BATCH_ENTRY *Entries,
+	_In_ ULONG Count
+	);
+
+BOOLEAN
+SpbTraceGet(
+	_In_ SPB_CONTEXT *SpbContext,
+	_In_ ULONGLONG Sequence,
+	_Out_ SPB_TRACE_RECORD *Record
+	);
+
 VOID
 SpbTargetDeinitialize(
 IN WDFDEVICE FxDevice,
@@ -0,0 +1,16 @@
+#ifndef _SPBTRANSPORT_H_
+#define _SPBTRANSPORT_H_
+
+//
+// Optional transport replacing the SPB I/O target, e.g. a simulated
+// device. Called with the bus owned, with the complete bus transfer.
+// Kept apart from spb.h so a transport can be built without WDF.
+//
+
+typedef struct _SPB_TRANSPORT
+{
+	NTSTATUS (*Write)(PVOID Context, PVOID Buffer, ULONG Length);
+	NTSTATUS (*Read)(PVOID Context, PVOID Buffer, ULONG Length, ULONG_PTR *BytesRead);
+} SPB_TRANSPORT;
+
+#endif
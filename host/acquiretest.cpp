@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <string.h>
+#include <ntddk.h>
+#include <wdf.h>
+#include "acquire.h"
+
+//
+// Drives the driver's frame source selection, acquire.cpp, with a
+// simulated pad and interrupt line, the way the ISR, the poll timer and
+// OnD0EntryPostInterruptsEnabled do. The pad is quiet for a while after
+// D0 entry, as the self-test expects, then has a contact down and a new
+// frame every LINE_FRAME_MS, the latest held until it is read. The timer
+// polls every LINE_POLL_MS. A working line signals each new frame, a
+// stuck line signals every millisecond with nothing to read, a dead
+// line never signals. A line the driver gives up on is disabled.
+//
+// Fails when a line doesn't end up as expected, or when the timer isn't
+// the source for as long as the self-test runs.
+//
+
+#define LINE_TICK           10000ULL    // 1ms, in 100ns units
+#define LINE_QUIET_MS       100
+#define LINE_RUN_MS         400
+#define LINE_FRAME_MS       7
+#define LINE_POLL_MS        8
+
+enum line_kind {
+	LINE_WORKING,
+	LINE_STUCK,
+	LINE_DEAD
+};
+
+typedef struct _LINE_RESULT
+{
+	ULONG Source;
+	ULONG SelfTest;
+	ULONGLONG Interrupts;
+	ULONGLONG SpuriousInterrupts;
+	ULONGLONG MissedInterrupts;
+	ULONG Disabled;
+	ULONG FramesMade;
+	ULONG FramesRead;
+	bool TimerDuringSelfTest;
+} LINE_RESULT;
+
+static const char *LineName(int kind) {
+	switch (kind) {
+	case LINE_WORKING:
+		return "working";
+	case LINE_STUCK:
+		return "stuck";
+	default:
+		return "dead";
+	}
+}
+
+static const char *LineSelfTestName(ULONG selfTest) {
+	switch (selfTest) {
+	case ELAN_SELFTEST_NOT_RUN:
+		return "not run";
+	case ELAN_SELFTEST_PASSED:
+		return "passed";
+	case ELAN_SELFTEST_STUCK_LINE:
+		return "stuck line";
+	case ELAN_SELFTEST_DEAD_LINE:
+		return "dead line";
+	case ELAN_SELFTEST_RUNNING:
+		return "running";
+	default:
+		return "?";
+	}
+}
+
+static void LineRun(int kind, LINE_RESULT *result) {
+	ELAN_ACQUISITION acq;
+	bool pending = false;
+	bool disabled = false;
+
+	memset(&acq, 0, sizeof(acq));
+	memset(result, 0, sizeof(*result));
+	result->TimerDuringSelfTest = true;
+
+	//
+	// D0 entry: polls until the interrupt is connected, then starts the
+	// self-test
+	//
+	acq.InterruptRequested = TRUE;
+	acq.Source = ELAN_ACQUIRE_TIMER;
+	acq.SelfTest = ELAN_SELFTEST_NOT_RUN;
+	ElanAcquireStart(&acq, 0);
+
+	for (ULONG ms = 1; ms <= LINE_QUIET_MS + LINE_RUN_MS; ms++) {
+		ULONGLONG now = ms * LINE_TICK;
+		bool edge = false;
+
+		if (ms > LINE_QUIET_MS && (ms - LINE_QUIET_MS) % LINE_FRAME_MS == 0) {
+			pending = true;
+			result->FramesMade++;
+			edge = kind == LINE_WORKING;
+		}
+		if (kind == LINE_STUCK)
+			edge = true;
+
+		//
+		// The passive-level ISR reads on the edge
+		//
+		if (edge && !disabled) {
+			BOOLEAN disableLine;
+
+			if (ElanAcquireOnInterrupt(&acq, &disableLine)) {
+				if (ElanAcquireRecordFrame(&acq, ELAN_ACQUIRE_INTERRUPT, pending, now))
+					disableLine = TRUE;
+				if (pending)
+					result->FramesRead++;
+				pending = false;
+			}
+			if (disableLine) {
+				disabled = true;
+				result->Disabled++;
+			}
+		}
+
+		if (ms % LINE_POLL_MS == 0) {
+			if (ElanAcquireRecordFrame(&acq, ELAN_ACQUIRE_TIMER, pending, now)) {
+				disabled = true;
+				result->Disabled++;
+			}
+			if (pending)
+				result->FramesRead++;
+			pending = false;
+		}
+
+		if (acq.SelfTest == ELAN_SELFTEST_RUNNING && acq.Source != ELAN_ACQUIRE_TIMER)
+			result->TimerDuringSelfTest = false;
+	}
+
+	result->Source = acq.Source;
+	result->SelfTest = acq.SelfTest;
+	result->Interrupts = acq.Interrupts;
+	result->SpuriousInterrupts = acq.SpuriousInterrupts;
+	result->MissedInterrupts = acq.MissedInterrupts;
+}
+
+static bool LineExpect(int kind, const LINE_RESULT *result) {
+	if (!result->TimerDuringSelfTest)
+		return false;
+
+	switch (kind) {
+	case LINE_WORKING:
+		return result->SelfTest == ELAN_SELFTEST_PASSED &&
+			result->Source == ELAN_ACQUIRE_INTERRUPT &&
+			result->MissedInterrupts == 0 &&
+			result->SpuriousInterrupts == 0 &&
+			result->Interrupts == result->FramesMade &&
+			result->Disabled == 0;
+	case LINE_STUCK:
+		return result->SelfTest == ELAN_SELFTEST_STUCK_LINE &&
+			result->Source == ELAN_ACQUIRE_TIMER &&
+			result->SpuriousInterrupts == ELAN_SELFTEST_SPURIOUS_LIMIT + 1 &&
+			result->Disabled == 1;
+	default:
+		return result->SelfTest == ELAN_SELFTEST_DEAD_LINE &&
+			result->Source == ELAN_ACQUIRE_TIMER &&
+			result->Interrupts == 0 &&
+			result->MissedInterrupts == ELAN_MISSED_INTERRUPT_LIMIT &&
+			result->Disabled == 1;
+	}
+}
+
+int main(int argc, char **argv) {
+	int failed = 0;
+
+	for (int kind = LINE_WORKING; kind <= LINE_DEAD; kind++) {
+		LINE_RESULT result;
+		bool ok;
+
+		LineRun(kind, &result);
+		ok = LineExpect(kind, &result);
+
+		printf("%-8s %-4s self-test %-10s source %-9s %llu interrupts, %llu spurious, %llu missed, "
+			"%lu disabled, %lu/%lu frames read%s\n",
+			LineName(kind), ok ? "ok" : "FAIL",
+			LineSelfTestName(result.SelfTest),
+			result.Source == ELAN_ACQUIRE_INTERRUPT ? "interrupt" : "timer",
+			(unsigned long long)result.Interrupts,
+			(unsigned long long)result.SpuriousInterrupts,
+			(unsigned long long)result.MissedInterrupts,
+			(unsigned long)result.Disabled,
+			(unsigned long)result.FramesRead, (unsigned long)result.FramesMade,
+			result.TimerDuringSelfTest ? "" : ", left the timer during the self-test");
+
+		if (!ok)
+			failed = 1;
+	}
+
+	return failed;
+}
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <unistd.h>
+#include "host.h"
+#include "spb.h"
+#include "boot.h"
+#include "elandebug.h"
+
+//
+// Boots the register model with ElanRunBootScript and polls reports from
+// it with SpbReadMemorySynchronously, the driver's own SPB routines going
+// through the SPB_TRANSPORT hook as they do with the SimulatedTarget
+// setting, and reports what each costs on the bus in the model's virtual
+// time. Bus latency and injected errors are set as with the Sim*
+// settings, and failed transfers are retried as with BusRetries, so the
+// retry backoff is part of the cost.
+//
+// Fails when a boot or a report read fails after its retries, or when a
+// boot reads back an identity other than the model's.
+//
+
+typedef struct _BUS_COST
+{
+	ULONGLONG Time;
+	ULONGLONG Transfers;
+	ULONGLONG BytesMoved;
+	ULONGLONG BusMicroseconds;
+	ULONGLONG InjectedErrors;
+} BUS_COST;
+
+static void BusSnapshot(const ELAN_SIM_DEVICE *sim, BUS_COST *cost) {
+	cost->Time = HostSimTime;
+	cost->Transfers = sim->Transfers;
+	cost->BytesMoved = sim->BytesMoved;
+	cost->BusMicroseconds = sim->BusMicroseconds;
+	cost->InjectedErrors = sim->InjectedErrors;
+}
+
+static void BusPrintCost(const char *label, const BUS_COST *start, const BUS_COST *end, ULONGLONG count) {
+	if (count == 0)
+		return;
+
+	printf("  %-6s %10.1f us %10.1f us on the bus %6.2f transfers %8.1f bytes per %s, %llu errors injected\n",
+		label,
+		(end->Time - start->Time) / 10.0 / count,
+		(double)(end->BusMicroseconds - start->BusMicroseconds) / count,
+		(double)(end->Transfers - start->Transfers) / count,
+		(double)(end->BytesMoved - start->BytesMoved) / count,
+		label,
+		(unsigned long long)(end->InjectedErrors - start->InjectedErrors));
+}
+
+static bool BusIdentityMatches(const ELAN_DEVICE_INFO *info, const ELAN_SIM_DEVICE *sim) {
+	return (info->UniqueId & 0xff) == sim->ProductId &&
+		info->FwVersion == sim->FwVersion &&
+		info->FwChecksum == sim->FwChecksum &&
+		(info->MaxX & 0x0fff) == sim->MaxX &&
+		(info->MaxY & 0x0fff) == sim->MaxY &&
+		info->XTraces == sim->XTraces &&
+		info->YTraces == sim->YTraces;
+}
+
+static void BusUsage(void) {
+	fprintf(stderr,
+		"usage: elan-bus-bench [-n boots] [-f frames] [-i interval-us] [-l latency-us]\n"
+		"                      [-b latency-us-per-byte] [-e error-interval] [-s] [-r retries]\n"
+		"  -n  boots of the model (default 20)\n"
+		"  -f  reports polled after the boots (default 1000)\n"
+		"  -i  microseconds between polls (default %d)\n"
+		"  -l  bus latency of each transfer, SimLatencyUs (default 0)\n"
+		"  -b  bus latency of each byte, SimLatencyUsPerByte (default 0)\n"
+		"  -e  fail every n'th transfer, SimErrorInterval (default 0, never)\n"
+		"  -s  injected errors return half the bytes, SimShortReads\n"
+		"  -r  retries of a failed transfer, BusRetries (default %d, at most %d)\n",
+		GESTURE_TICK_MS * 1000, ETP_RETRY_COUNT, SPB_RETRY_LIMIT);
+}
+
+int main(int argc, char **argv) {
+	static SPB_CONTEXT spb;
+	ELAN_SIM_DEVICE sim;
+	ELAN_DEVICE_INFO info;
+	ELAN_BOOT_TIMING timing;
+	BUS_COST start, end;
+	int boots = 20;
+	int frames = 1000;
+	int intervalUs = GESTURE_TICK_MS * 1000;
+	int retries = ETP_RETRY_COUNT;
+	int option;
+
+	ElanSimInitialize(&sim);
+
+	while ((option = getopt(argc, argv, "n:f:i:l:b:e:sr:h")) != -1) {
+		switch (option) {
+		case 'n':
+			boots = atoi(optarg);
+			break;
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'i':
+			intervalUs = atoi(optarg);
+			break;
+		case 'l':
+			sim.LatencyUs = atoi(optarg);
+			break;
+		case 'b':
+			sim.LatencyUsPerByte = atoi(optarg);
+			break;
+		case 'e':
+			sim.ErrorInterval = atoi(optarg);
+			break;
+		case 's':
+			sim.ErrorStatus = STATUS_SUCCESS;
+			break;
+		case 'r':
+			retries = atoi(optarg);
+			break;
+		default:
+			BusUsage();
+			return 2;
+		}
+	}
+	if (boots < 1 || frames < 0 || intervalUs < 1 || retries < 0 || retries > SPB_RETRY_LIMIT) {
+		BusUsage();
+		return 2;
+	}
+
+	//
+	// Set up as the driver does in OnPrepareHardware, less the I/O
+	// target
+	//
+	ElanSimAttach(&spb, &sim);
+	spb.RetryCount = retries;
+	if (!NT_SUCCESS(SpbTargetInitialize(NULL, &spb))) {
+		fprintf(stderr, "elan-bus-bench: SpbTargetInitialize failed\n");
+		return 1;
+	}
+
+	int failed = 0;
+	ULONG failedBoots = 0;
+	ULONG failedSteps = 0;
+	ULONG wrongIdentity = 0;
+
+	RtlZeroMemory(&timing, sizeof(timing));
+
+	BusSnapshot(&sim, &start);
+	for (int i = 0; i < boots; i++) {
+		if (!NT_SUCCESS(ElanRunBootScript(&spb, &info, &timing)))
+			failedBoots++;
+		failedSteps += timing.FailedSteps;
+		if (!BusIdentityMatches(&info, &sim))
+			wrongIdentity++;
+	}
+	BusSnapshot(&sim, &end);
+
+	printf("latency %lu us + %lu us/byte, error every %lu transfers%s, %d retries\n",
+		(unsigned long)sim.LatencyUs, (unsigned long)sim.LatencyUsPerByte,
+		(unsigned long)sim.ErrorInterval, sim.ErrorStatus == STATUS_SUCCESS ? " (short reads)" : "",
+		retries);
+	printf("%d boots: %lu failed, %lu failed steps, %lu read back a wrong identity\n",
+		boots, (unsigned long)failedBoots, (unsigned long)failedSteps, (unsigned long)wrongIdentity);
+	BusPrintCost("boot", &start, &end, boots);
+
+	printf("  last boot by step:");
+	for (ULONG i = 0; i < timing.Steps; i++)
+		printf(" %.0f", timing.StepTicks[i] / 10.0);
+	printf(" us\n");
+
+	if (failedBoots != 0 || failedSteps != 0 || wrongIdentity != 0)
+		failed = 1;
+
+	//
+	// Poll reports into a reused buffer, as the timer-driven poll does,
+	// while the model plays a finger moving across the pad
+	//
+	WDFMEMORY memory;
+	PUCHAR report;
+	ULONG failedReads = 0;
+	ULONG reports = 0;
+
+	if (!NT_SUCCESS(WdfMemoryCreate(WDF_NO_OBJECT_ATTRIBUTES, NonPagedPool, CYAPA_POOL_TAG,
+		ETP_MAX_REPORT_LEN, &memory, (PVOID *)&report))) {
+		fprintf(stderr, "elan-bus-bench: WdfMemoryCreate failed\n");
+		return 1;
+	}
+
+	ElanSimRunScript(&sim, ELAN_SIM_SCRIPT_MOVE);
+
+	BusSnapshot(&sim, &start);
+	for (int i = 0; i < frames; i++) {
+		HostSimTime += intervalUs * 10ULL;
+
+		if (!NT_SUCCESS(SpbReadMemorySynchronously(&spb, 0, memory, ETP_MAX_REPORT_LEN)))
+			failedReads++;
+		else if (report[ETP_REPORT_ID_OFFSET] == ETP_REPORT_ID)
+			reports++;
+	}
+	BusSnapshot(&sim, &end);
+
+	//
+	// The poll interval is the caller's, not the bus's
+	//
+	end.Time -= (ULONGLONG)frames * intervalUs * 10;
+
+	printf("%d polls: %lu failed, %lu reports\n", frames, (unsigned long)failedReads, (unsigned long)reports);
+	BusPrintCost("poll", &start, &end, frames);
+
+	if (failedReads != 0 || reports != (ULONG)frames - failedReads)
+		failed = 1;
+
+	printf("spb: %lld retries, %lld recovered; errors %lld nack %lld timeout %lld short %lld other\n",
+		(long long)spb.Retries, (long long)spb.Recovered,
+		(long long)spb.Errors[SPB_ERROR_NACK], (long long)spb.Errors[SPB_ERROR_TIMEOUT],
+		(long long)spb.Errors[SPB_ERROR_SHORT], (long long)spb.Errors[SPB_ERROR_OTHER]);
+
+	WdfObjectDelete(memory);
+	SpbTargetDeinitialize(NULL, &spb);
+
+	return failed;
+}
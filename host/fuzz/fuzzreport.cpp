@@ -0,0 +1,87 @@
+#include <ntddk.h>
+#include "gesture.h"
+
+//
+// libFuzzer target over the report decoder and the gesture engine,
+// built with AddressSanitizer and UndefinedBehaviorSanitizer so that
+// out-of-bounds accesses and undefined arithmetic are reported as
+// crashes. An input is a 3 byte header followed by frames of
+// FUZZ_FRAME_LEN bytes:
+//
+//   header  - pad width and height in raw units, high nibbles packed in
+//             the third byte, and a prediction horizon in its low bits
+//   frame   - the milliseconds since the previous frame, with the top
+//             bit routing the frame through TrackpadRawInput, and an
+//             ETP_MAX_REPORT_LEN byte report
+//
+// Frames with the top bit clear go to ElanDecodeReport and, when they
+// decode, ProcessGesture, whatever the unchanged frame check would say.
+//
+
+#define FUZZ_HEADER_LEN     3
+#define FUZZ_FRAME_LEN      (1 + ETP_MAX_REPORT_LEN)
+
+static csgesture_softc FuzzSoftc;
+
+// Last mouse report sent, kept by gesture.cpp to drop repeats
+extern _CYAPA_RELATIVE_MOUSE_REPORT lastreport;
+
+NTSTATUS
+ElanProcessVendorReport(
+	IN PDEVICE_CONTEXT DevContext,
+	IN PVOID ReportBuffer,
+	IN ULONG ReportBufferLen,
+	OUT size_t* BytesWritten
+	)
+{
+	//
+	// Stands in for the HID read queue: every report has to fit the
+	// largest report the driver describes, and is read in full so a
+	// report built past the end of its buffer is caught
+	//
+	static volatile BYTE sink;
+	BYTE copy[max(sizeof(ElanKeyboardReport), sizeof(ElanRelativeMouseReport))];
+
+	UNREFERENCED_PARAMETER(DevContext);
+
+	if (ReportBufferLen == 0 || ReportBufferLen > sizeof(copy))
+		__builtin_trap();
+
+	memcpy(copy, ReportBuffer, ReportBufferLen);
+	sink = copy[ReportBufferLen - 1];
+
+	*BytesWritten = ReportBufferLen;
+	return STATUS_SUCCESS;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
+	csgesture_softc *sc = &FuzzSoftc;
+	uint8_t report[ETP_MAX_REPORT_LEN];
+
+	if (Size < FUZZ_HEADER_LEN)
+		return 0;
+
+	memset(sc, 0, sizeof(*sc));
+	memset(&lastreport, 0, sizeof(lastreport));
+	sc->resx = Data[0] | ((Data[2] & 0xf0) << 4);
+	sc->resy = Data[1] | ((Data[2] & 0x0f) << 8);
+	sc->predictms = Data[2] % (GESTURE_MAX_PREDICT_MS + 1);
+
+	Data += FUZZ_HEADER_LEN;
+	Size -= FUZZ_HEADER_LEN;
+
+	for (; Size >= FUZZ_FRAME_LEN; Data += FUZZ_FRAME_LEN, Size -= FUZZ_FRAME_LEN) {
+		int intervalMs = Data[0] & 0x7f;
+
+		memcpy(report, Data + 1, ETP_MAX_REPORT_LEN);
+
+		if (Data[0] & 0x80) {
+			TrackpadRawInput(NULL, sc, report, intervalMs);
+		}
+		else if (ElanDecodeReport(sc, report) == ELAN_FRAME_VALID) {
+			sc->frameintervalms = intervalMs;
+			ProcessGesture(NULL, sc);
+		}
+	}
+	return 0;
+}
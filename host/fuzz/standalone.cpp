@@ -0,0 +1,216 @@
+#include <dirent.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <sanitizer/common_interface_defs.h>
+#include <ntddk.h>
+#include "elantp.h"
+
+//
+// Stand-in for libFuzzer where the compiler doesn't have it (GCC). Takes
+// the same -runs= and -max_total_time= flags and seed files or
+// directories, and mutates the seeds, or generated reports when there
+// are none, at random. Crashes are left to the sanitizers; the input
+// that caused one is first written to crash-<pid> so it can be replayed
+// by passing it as a seed with -runs=1. Prints the executions per second
+// at the end.
+//
+
+#define FUZZ_MAX_LEN        4096
+#define FUZZ_MAX_SEEDS      1024
+#define FUZZ_HEADER_LEN     3
+#define FUZZ_FRAME_LEN      (1 + ETP_MAX_REPORT_LEN)
+#define FUZZ_SEED_FRAMES    32
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size);
+
+static uint8_t *FuzzSeeds[FUZZ_MAX_SEEDS];
+static size_t FuzzSeedLengths[FUZZ_MAX_SEEDS];
+static size_t FuzzSeedCount;
+
+static uint8_t FuzzInput[FUZZ_MAX_LEN];
+static size_t FuzzInputLength;
+
+static uint64_t FuzzState = 88172645463325252ULL;
+
+static uint32_t FuzzRandom(void) {
+	FuzzState ^= FuzzState << 13;
+	FuzzState ^= FuzzState >> 7;
+	FuzzState ^= FuzzState << 17;
+	return (uint32_t)(FuzzState >> 32);
+}
+
+static void FuzzSaveCrash(void) {
+	char path[64];
+
+	snprintf(path, sizeof(path), "crash-%d", (int)getpid());
+	FILE *file = fopen(path, "wb");
+	if (file != NULL) {
+		fwrite(FuzzInput, 1, FuzzInputLength, file);
+		fclose(file);
+		fprintf(stderr, "input written to %s\n", path);
+	}
+}
+
+static void FuzzSignal(int sig) {
+	FuzzSaveCrash();
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+static void FuzzAddSeed(const char *path) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL || FuzzSeedCount == FUZZ_MAX_SEEDS) {
+		if (file != NULL)
+			fclose(file);
+		return;
+	}
+
+	uint8_t *seed = (uint8_t *)malloc(FUZZ_MAX_LEN);
+	size_t length = seed != NULL ? fread(seed, 1, FUZZ_MAX_LEN, file) : 0;
+	fclose(file);
+
+	FuzzSeeds[FuzzSeedCount] = seed;
+	FuzzSeedLengths[FuzzSeedCount] = length;
+	FuzzSeedCount++;
+}
+
+static void FuzzAddSeeds(const char *path) {
+	struct stat info;
+
+	if (stat(path, &info) != 0) {
+		fprintf(stderr, "%s: not found\n", path);
+		return;
+	}
+	if (!S_ISDIR(info.st_mode)) {
+		FuzzAddSeed(path);
+		return;
+	}
+
+	DIR *dir = opendir(path);
+	struct dirent *entry;
+	while (dir != NULL && (entry = readdir(dir)) != NULL) {
+		char child[4096];
+
+		if (entry->d_name[0] == '.')
+			continue;
+		snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+		FuzzAddSeed(child);
+	}
+	if (dir != NULL)
+		closedir(dir);
+}
+
+static void FuzzGenerate(void) {
+	//
+	// Well-formed reports with random contacts, so that mutations start
+	// past the report ID check
+	//
+	FuzzInputLength = FUZZ_HEADER_LEN + FUZZ_SEED_FRAMES * FUZZ_FRAME_LEN;
+	for (size_t i = 0; i < FuzzInputLength; i++)
+		FuzzInput[i] = (uint8_t)FuzzRandom();
+
+	for (int n = 0; n < FUZZ_SEED_FRAMES; n++) {
+		uint8_t *frame = &FuzzInput[FUZZ_HEADER_LEN + n * FUZZ_FRAME_LEN];
+		uint8_t *report = frame + 1;
+
+		frame[0] &= 0x8f;
+		report[0] = ETP_I2C_REPORT_LEN;
+		report[ETP_REPORT_ID_OFFSET] = ETP_REPORT_ID;
+	}
+}
+
+static void FuzzMutate(void) {
+	if (FuzzSeedCount == 0 || FuzzRandom() % 8 == 0) {
+		FuzzGenerate();
+	}
+	else {
+		size_t seed = FuzzRandom() % FuzzSeedCount;
+		FuzzInputLength = FuzzSeedLengths[seed];
+		memcpy(FuzzInput, FuzzSeeds[seed], FuzzInputLength);
+	}
+
+	int mutations = 1 + FuzzRandom() % 16;
+	for (int m = 0; m < mutations && FuzzInputLength != 0; m++) {
+		size_t at = FuzzRandom() % FuzzInputLength;
+
+		switch (FuzzRandom() % 4) {
+		case 0:
+			FuzzInput[at] ^= 1 << (FuzzRandom() % 8);
+			break;
+		case 1:
+			FuzzInput[at] = (uint8_t)FuzzRandom();
+			break;
+		case 2:
+			FuzzInput[at] = (FuzzRandom() & 1) ? 0xff : 0x00;
+			break;
+		case 3:
+			// Repeat a frame, as the pad does when nothing changed
+			if (FuzzInputLength + FUZZ_FRAME_LEN <= FUZZ_MAX_LEN && at + FUZZ_FRAME_LEN <= FuzzInputLength) {
+				memmove(FuzzInput + at + FUZZ_FRAME_LEN, FuzzInput + at, FuzzInputLength - at);
+				FuzzInputLength += FUZZ_FRAME_LEN;
+			}
+			break;
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	unsigned long long runs = 0;
+	unsigned long long seconds = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "-runs=", 6) == 0)
+			runs = strtoull(argv[i] + 6, NULL, 0);
+		else if (strncmp(argv[i], "-max_total_time=", 16) == 0)
+			seconds = strtoull(argv[i] + 16, NULL, 0);
+		else if (strncmp(argv[i], "-seed=", 6) == 0)
+			FuzzState = strtoull(argv[i] + 6, NULL, 0) | 1;
+		else if (argv[i][0] == '-')
+			fprintf(stderr, "ignoring %s\n", argv[i]);
+		else
+			FuzzAddSeeds(argv[i]);
+	}
+	if (runs == 0 && seconds == 0)
+		seconds = 60;
+
+	__sanitizer_set_death_callback(FuzzSaveCrash);
+	signal(SIGSEGV, FuzzSignal);
+	signal(SIGILL, FuzzSignal);
+	signal(SIGFPE, FuzzSignal);
+	signal(SIGABRT, FuzzSignal);
+
+	struct timespec start, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	//
+	// Seeds go through unchanged first, so a saved crash reproduces
+	//
+	unsigned long long execs = 0;
+	for (size_t seed = 0; seed < FuzzSeedCount && (runs == 0 || execs < runs); seed++, execs++) {
+		FuzzInputLength = FuzzSeedLengths[seed];
+		memcpy(FuzzInput, FuzzSeeds[seed], FuzzInputLength);
+		LLVMFuzzerTestOneInput(FuzzInput, FuzzInputLength);
+	}
+
+	double elapsed = 0;
+	for (; runs == 0 || execs < runs; execs++) {
+		FuzzMutate();
+		LLVMFuzzerTestOneInput(FuzzInput, FuzzInputLength);
+
+		if ((execs & 0x3ff) == 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+			if (seconds != 0 && elapsed >= seconds)
+				break;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%llu execs in %.1f s, %.0f execs/s, no crashes\n",
+		execs, elapsed, elapsed > 0 ? execs / elapsed : 0.0);
+	return 0;
+}
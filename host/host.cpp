@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "host.h"
+
+ULONGLONG HostReports;
+
+// Last mouse report sent, kept by gesture.cpp to drop repeats
+extern _CYAPA_RELATIVE_MOUSE_REPORT lastreport;
+
+NTSTATUS
+ElanProcessVendorReport(
+	IN PDEVICE_CONTEXT DevContext,
+	IN PVOID ReportBuffer,
+	IN ULONG ReportBufferLen,
+	OUT size_t* BytesWritten
+	)
+{
+	//
+	// The engine folds every report into sc->reportdigest before handing
+	// it over, so a host only needs to count them
+	//
+	UNREFERENCED_PARAMETER(DevContext);
+	UNREFERENCED_PARAMETER(ReportBuffer);
+
+	HostReports++;
+	*BytesWritten = ReportBufferLen;
+	return STATUS_SUCCESS;
+}
+
+bool HostAllocSequence(size_t Count, HOST_SEQUENCE *Sequence) {
+	ELAN_CAPTURE_HEADER *header;
+
+	memset(Sequence, 0, sizeof(*Sequence));
+	Sequence->Length = sizeof(ELAN_CAPTURE_HEADER) + Count * sizeof(ELAN_CAPTURE_RECORD);
+	Sequence->Capture = (uint8_t *)calloc(1, Sequence->Length);
+	if (Sequence->Capture == NULL)
+		return false;
+
+	header = (ELAN_CAPTURE_HEADER *)Sequence->Capture;
+	header->Magic = ELAN_CAPTURE_MAGIC;
+	header->Version = ELAN_CAPTURE_VERSION;
+	header->HeaderSize = sizeof(ELAN_CAPTURE_HEADER);
+	header->RecordSize = sizeof(ELAN_CAPTURE_RECORD);
+	header->RecordCount = Count;
+	header->TimestampFrequency = 10000000;
+
+	Sequence->Records = Sequence->Capture + header->HeaderSize;
+	Sequence->RecordSize = header->RecordSize;
+	Sequence->Count = Count;
+	return true;
+}
+
+ULONG HostIntervalMs(ULONGLONG From, ULONGLONG To) {
+	return (ULONG)(To / 10000 - From / 10000);
+}
+
+static bool HostLoadReports(const uint8_t *data, size_t length, ULONG intervalUs, HOST_SEQUENCE *sequence) {
+	size_t count = length / ETP_MAX_REPORT_LEN;
+
+	if (length % ETP_MAX_REPORT_LEN != 0 || !HostAllocSequence(count, sequence))
+		return false;
+
+	for (size_t i = 0; i < count; i++) {
+		ELAN_CAPTURE_RECORD *record = HostRecord(sequence, i);
+
+		memcpy(record->Report, data + i * ETP_MAX_REPORT_LEN, ETP_MAX_REPORT_LEN);
+		record->Timestamp = i * intervalUs * 10ULL;
+		record->IntervalMs = i == 0 ? intervalUs / 1000 :
+			HostIntervalMs(record->Timestamp - intervalUs * 10ULL, record->Timestamp);
+	}
+	return true;
+}
+
+bool HostLoadSequence(const char *Path, ULONG IntervalUs, HOST_SEQUENCE *Sequence) {
+	struct stat status;
+
+	memset(Sequence, 0, sizeof(*Sequence));
+
+	int file = open(Path, O_RDONLY);
+	if (file < 0) {
+		fprintf(stderr, "%s: cannot open\n", Path);
+		return false;
+	}
+
+	//
+	// Writable but private, so that an update can patch the output of
+	// the records in place without touching the file
+	//
+	uint8_t *data = NULL;
+	size_t length = 0;
+	if (fstat(file, &status) == 0 && status.st_size > 0) {
+		length = (size_t)status.st_size;
+		data = (uint8_t *)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+		if (data == MAP_FAILED)
+			data = NULL;
+	}
+	close(file);
+
+	bool loaded = false;
+	ULONGLONG count;
+	ULONG recordSize;
+	uint8_t *records = data != NULL ? ElanCaptureRecords(data, length, &recordSize, &count) : NULL;
+
+	if (records != NULL) {
+		Sequence->Capture = data;
+		Sequence->Length = length;
+		Sequence->Mapped = true;
+		Sequence->Records = records;
+		Sequence->RecordSize = recordSize;
+		Sequence->Count = (size_t)count;
+		Sequence->Golden = true;
+		return true;
+	}
+
+	ULONG magic = 0;
+	if (data != NULL && length >= sizeof(magic))
+		memcpy(&magic, data, sizeof(magic));
+
+	if (data != NULL && magic != ELAN_CAPTURE_MAGIC)
+		loaded = HostLoadReports(data, length, IntervalUs, Sequence);
+	if (data != NULL)
+		munmap(data, length);
+
+	if (!loaded)
+		fprintf(stderr, "%s: not a capture or a sequence of %d byte reports\n", Path, ETP_MAX_REPORT_LEN);
+	return loaded;
+}
+
+bool HostSaveCapture(const char *Path, const HOST_SEQUENCE *Sequence) {
+	ELAN_CAPTURE_HEADER *header = (ELAN_CAPTURE_HEADER *)Sequence->Capture;
+	char temporary[4096];
+
+	//
+	// Only the records replayed are kept. A mapped capture still reads
+	// its untouched pages from the file, so it is written beside it and
+	// renamed over it.
+	//
+	header->RecordCount = Sequence->Count;
+	size_t length = header->HeaderSize + Sequence->Count * Sequence->RecordSize;
+
+	snprintf(temporary, sizeof(temporary), "%s.tmp", Path);
+	FILE *file = fopen(temporary, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "%s: cannot create\n", temporary);
+		return false;
+	}
+
+	bool written = fwrite(Sequence->Capture, 1, length, file) == length;
+	if (fclose(file) != 0)
+		written = false;
+	if (written && rename(temporary, Path) != 0)
+		written = false;
+
+	if (!written) {
+		fprintf(stderr, "%s: write failed\n", Path);
+		remove(temporary);
+	}
+	return written;
+}
+
+void HostFreeSequence(HOST_SEQUENCE *Sequence) {
+	if (Sequence->Mapped)
+		munmap(Sequence->Capture, Sequence->Length);
+	else
+		free(Sequence->Capture);
+	memset(Sequence, 0, sizeof(*Sequence));
+}
+
+void HostResetEngine(struct csgesture_softc *sc, int resx, int resy) {
+	//
+	// The device context, and the softc in it, start out zeroed
+	//
+	memset(sc, 0, sizeof(*sc));
+	memset(&lastreport, 0, sizeof(lastreport));
+	sc->resx = resx;
+	sc->resy = resy;
+}
+
+ULONGLONG HostNanoseconds(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (ULONGLONG)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
@@ -0,0 +1,89 @@
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <ntddk.h>
+#include "gesture.h"
+#include "elansim.h"
+
+//
+// Geometry of the Acer C720P's pad, used for report sequences that don't
+// come with their own
+//
+
+#define HOST_DEFAULT_RESX       3048
+#define HOST_DEFAULT_RESY       1672
+
+//
+// A report sequence as the host tools replay it, always in the capture
+// format of elanioctl.h, so that it can go through ElanReplayCapture and
+// its records can be handed to the engine where they lie. A capture file
+// is mapped privately rather than read; raw reports and simulator
+// scripts are laid out as a capture in memory. Each record holds a
+// report with the milliseconds since the previous one and, when it came
+// from a capture, the HID output the driver produced for it.
+//
+
+typedef struct _HOST_SEQUENCE
+{
+	// The capture, header and records, and whether it is mapped
+	uint8_t *Capture;
+	size_t Length;
+	bool Mapped;
+
+	uint8_t *Records;
+	ULONG RecordSize;
+	size_t Count;
+
+	// Records carry the driver's output, to be matched by a replay
+	bool Golden;
+} HOST_SEQUENCE;
+
+static inline ELAN_CAPTURE_RECORD *HostRecord(const HOST_SEQUENCE *Sequence, size_t Index) {
+	return (ELAN_CAPTURE_RECORD *)(Sequence->Records + Index * Sequence->RecordSize);
+}
+
+//
+// Maps an ELAN capture file, or lays out a raw file of back-to-back
+// ETP_MAX_REPORT_LEN byte reports read IntervalUs apart. Changes to the
+// records of a mapped capture stay private until HostSaveCapture.
+//
+
+bool HostLoadSequence(const char *Path, ULONG IntervalUs, HOST_SEQUENCE *Sequence);
+bool HostSaveCapture(const char *Path, const HOST_SEQUENCE *Sequence);
+void HostFreeSequence(HOST_SEQUENCE *Sequence);
+
+// Lays out an empty capture of Count zeroed records
+bool HostAllocSequence(size_t Count, HOST_SEQUENCE *Sequence);
+
+//
+// Plays one of ElanSimScripts through the register model, reading a
+// report every IntervalUs of virtual time, Loops times over
+//
+
+bool HostSimSequence(ULONG Script, ULONG IntervalUs, int Loops, HOST_SEQUENCE *Sequence);
+
+//
+// Whole milliseconds from one 100ns time to a later one, as the driver
+// hands them to the engine: what is left under a millisecond is carried
+// to the next frame, so the intervals of a run add up to its length
+//
+
+ULONG HostIntervalMs(ULONGLONG From, ULONGLONG To);
+
+extern const char *HostSimScriptNames[ELAN_SIM_SCRIPT_COUNT];
+
+// Virtual time of the register model, in 100ns units
+extern ULONGLONG HostSimTime;
+
+//
+// Puts the engine back in the state of a freshly added device
+//
+
+void HostResetEngine(struct csgesture_softc *sc, int resx, int resy);
+
+ULONGLONG HostNanoseconds(void);
+
+// HID reports the engine has handed to ElanProcessVendorReport
+extern ULONGLONG HostReports;
+
+#endif
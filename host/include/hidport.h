@@ -0,0 +1,10 @@
+#ifndef _HOST_HIDPORT_H_
+#define _HOST_HIDPORT_H_
+
+//
+// The portable sources include hidport.h but use nothing from it
+//
+
+#include <ntddk.h>
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef _HOST_INITGUID_H_
+#define _HOST_INITGUID_H_
+
+//
+// The portable sources include initguid.h but define no GUIDs
+//
+
+#endif
@@ -0,0 +1,244 @@
+#ifndef _HOST_NTDDK_H_
+#define _HOST_NTDDK_H_
+
+//
+// Just enough of the kernel headers for the driver's portable sources
+// (report decoding, the gesture engine, the register model, and the SPB
+// routines and boot script it is driven through) to build as user-mode
+// code on a host. Include it after any C++ library header, since min
+// and max are macros here as they are in the WDK.
+//
+// The host tools are single threaded: interlocked operations are plain
+// atomics, and an event wait never has anyone to wait for. Time is the
+// register model's virtual clock, see sim.cpp, but for the real time
+// ReadTimeStampCounter returns.
+//
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// stdlib.h already has abs(), keep the driver's stdint.h from adding one
+#define ABS32
+
+#define IN
+#define OUT
+#define OPTIONAL
+#define _In_
+#define _Out_
+#define _In_reads_(Count)
+#define _In_reads_bytes_(Length)
+
+#define VOID                void
+typedef void                *PVOID;
+typedef char                CHAR, *PCHAR;
+typedef uint16_t            WCHAR, *PWCHAR;
+typedef unsigned char       UCHAR, *PUCHAR;
+typedef unsigned char       BYTE;
+typedef unsigned char       BOOLEAN;
+typedef int16_t             SHORT;
+typedef uint16_t            USHORT, UINT16;
+typedef int32_t             LONG;
+typedef uint32_t            ULONG, *PULONG;
+typedef int64_t             LONGLONG, LONG64;
+typedef uint64_t            ULONGLONG;
+typedef uintptr_t           ULONG_PTR;
+typedef size_t              SIZE_T;
+
+typedef union _LARGE_INTEGER
+{
+	struct
+	{
+		ULONG LowPart;
+		LONG HighPart;
+	} u;
+	LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+#define TRUE                1
+#define FALSE               0
+
+#define MAXUCHAR            0xff
+#define MAXULONG            0xffffffffUL
+
+typedef LONG NTSTATUS;
+
+#define NT_SUCCESS(Status)  (((NTSTATUS)(Status)) >= 0)
+
+#define STATUS_SUCCESS              ((NTSTATUS)0x00000000L)
+#define STATUS_UNSUCCESSFUL         ((NTSTATUS)0xC0000001L)
+#define STATUS_INVALID_PARAMETER    ((NTSTATUS)0xC000000DL)
+#define STATUS_BUFFER_TOO_SMALL     ((NTSTATUS)0xC0000023L)
+#define STATUS_IO_TIMEOUT           ((NTSTATUS)0xC00000B5L)
+#define STATUS_NOT_SUPPORTED        ((NTSTATUS)0xC00000BBL)
+#define STATUS_NOT_IMPLEMENTED      ((NTSTATUS)0xC0000002L)
+#define STATUS_INVALID_DEVICE_REQUEST ((NTSTATUS)0xC0000010L)
+#define STATUS_DEVICE_BUSY          ((NTSTATUS)0x80000011L)
+#define STATUS_NO_SUCH_DEVICE       ((NTSTATUS)0xC000000EL)
+#define STATUS_CANCELLED            ((NTSTATUS)0xC0000120L)
+#define STATUS_DEVICE_PROTOCOL_ERROR ((NTSTATUS)0xC0000186L)
+
+#define CTL_CODE(DeviceType, Function, Method, Access) \
+	(((DeviceType) << 16) | ((Access) << 14) | ((Function) << 2) | (Method))
+#define METHOD_OUT_DIRECT   2
+#define FILE_ANY_ACCESS     0
+
+#ifndef min
+#define min(a, b)           (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b)           (((a) > (b)) ? (a) : (b))
+#endif
+
+#define RtlZeroMemory(Destination, Length)          memset((Destination), 0, (Length))
+#define RtlFillMemory(Destination, Length, Fill)    memset((Destination), (Fill), (Length))
+#define RtlCopyMemory(Destination, Source, Length)  memcpy((Destination), (Source), (Length))
+#define RtlEqualMemory(Destination, Source, Length) (!memcmp((Destination), (Source), (Length)))
+
+#define RTL_NUMBER_OF(A)            (sizeof(A) / sizeof((A)[0]))
+#define FIELD_OFFSET(type, field)   ((LONG)offsetof(type, field))
+#define C_ASSERT(e)                 static_assert(e, #e)
+#define UNREFERENCED_PARAMETER(P)   ((void)(P))
+
+typedef struct _UNICODE_STRING
+{
+	USHORT Length;
+	USHORT MaximumLength;
+	PWCHAR Buffer;
+} UNICODE_STRING;
+
+static inline VOID RtlInitEmptyUnicodeString(UNICODE_STRING *String, PWCHAR Buffer, USHORT Size) {
+	String->Length = 0;
+	String->MaximumLength = Size;
+	String->Buffer = Buffer;
+}
+
+#define GENERIC_READ            0x80000000UL
+#define GENERIC_WRITE           0x40000000UL
+#define FILE_OPEN               0x00000001UL
+#define FILE_ATTRIBUTE_NORMAL   0x00000080UL
+
+typedef enum _POOL_TYPE { NonPagedPool } POOL_TYPE;
+
+//
+// Interlocked operations return the new value, except Exchange,
+// CompareExchange and Or, which return the old one
+//
+
+static inline LONG InterlockedIncrement(volatile LONG *Target) {
+	return __atomic_add_fetch(Target, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedDecrement(volatile LONG *Target) {
+	return __atomic_sub_fetch(Target, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedExchange(volatile LONG *Target, LONG Value) {
+	return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedCompareExchange(volatile LONG *Target, LONG Exchange, LONG Comparand) {
+	__atomic_compare_exchange_n(Target, &Comparand, Exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return Comparand;
+}
+
+static inline LONG InterlockedOr(volatile LONG *Target, LONG Value) {
+	return __atomic_fetch_or(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG64 InterlockedIncrement64(volatile LONG64 *Target) {
+	return __atomic_add_fetch(Target, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG64 InterlockedAdd64(volatile LONG64 *Target, LONG64 Value) {
+	return __atomic_add_fetch(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG64 InterlockedExchange64(volatile LONG64 *Target, LONG64 Value) {
+	return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+#define KeMemoryBarrier()   __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+static inline BOOLEAN BitScanForward(ULONG *Index, ULONG Mask) {
+	if (Mask == 0)
+		return FALSE;
+	*Index = (ULONG)__builtin_ctz(Mask);
+	return TRUE;
+}
+
+//
+// Events only record whether they are signalled
+//
+
+typedef enum _EVENT_TYPE { NotificationEvent, SynchronizationEvent } EVENT_TYPE;
+typedef enum _KWAIT_REASON { Executive } KWAIT_REASON;
+typedef enum _KPROCESSOR_MODE { KernelMode } KPROCESSOR_MODE;
+
+#define IO_NO_INCREMENT     0
+
+typedef struct _KEVENT
+{
+	EVENT_TYPE Type;
+	LONG Signalled;
+} KEVENT;
+
+static inline VOID KeInitializeEvent(KEVENT *Event, EVENT_TYPE Type, BOOLEAN State) {
+	Event->Type = Type;
+	Event->Signalled = State;
+}
+
+static inline LONG KeSetEvent(KEVENT *Event, LONG Increment, BOOLEAN Wait) {
+	UNREFERENCED_PARAMETER(Increment);
+	UNREFERENCED_PARAMETER(Wait);
+	return InterlockedExchange(&Event->Signalled, 1);
+}
+
+static inline VOID KeClearEvent(KEVENT *Event) {
+	InterlockedExchange(&Event->Signalled, 0);
+}
+
+static inline NTSTATUS KeWaitForSingleObject(PVOID Object, KWAIT_REASON Reason,
+	KPROCESSOR_MODE Mode, BOOLEAN Alertable, LARGE_INTEGER *Timeout) {
+	KEVENT *event = (KEVENT *)Object;
+
+	UNREFERENCED_PARAMETER(Reason);
+	UNREFERENCED_PARAMETER(Mode);
+	UNREFERENCED_PARAMETER(Alertable);
+	UNREFERENCED_PARAMETER(Timeout);
+
+	if (event->Type == SynchronizationEvent)
+		InterlockedExchange(&event->Signalled, 0);
+	return STATUS_SUCCESS;
+}
+
+//
+// Both run on the register model's virtual clock: the performance
+// counter ticks in 100ns units, and a stall moves the clock on
+//
+
+LARGE_INTEGER KeQueryPerformanceCounter(LARGE_INTEGER *Frequency);
+VOID KeStallExecutionProcessor(ULONG Microseconds);
+
+//
+// Real time, for the microbenchmarks: the time stamp counter where
+// there is one, as in the driver, and nanoseconds elsewhere
+//
+
+static inline ULONGLONG ReadTimeStampCounter(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef _HOST_RESHUB_H_
+#define _HOST_RESHUB_H_
+
+//
+// The host has no resource hub; spb.cpp only builds a path from it for
+// the I/O target, which the host never opens
+//
+
+#include <ntddk.h>
+
+#define RESOURCE_HUB_PATH_SIZE  64
+
+#define RESOURCE_HUB_CREATE_PATH_FROM_ID(String, LowPart, HighPart) \
+	(UNREFERENCED_PARAMETER(String), STATUS_NOT_SUPPORTED)
+
+#endif
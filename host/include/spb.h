@@ -0,0 +1,87 @@
+#ifndef _HOST_SPB_H_
+#define _HOST_SPB_H_
+
+//
+// The transfer lists of IOCTL_SPB_EXECUTE_SEQUENCE, laid out as in the
+// WDK's spb.h. On the host spb.cpp formats them but never sends them.
+//
+
+#include <ntddk.h>
+
+#define IOCTL_SPB_EXECUTE_SEQUENCE  CTL_CODE(0x0000006d, 0x0101, 0, FILE_ANY_ACCESS)
+
+typedef enum _SPB_TRANSFER_DIRECTION
+{
+	SpbTransferDirectionNone,
+	SpbTransferDirectionFromDevice,
+	SpbTransferDirectionToDevice,
+	SpbTransferDirectionMax
+} SPB_TRANSFER_DIRECTION;
+
+typedef enum _SPB_TRANSFER_BUFFER_FORMAT
+{
+	SpbTransferBufferFormatInvalid,
+	SpbTransferBufferFormatSimple,
+	SpbTransferBufferFormatList,
+	SpbTransferBufferFormatSimpleNonPaged,
+	SpbTransferBufferFormatMdl,
+	SpbTransferBufferFormatMax
+} SPB_TRANSFER_BUFFER_FORMAT;
+
+typedef struct _SPB_TRANSFER_BUFFER
+{
+	SPB_TRANSFER_BUFFER_FORMAT Format;
+
+	struct
+	{
+		PVOID Buffer;
+		ULONG BufferCb;
+	} Simple;
+} SPB_TRANSFER_BUFFER;
+
+typedef struct _SPB_TRANSFER_LIST_ENTRY
+{
+	SPB_TRANSFER_DIRECTION Direction;
+	ULONG DelayInUs;
+	SPB_TRANSFER_BUFFER Buffer;
+} SPB_TRANSFER_LIST_ENTRY;
+
+typedef struct _SPB_TRANSFER_LIST
+{
+	ULONG Size;
+	ULONG Reserved;
+	ULONG TransferCount;
+	SPB_TRANSFER_LIST_ENTRY Transfers[1];
+} SPB_TRANSFER_LIST;
+
+//
+// The other entries follow the list's first, and are reached by indexing
+// past Transfers[0] as with the WDK
+//
+
+#define SPB_TRANSFER_LIST_AND_ENTRIES(Count) \
+	struct \
+	{ \
+		SPB_TRANSFER_LIST List; \
+		SPB_TRANSFER_LIST_ENTRY ExtraTransfers[(Count) - 1]; \
+	}
+
+static inline VOID SPB_TRANSFER_LIST_INIT(SPB_TRANSFER_LIST *List, ULONG Count) {
+	List->Size = sizeof(SPB_TRANSFER_LIST);
+	List->Reserved = 0;
+	List->TransferCount = Count;
+}
+
+static inline SPB_TRANSFER_LIST_ENTRY SPB_TRANSFER_LIST_ENTRY_INIT_SIMPLE(
+	SPB_TRANSFER_DIRECTION Direction, ULONG DelayInUs, PVOID Buffer, ULONG BufferCb) {
+	SPB_TRANSFER_LIST_ENTRY entry;
+
+	entry.Direction = Direction;
+	entry.DelayInUs = DelayInUs;
+	entry.Buffer.Format = SpbTransferBufferFormatSimple;
+	entry.Buffer.Simple.Buffer = Buffer;
+	entry.Buffer.Simple.BufferCb = BufferCb;
+	return entry;
+}
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef _HOST_WDF_H_
+#define _HOST_WDF_H_
+
+//
+// Just enough of WDF for spb.cpp. The host never opens an I/O target:
+// the SPB routines are driven through a transport, the register model,
+// so only memory objects are created, and the I/O target and request
+// calls fail with STATUS_NOT_SUPPORTED. acquire.h only carries a work
+// item handle; the other portable sources use nothing from here.
+//
+
+#include <ntddk.h>
+
+typedef PVOID WDFOBJECT;
+typedef PVOID WDFCONTEXT;
+typedef struct WDFDEVICE__ *WDFDEVICE;
+typedef struct WDFMEMORY__ *WDFMEMORY;
+typedef struct WDFIOTARGET__ *WDFIOTARGET;
+typedef struct WDFREQUEST__ *WDFREQUEST;
+typedef struct WDFSPINLOCK__ *WDFSPINLOCK;
+typedef struct WDFWORKITEM__ *WDFWORKITEM;
+
+typedef struct _WDF_OBJECT_ATTRIBUTES
+{
+	WDFOBJECT ParentObject;
+} WDF_OBJECT_ATTRIBUTES;
+
+#define WDF_NO_OBJECT_ATTRIBUTES    NULL
+#define WDF_NO_SEND_OPTIONS         NULL
+
+static inline VOID WDF_OBJECT_ATTRIBUTES_INIT(WDF_OBJECT_ATTRIBUTES *Attributes) {
+	Attributes->ParentObject = NULL;
+}
+
+//
+// Memory objects
+//
+
+struct WDFMEMORY__
+{
+	PVOID Buffer;
+	size_t Size;
+};
+
+static inline NTSTATUS WdfMemoryCreate(WDF_OBJECT_ATTRIBUTES *Attributes, POOL_TYPE PoolType,
+	ULONG PoolTag, size_t BufferSize, WDFMEMORY *Memory, PVOID *Buffer) {
+	UNREFERENCED_PARAMETER(Attributes);
+	UNREFERENCED_PARAMETER(PoolType);
+	UNREFERENCED_PARAMETER(PoolTag);
+
+	*Memory = (WDFMEMORY)malloc(sizeof(struct WDFMEMORY__));
+	if (*Memory == NULL)
+		return STATUS_UNSUCCESSFUL;
+
+	(*Memory)->Buffer = calloc(1, BufferSize);
+	(*Memory)->Size = BufferSize;
+	if ((*Memory)->Buffer == NULL) {
+		free(*Memory);
+		*Memory = NULL;
+		return STATUS_UNSUCCESSFUL;
+	}
+
+	if (Buffer != NULL)
+		*Buffer = (*Memory)->Buffer;
+	return STATUS_SUCCESS;
+}
+
+static inline PVOID WdfMemoryGetBuffer(WDFMEMORY Memory, size_t *BufferSize) {
+	if (BufferSize != NULL)
+		*BufferSize = Memory->Size;
+	return Memory->Buffer;
+}
+
+// Only memory objects exist on the host
+static inline VOID WdfObjectDelete(WDFOBJECT Object) {
+	WDFMEMORY memory = (WDFMEMORY)Object;
+
+	if (memory == NULL)
+		return;
+	free(memory->Buffer);
+	free(memory);
+}
+
+typedef struct _WDFMEMORY_OFFSET
+{
+	size_t BufferOffset;
+	size_t BufferLength;
+} WDFMEMORY_OFFSET;
+
+typedef struct _WDF_MEMORY_DESCRIPTOR
+{
+	PVOID Buffer;
+	ULONG Length;
+	WDFMEMORY Memory;
+	WDFMEMORY_OFFSET *Offsets;
+} WDF_MEMORY_DESCRIPTOR, *PWDF_MEMORY_DESCRIPTOR;
+
+static inline VOID WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(WDF_MEMORY_DESCRIPTOR *Descriptor,
+	PVOID Buffer, ULONG Length) {
+	Descriptor->Buffer = Buffer;
+	Descriptor->Length = Length;
+	Descriptor->Memory = NULL;
+	Descriptor->Offsets = NULL;
+}
+
+static inline VOID WDF_MEMORY_DESCRIPTOR_INIT_HANDLE(WDF_MEMORY_DESCRIPTOR *Descriptor,
+	WDFMEMORY Memory, WDFMEMORY_OFFSET *Offsets) {
+	Descriptor->Buffer = NULL;
+	Descriptor->Length = 0;
+	Descriptor->Memory = Memory;
+	Descriptor->Offsets = Offsets;
+}
+
+//
+// Spin locks are never created: the asynchronous queue needs the I/O
+// target
+//
+
+static inline NTSTATUS WdfSpinLockCreate(WDF_OBJECT_ATTRIBUTES *Attributes, WDFSPINLOCK *SpinLock) {
+	UNREFERENCED_PARAMETER(Attributes);
+	*SpinLock = NULL;
+	return STATUS_NOT_SUPPORTED;
+}
+
+static inline VOID WdfSpinLockAcquire(WDFSPINLOCK SpinLock) {
+	UNREFERENCED_PARAMETER(SpinLock);
+}
+
+static inline VOID WdfSpinLockRelease(WDFSPINLOCK SpinLock) {
+	UNREFERENCED_PARAMETER(SpinLock);
+}
+
+//
+// I/O targets and requests
+//
+
+typedef struct _WDF_IO_TARGET_OPEN_PARAMS
+{
+	UNICODE_STRING *TargetDeviceName;
+	ULONG DesiredAccess;
+	ULONG ShareAccess;
+	ULONG CreateDisposition;
+	ULONG FileAttributes;
+} WDF_IO_TARGET_OPEN_PARAMS;
+
+static inline VOID WDF_IO_TARGET_OPEN_PARAMS_INIT_OPEN_BY_NAME(WDF_IO_TARGET_OPEN_PARAMS *Params,
+	UNICODE_STRING *TargetDeviceName, ULONG DesiredAccess) {
+	memset(Params, 0, sizeof(*Params));
+	Params->TargetDeviceName = TargetDeviceName;
+	Params->DesiredAccess = DesiredAccess;
+}
+
+typedef struct _IO_STATUS_BLOCK
+{
+	NTSTATUS Status;
+	ULONG_PTR Information;
+} IO_STATUS_BLOCK;
+
+typedef struct _WDF_REQUEST_COMPLETION_PARAMS
+{
+	IO_STATUS_BLOCK IoStatus;
+} WDF_REQUEST_COMPLETION_PARAMS, *PWDF_REQUEST_COMPLETION_PARAMS;
+
+typedef VOID EVT_WDF_REQUEST_COMPLETION_ROUTINE(WDFREQUEST Request, WDFIOTARGET Target,
+	PWDF_REQUEST_COMPLETION_PARAMS Params, WDFCONTEXT Context);
+typedef EVT_WDF_REQUEST_COMPLETION_ROUTINE *PFN_WDF_REQUEST_COMPLETION_ROUTINE;
+
+#define WDF_REQUEST_REUSE_NO_FLAGS  0
+
+typedef struct _WDF_REQUEST_REUSE_PARAMS
+{
+	ULONG Flags;
+	NTSTATUS Status;
+} WDF_REQUEST_REUSE_PARAMS;
+
+static inline VOID WDF_REQUEST_REUSE_PARAMS_INIT(WDF_REQUEST_REUSE_PARAMS *Params,
+	ULONG Flags, NTSTATUS Status) {
+	Params->Flags = Flags;
+	Params->Status = Status;
+}
+
+static inline NTSTATUS WdfIoTargetCreate(WDFDEVICE Device, WDF_OBJECT_ATTRIBUTES *Attributes,
+	WDFIOTARGET *IoTarget) {
+	UNREFERENCED_PARAMETER(Device);
+	UNREFERENCED_PARAMETER(Attributes);
+	*IoTarget = NULL;
+	return STATUS_NOT_SUPPORTED;
+}
+
+static inline NTSTATUS WdfIoTargetOpen(WDFIOTARGET IoTarget, WDF_IO_TARGET_OPEN_PARAMS *Params) {
+	UNREFERENCED_PARAMETER(IoTarget);
+	UNREFERENCED_PARAMETER(Params);
+	return STATUS_NOT_SUPPORTED;
+}
+
+static inline NTSTATUS WdfIoTargetSendWriteSynchronously(WDFIOTARGET IoTarget, WDFREQUEST Request,
+	WDF_MEMORY_DESCRIPTOR *InputBuffer, LONGLONG *DeviceOffset, PVOID RequestOptions,
+	ULONG_PTR *BytesWritten) {
+	return STATUS_NOT_SUPPORTED;
+}
+
+static inline NTSTATUS WdfIoTargetSendReadSynchronously(WDFIOTARGET IoTarget, WDFREQUEST Request,
+	WDF_MEMORY_DESCRIPTOR *OutputBuffer, LONGLONG *DeviceOffset, PVOID RequestOptions,
+	ULONG_PTR *BytesRead) {
+	return STATUS_NOT_SUPPORTED;
+}
+
+static inline NTSTATUS WdfIoTargetSendIoctlSynchronously(WDFIOTARGET IoTarget, WDFREQUEST Request,
+	ULONG IoctlCode, WDF_MEMORY_DESCRIPTOR *InputBuffer, WDF_MEMORY_DESCRIPTOR *OutputBuffer,
+	PVOID RequestOptions, ULONG_PTR *BytesReturned) {
+	return STATUS_NOT_SUPPORTED;
+}
+
+static inline NTSTATUS WdfIoTargetFormatRequestForWrite(WDFIOTARGET IoTarget, WDFREQUEST Request,
+	WDFMEMORY InputBuffer, WDFMEMORY_OFFSET *InputBufferOffset, LONGLONG *DeviceOffset) {
+	return STATUS_NOT_SUPPORTED;
+}
+
+static inline NTSTATUS WdfIoTargetFormatRequestForRead(WDFIOTARGET IoTarget, WDFREQUEST Request,
+	WDFMEMORY OutputBuffer, WDFMEMORY_OFFSET *OutputBufferOffset, LONGLONG *DeviceOffset) {
+	return STATUS_NOT_SUPPORTED;
+}
+
+static inline NTSTATUS WdfIoTargetFormatRequestForIoctl(WDFIOTARGET IoTarget, WDFREQUEST Request,
+	ULONG IoctlCode, WDFMEMORY InputBuffer, WDFMEMORY_OFFSET *InputBufferOffset,
+	WDFMEMORY OutputBuffer, WDFMEMORY_OFFSET *OutputBufferOffset) {
+	return STATUS_NOT_SUPPORTED;
+}
+
+static inline NTSTATUS WdfRequestCreate(WDF_OBJECT_ATTRIBUTES *Attributes, WDFIOTARGET IoTarget,
+	WDFREQUEST *Request) {
+	*Request = NULL;
+	return STATUS_NOT_SUPPORTED;
+}
+
+static inline NTSTATUS WdfRequestReuse(WDFREQUEST Request, WDF_REQUEST_REUSE_PARAMS *Params) {
+	return STATUS_NOT_SUPPORTED;
+}
+
+static inline VOID WdfRequestSetCompletionRoutine(WDFREQUEST Request,
+	PFN_WDF_REQUEST_COMPLETION_ROUTINE CompletionRoutine, WDFCONTEXT Context) {
+}
+
+static inline BOOLEAN WdfRequestSend(WDFREQUEST Request, WDFIOTARGET IoTarget, PVOID Options) {
+	return FALSE;
+}
+
+static inline NTSTATUS WdfRequestGetStatus(WDFREQUEST Request) {
+	return STATUS_NOT_SUPPORTED;
+}
+
+static inline BOOLEAN WdfRequestCancelSentRequest(WDFREQUEST Request) {
+	return FALSE;
+}
+
+#endif
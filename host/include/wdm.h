@@ -0,0 +1,10 @@
+#ifndef _HOST_WDM_H_
+#define _HOST_WDM_H_
+
+//
+// Everything the portable sources use from wdm.h is in ntddk.h
+//
+
+#include <ntddk.h>
+
+#endif
@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <unistd.h>
+#include "host.h"
+
+//
+// Microbenchmarks of the gesture engine's primitives. Each primitive is
+// run over a realistic and an adversarial input set, and costs are in
+// ReadTimeStampCounter() cycles per call, including the call into the
+// primitive.
+//
+
+enum bench_primitive {
+	BENCH_DISTANCESQ = 0,
+	BENCH_SCROLL_VALUE,
+	BENCH_HISTORY_SHIFT,
+	BENCH_BLACKLIST,
+	BENCH_DECODE,
+	BENCH_PRIMITIVES
+};
+
+enum bench_input {
+	BENCH_REALISTIC = 0,
+	BENCH_ADVERSARIAL,
+	BENCH_INPUT_SETS
+};
+
+static const char *BenchNames[BENCH_PRIMITIVES] = {
+	"distancesq",
+	"CalcScrollValue",
+	"ShiftHistory",
+	"BlacklistTrailingFingers",
+	"ElanDecodeReport"
+};
+
+typedef struct _BENCH_RESULT
+{
+	ULONGLONG Calls;
+	ULONGLONG Cycles;
+} BENCH_RESULT;
+
+#define BENCH_INPUTS		256
+#define BENCH_FRAMES		64
+#define BENCH_FINGERS		5
+
+// Passes over each input set, -p
+static int BenchPasses = 16;
+
+//
+// Inputs are generated into these tables before the timed loops, so only
+// the primitive is measured.
+//
+
+static int BenchA[BENCH_INPUTS];
+static int BenchB[BENCH_INPUTS];
+static uint8_t BenchFrames[BENCH_FRAMES][ETP_MAX_REPORT_LEN];
+static csgesture_softc BenchSoftc;
+
+//
+// Results are folded into BenchSink so the calls can't be optimized out
+//
+
+static volatile int BenchSink;
+
+static
+int
+BenchRandom(
+	IN OUT ULONG *Seed
+	)
+{
+	*Seed = *Seed * 1103515245 + 12345;
+	return (*Seed >> 16) & 0x7fff;
+}
+
+static
+VOID
+BenchFinish(
+	OUT BENCH_RESULT *Result,
+	IN ULONGLONG Calls,
+	IN ULONGLONG Start,
+	IN int Sink
+	)
+{
+	Result->Calls = Calls;
+	Result->Cycles = ReadTimeStampCounter() - Start;
+	BenchSink = Sink;
+}
+
+static
+VOID
+BenchDistancesq(
+	IN int Input,
+	OUT BENCH_RESULT *Result
+	)
+{
+	ULONG seed = 1;
+	ULONGLONG start;
+	int sink = 0;
+
+	for (int n = 0; n < BENCH_INPUTS; n++) {
+		if (Input == BENCH_REALISTIC) {
+			// Motion totals of a finger over the 10 frame history
+			BenchA[n] = BenchRandom(&seed) % 200;
+			BenchB[n] = BenchRandom(&seed) % 200;
+		}
+		else {
+			// Signed totals up to the largest that can't overflow
+			BenchA[n] = BenchRandom(&seed) * ((n & 1) ? -1 : 1);
+			BenchB[n] = BenchRandom(&seed) * ((n & 2) ? -1 : 1);
+		}
+	}
+
+	start = ReadTimeStampCounter();
+	for (int pass = 0; pass < BenchPasses; pass++)
+		for (int n = 0; n < BENCH_INPUTS; n++)
+			sink += distancesq(BenchA[n], BenchB[n]);
+	BenchFinish(Result, (ULONGLONG)BenchPasses * BENCH_INPUTS, start, sink);
+}
+
+static
+VOID
+BenchScrollValue(
+	IN int Input,
+	OUT BENCH_RESULT *Result
+	)
+{
+	ULONG seed = 2;
+	ULONGLONG start;
+	int sink = 0;
+
+	for (int n = 0; n < BENCH_INPUTS; n++) {
+		if (Input == BENCH_REALISTIC) {
+			// Two finger scroll deltas over a 50-100ms history window
+			BenchA[n] = BenchRandom(&seed) % 31 - 15;
+			BenchB[n] = 50 + BenchRandom(&seed) % 51;
+		}
+		else {
+			// Straddles every threshold, with unpredictable branches
+			BenchA[n] = BenchRandom(&seed) % 251 - 125;
+			BenchB[n] = BenchRandom(&seed) % 21;
+		}
+	}
+
+	start = ReadTimeStampCounter();
+	for (int pass = 0; pass < BenchPasses; pass++)
+		for (int n = 0; n < BENCH_INPUTS; n++)
+			sink += CalcScrollValue(BenchA[n], BenchB[n]);
+	BenchFinish(Result, (ULONGLONG)BenchPasses * BENCH_INPUTS, start, sink);
+}
+
+static
+VOID
+BenchHistoryShift(
+	IN int Input,
+	OUT BENCH_RESULT *Result
+	)
+{
+	csgesture_softc *sc = &BenchSoftc;
+	ULONG seed = 3;
+	ULONGLONG start;
+
+	RtlZeroMemory(sc, sizeof(*sc));
+	sc->frameintervalms = GESTURE_TICK_MS;
+
+	for (int n = 0; n < BENCH_INPUTS; n++) {
+		if (Input == BENCH_REALISTIC) {
+			// A finger moving a few units per frame
+			BenchA[n] = BenchRandom(&seed) % 8;
+			BenchB[n] = BenchRandom(&seed) % 8;
+		}
+		else {
+			// Contacts jumping across the pad every frame
+			BenchA[n] = BenchRandom(&seed) % 0x1000;
+			BenchB[n] = BenchRandom(&seed) % 0x1000;
+		}
+	}
+
+	start = ReadTimeStampCounter();
+	for (int pass = 0; pass < BenchPasses; pass++) {
+		for (int n = 0; n < BENCH_INPUTS; n++) {
+			int i = n % BENCH_FINGERS;
+			sc->x[i] = BenchA[n];
+			sc->y[i] = BenchB[n];
+			ShiftHistory(sc, i);
+		}
+	}
+	BenchFinish(Result, (ULONGLONG)BenchPasses * BENCH_INPUTS, start, sc->flextotalx[0]);
+}
+
+static
+VOID
+BenchBlacklist(
+	IN int Input,
+	OUT BENCH_RESULT *Result
+	)
+{
+	csgesture_softc *sc = &BenchSoftc;
+	ULONG seed = 4;
+	ULONGLONG start;
+
+	RtlZeroMemory(sc, sizeof(*sc));
+
+	for (int j = 0; j < BENCH_FINGERS; j++) {
+		if (Input == BENCH_REALISTIC && j != 0) {
+			sc->x[j] = -1;
+			sc->y[j] = -1;
+		}
+		else {
+			sc->x[j] = BenchRandom(&seed) % 0x1000;
+			sc->y[j] = BenchRandom(&seed) % 0x1000;
+		}
+		sc->downms[j] = 200;
+	}
+
+	for (int n = 0; n < BENCH_INPUTS; n++) {
+		if (Input == BENCH_REALISTIC) {
+			// One finger panning
+			BenchA[n] = 0;
+		}
+		else {
+			// Five fingers down and a random one panning, so every
+			// comparison runs and the y test is unpredictable. The
+			// equal contact age keeps any finger from being blacklisted.
+			BenchA[n] = BenchRandom(&seed) % BENCH_FINGERS;
+		}
+	}
+
+	start = ReadTimeStampCounter();
+	for (int pass = 0; pass < BenchPasses; pass++)
+		for (int n = 0; n < BENCH_INPUTS; n++)
+			BlacklistTrailingFingers(sc, BenchA[n]);
+	BenchFinish(Result, (ULONGLONG)BenchPasses * BENCH_INPUTS, start, sc->blacklistedids[0]);
+}
+
+static
+VOID
+BenchDecode(
+	IN int Input,
+	OUT BENCH_RESULT *Result
+	)
+{
+	csgesture_softc *sc = &BenchSoftc;
+	ELAN_SIM_DEVICE sim;
+	ULONG seed = 5;
+	ULONGLONG start;
+	int sink = 0;
+
+	ElanSimInitialize(&sim);
+
+	RtlZeroMemory(sc, sizeof(*sc));
+	sc->resx = sim.MaxX;
+	sc->resy = sim.MaxY;
+
+	for (int n = 0; n < BENCH_FRAMES; n++) {
+		if (Input == BENCH_REALISTIC) {
+			// Frames sampled across every simulator finger script
+			const ELAN_SIM_SCRIPT *script =
+				&ElanSimScripts[1 + n % (ELAN_SIM_SCRIPT_COUNT - 1)];
+			ULONG timeUs = (ULONG)((ULONGLONG)script->DurationUs * n / BENCH_FRAMES);
+
+			ElanSimBuildReport(script, timeUs, &seed, BenchFrames[n]);
+		}
+		else {
+			// Noise with a valid report ID and all five contacts set
+			for (int b = 0; b < ETP_MAX_REPORT_LEN; b++)
+				BenchFrames[n][b] = (uint8_t)BenchRandom(&seed);
+			BenchFrames[n][0] = ETP_I2C_REPORT_LEN;
+			BenchFrames[n][ETP_REPORT_ID_OFFSET] = ETP_REPORT_ID;
+			BenchFrames[n][ETP_TOUCH_INFO_OFFSET] |= 0xf8;
+		}
+	}
+
+	start = ReadTimeStampCounter();
+	for (int pass = 0; pass < BenchPasses * (BENCH_INPUTS / BENCH_FRAMES); pass++)
+		for (int n = 0; n < BENCH_FRAMES; n++)
+			sink += ElanDecodeReport(sc, BenchFrames[n]);
+	BenchFinish(Result, (ULONGLONG)BenchPasses * BENCH_INPUTS, start, sink + sc->x[0]);
+}
+
+static void BenchUsage(void) {
+	fprintf(stderr,
+		"usage: elan-micro-bench [-p passes]\n"
+		"  -p  passes over each input set of %d calls (default 16)\n",
+		BENCH_INPUTS);
+}
+
+int main(int argc, char **argv) {
+	static void (*const benches[BENCH_PRIMITIVES])(int, BENCH_RESULT *) = {
+		BenchDistancesq,
+		BenchScrollValue,
+		BenchHistoryShift,
+		BenchBlacklist,
+		BenchDecode
+	};
+	BENCH_RESULT results[BENCH_PRIMITIVES][BENCH_INPUT_SETS];
+	int option;
+
+	while ((option = getopt(argc, argv, "p:h")) != -1) {
+		switch (option) {
+		case 'p':
+			BenchPasses = atoi(optarg);
+			break;
+		default:
+			BenchUsage();
+			return 2;
+		}
+	}
+	if (BenchPasses < 1) {
+		BenchUsage();
+		return 2;
+	}
+
+	for (int input = 0; input < BENCH_INPUT_SETS; input++)
+		for (int bench = 0; bench < BENCH_PRIMITIVES; bench++)
+			benches[bench](input, &results[bench][input]);
+
+	printf("%-26s %12s %12s  cycles per call\n", "", "realistic", "adversarial");
+	for (int bench = 0; bench < BENCH_PRIMITIVES; bench++) {
+		printf("%-26s", BenchNames[bench]);
+		for (int input = 0; input < BENCH_INPUT_SETS; input++)
+			printf(" %12.1f", (double)results[bench][input].Cycles / results[bench][input].Calls);
+		printf("\n");
+	}
+
+	return 0;
+}
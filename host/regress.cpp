@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <unistd.h>
+#include "host.h"
+
+//
+// Replays captures through the engine and checks each frame's HID
+// output, as the digest and count of the reports sent, against the
+// output stored with it. A capture fails on any mismatch, or when its
+// 99th percentile frame takes longer than the budget; the default is
+// the driver's FrameBudgetUs default. Captures read from a trackpad
+// with IOCTL_ELAN_READ_CAPTURE can be checked in as they are.
+//
+// -u rewrites the stored output after an intended change in behaviour,
+// and -s records one of the simulator scripts as a new capture.
+//
+
+#define REGRESS_BUDGET_US       1000
+#define REGRESS_SIM_LOOPS       2
+#define REGRESS_MISMATCHES_SHOWN 5
+
+static csgesture_softc RegressSoftc;
+
+static int RegressCompareTimes(const void *a, const void *b) {
+	ULONGLONG left = *(const ULONGLONG *)a;
+	ULONGLONG right = *(const ULONGLONG *)b;
+
+	return left < right ? -1 : left > right;
+}
+
+static bool RegressReplay(const char *path, HOST_SEQUENCE *sequence, ULONGLONG budgetNs, bool update) {
+	csgesture_softc *sc = &RegressSoftc;
+	ULONGLONG mismatches = 0;
+	ULONGLONG shown = 0;
+	ULONGLONG overBudget = 0;
+	ULONGLONG total = 0;
+
+	ULONGLONG *times = (ULONGLONG *)calloc(sequence->Count ? sequence->Count : 1, sizeof(ULONGLONG));
+	if (times == NULL)
+		return false;
+
+	//
+	// The verdict is ElanReplayCapture's, over the capture where it lies.
+	// The timed pass replays it again a frame at a time, to time each
+	// frame and show where the output went wrong.
+	//
+	if (!update) {
+		HostResetEngine(sc, HOST_DEFAULT_RESX, HOST_DEFAULT_RESY);
+		ElanReplayCapture(NULL, sc, sequence->Capture, sequence->Length, &mismatches);
+	}
+
+	HostResetEngine(sc, HOST_DEFAULT_RESX, HOST_DEFAULT_RESY);
+
+	for (size_t i = 0; i < sequence->Count; i++) {
+		ELAN_CAPTURE_RECORD *frame = HostRecord(sequence, i);
+
+		ULONGLONG start = HostNanoseconds();
+		TrackpadRawInput(NULL, sc, frame->Report, frame->IntervalMs);
+		times[i] = HostNanoseconds() - start;
+
+		total += times[i];
+		if (times[i] > budgetNs)
+			overBudget++;
+
+		if (update) {
+			frame->OutputDigest = sc->reportdigest;
+			frame->OutputCount = (UCHAR)sc->reportcount;
+		}
+		else if (sc->reportdigest != frame->OutputDigest ||
+			sc->reportcount != frame->OutputCount) {
+			if (++shown <= REGRESS_MISMATCHES_SHOWN)
+				printf("%s: frame %zu sent %d reports, digest %08x, expected %d, %08x\n",
+					path, i, sc->reportcount, sc->reportdigest,
+					frame->OutputCount, frame->OutputDigest);
+		}
+	}
+
+	ULONGLONG p99 = 0;
+	ULONGLONG worst = 0;
+	if (sequence->Count != 0) {
+		qsort(times, sequence->Count, sizeof(ULONGLONG), RegressCompareTimes);
+		p99 = times[(sequence->Count - 1) * 99 / 100];
+		worst = times[sequence->Count - 1];
+	}
+	free(times);
+
+	bool passed = mismatches == 0 && p99 <= budgetNs;
+	printf("%s: %zu frames, %llu mismatched, %.1f ns mean, %llu ns p99, %llu ns max, %llu over budget - %s\n",
+		path, sequence->Count, (unsigned long long)mismatches,
+		sequence->Count ? (double)total / sequence->Count : 0.0,
+		(unsigned long long)p99, (unsigned long long)worst, (unsigned long long)overBudget,
+		update ? "updated" : (passed ? "ok" : "FAILED"));
+
+	if (update)
+		return HostSaveCapture(path, sequence);
+	return passed;
+}
+
+static int RegressRecord(const char *scriptName, const char *path) {
+	HOST_SEQUENCE sequence;
+	ULONG script;
+
+	for (script = ELAN_SIM_SCRIPT_NONE + 1; script < ELAN_SIM_SCRIPT_COUNT; script++) {
+		if (strcmp(scriptName, HostSimScriptNames[script]) == 0)
+			break;
+	}
+	if (script == ELAN_SIM_SCRIPT_COUNT) {
+		fprintf(stderr, "%s: no such simulator script\n", scriptName);
+		return 2;
+	}
+
+	if (!HostSimSequence(script, GESTURE_TICK_MS * 1000, REGRESS_SIM_LOOPS, &sequence))
+		return 1;
+
+	bool recorded = RegressReplay(path, &sequence, ~0ULL, true);
+	HostFreeSequence(&sequence);
+	return recorded ? 0 : 1;
+}
+
+static void RegressUsage(void) {
+	fprintf(stderr,
+		"usage: elan-regress [-b budget-us] [-u] capture...\n"
+		"       elan-regress -s script capture\n"
+		"  -b  99th percentile frame budget in microseconds (default %d)\n"
+		"  -u  store the engine's current output in the captures\n"
+		"  -s  record a simulator script as a capture\n",
+		REGRESS_BUDGET_US);
+}
+
+int main(int argc, char **argv) {
+	ULONGLONG budgetNs = REGRESS_BUDGET_US * 1000ULL;
+	const char *script = NULL;
+	bool update = false;
+	int option;
+
+	while ((option = getopt(argc, argv, "b:us:h")) != -1) {
+		switch (option) {
+		case 'b':
+			budgetNs = strtoull(optarg, NULL, 0) * 1000;
+			break;
+		case 'u':
+			update = true;
+			break;
+		case 's':
+			script = optarg;
+			break;
+		default:
+			RegressUsage();
+			return 2;
+		}
+	}
+	if (optind == argc || (script != NULL && argc - optind != 1)) {
+		RegressUsage();
+		return 2;
+	}
+
+	if (script != NULL)
+		return RegressRecord(script, argv[optind]);
+
+	int failed = 0;
+	for (int i = optind; i < argc; i++) {
+		HOST_SEQUENCE sequence;
+
+		if (!HostLoadSequence(argv[i], GESTURE_TICK_MS * 1000, &sequence)) {
+			failed = 1;
+			continue;
+		}
+		if (!sequence.Golden && !update) {
+			fprintf(stderr, "%s: raw reports carry no output to check against\n", argv[i]);
+			failed = 1;
+		}
+		else if (!RegressReplay(argv[i], &sequence, budgetNs, update)) {
+			failed = 1;
+		}
+		HostFreeSequence(&sequence);
+	}
+	return failed;
+}
@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include "host.h"
+
+//
+// Replays report sequences through the decoder and gesture engine and
+// reports what each frame costs. A throughput pass hands the whole
+// sequence to ElanReplayCapture untimed, so a capture file is replayed
+// from its mapping without copying a record; a stage pass runs the same
+// steps with a timestamp between each, less the cost of taking the
+// timestamp:
+//
+//   filter  - classification and the unchanged frame check
+//   decode  - ElanDecodeReport
+//   gesture - ProcessGesture
+//
+// Stage costs are averaged over every frame of the sequence, so they
+// add up to roughly the throughput pass's ns/frame.
+//
+// -P replays with pointer prediction leading by that many milliseconds.
+// A prediction pass then scores each contact's predicted position
+// against where the replay puts it once the horizon has passed, next to
+// the error of not predicting at all, in pad units.
+//
+
+// Predictions a contact can have waiting for their horizon
+#define REPLAY_PREDICTIONS      256
+
+enum replay_stage {
+	REPLAY_FILTER = 0,
+	REPLAY_DECODE,
+	REPLAY_GESTURE,
+	REPLAY_STAGES
+};
+
+static const char *ReplayStageNames[REPLAY_STAGES] = {
+	"filter",
+	"decode",
+	"gesture"
+};
+
+static csgesture_softc ReplaySoftc;
+
+static int ReplayPredictMs;
+
+static void ReplayResetEngine(csgesture_softc *sc) {
+	HostResetEngine(sc, HOST_DEFAULT_RESX, HOST_DEFAULT_RESY);
+	sc->predictms = ReplayPredictMs;
+}
+
+static ULONGLONG ReplayTimerCost(void) {
+	ULONGLONG best = ~0ULL;
+
+	for (int i = 0; i < 1000; i++) {
+		ULONGLONG start = HostNanoseconds();
+		ULONGLONG end = HostNanoseconds();
+		if (end - start < best)
+			best = end - start;
+	}
+	return best;
+}
+
+static ULONGLONG ReplayThroughput(const HOST_SEQUENCE *sequence, int passes) {
+	csgesture_softc *sc = &ReplaySoftc;
+	ULONGLONG total = 0;
+	ULONGLONG mismatches;
+
+	for (int pass = 0; pass < passes; pass++) {
+		ReplayResetEngine(sc);
+
+		ULONGLONG start = HostNanoseconds();
+		ElanReplayCapture(NULL, sc, sequence->Capture, sequence->Length, &mismatches);
+		total += HostNanoseconds() - start;
+	}
+	return total;
+}
+
+static ULONGLONG ReplayElapsed(ULONGLONG start, ULONGLONG end, ULONGLONG timerCost) {
+	return end - start > timerCost ? end - start - timerCost : 0;
+}
+
+static void ReplayStages(const HOST_SEQUENCE *sequence, int passes, ULONGLONG timerCost,
+	ULONGLONG stageNs[REPLAY_STAGES], ULONGLONG stageFrames[REPLAY_STAGES]) {
+	csgesture_softc *sc = &ReplaySoftc;
+
+	for (int pass = 0; pass < passes; pass++) {
+		ReplayResetEngine(sc);
+
+		for (size_t i = 0; i < sequence->Count; i++) {
+			ELAN_CAPTURE_RECORD *frame = HostRecord(sequence, i);
+
+			//
+			// TrackpadRawInput, one stage at a time
+			//
+			ULONGLONG t0 = HostNanoseconds();
+			bool skip = ElanClassifyReport(frame->Report) != ELAN_FRAME_VALID;
+			if (!skip) {
+				sc->frameintervalms = frame->IntervalMs;
+				skip = ElanSkipUnchangedFrame(sc, frame->Report);
+			}
+			ULONGLONG t1 = HostNanoseconds();
+			stageNs[REPLAY_FILTER] += ReplayElapsed(t0, t1, timerCost);
+			stageFrames[REPLAY_FILTER]++;
+			if (skip)
+				continue;
+
+			t0 = HostNanoseconds();
+			ElanDecodeReport(sc, frame->Report);
+			t1 = HostNanoseconds();
+			ProcessGesture(NULL, sc);
+			ULONGLONG t2 = HostNanoseconds();
+
+			stageNs[REPLAY_DECODE] += ReplayElapsed(t0, t1, timerCost);
+			stageNs[REPLAY_GESTURE] += ReplayElapsed(t1, t2, timerCost);
+			stageFrames[REPLAY_DECODE]++;
+			stageFrames[REPLAY_GESTURE]++;
+		}
+	}
+}
+
+typedef struct _REPLAY_PREDICTION
+{
+	// Replay time the prediction is due, in milliseconds
+	ULONGLONG DueMs;
+
+	int X, Y;
+	int OriginX, OriginY;
+} REPLAY_PREDICTION;
+
+typedef struct _REPLAY_ERRORS
+{
+	double *Predicted;
+	double *Unpredicted;
+	size_t Count;
+	size_t Capacity;
+} REPLAY_ERRORS;
+
+static REPLAY_PREDICTION ReplayPending[ETP_MAX_FINGERS][REPLAY_PREDICTIONS];
+
+static int ReplayCompareErrors(const void *a, const void *b) {
+	double left = *(const double *)a;
+	double right = *(const double *)b;
+
+	return left < right ? -1 : left > right;
+}
+
+static bool ReplayAddError(REPLAY_ERRORS *errors, double predicted, double unpredicted) {
+	if (errors->Count == errors->Capacity) {
+		size_t capacity = errors->Capacity ? errors->Capacity * 2 : 4096;
+		double *grownPredicted = (double *)realloc(errors->Predicted, capacity * sizeof(double));
+		if (grownPredicted == NULL)
+			return false;
+		errors->Predicted = grownPredicted;
+		double *grownUnpredicted = (double *)realloc(errors->Unpredicted, capacity * sizeof(double));
+		if (grownUnpredicted == NULL)
+			return false;
+		errors->Unpredicted = grownUnpredicted;
+		errors->Capacity = capacity;
+	}
+	errors->Predicted[errors->Count] = predicted;
+	errors->Unpredicted[errors->Count] = unpredicted;
+	errors->Count++;
+	return true;
+}
+
+static void ReplayPrintErrors(const char *label, double *errors, size_t count) {
+	double sum = 0;
+
+	for (size_t i = 0; i < count; i++)
+		sum += errors[i];
+	qsort(errors, count, sizeof(double), ReplayCompareErrors);
+	printf("  %-8s %10.1f mean %10.1f p99 %10.1f max\n", label,
+		sum / count, errors[(count - 1) * 99 / 100], errors[count - 1]);
+}
+
+static void ReplayPrediction(const HOST_SEQUENCE *sequence) {
+	csgesture_softc *sc = &ReplaySoftc;
+	REPLAY_ERRORS errors = { 0 };
+	size_t head[ETP_MAX_FINGERS] = { 0 };
+	size_t pending[ETP_MAX_FINGERS] = { 0 };
+	ULONGLONG nowMs = 0;
+
+	//
+	// Each contact's position, led by predx and predy, is where the
+	// engine expects it predictms on; the first frame at or past that
+	// time is the ground truth, as the engine scores it itself. Only
+	// frames the engine processes move the clock, as in the driver.
+	//
+	ReplayResetEngine(sc);
+
+	for (size_t i = 0; i < sequence->Count; i++) {
+		ELAN_CAPTURE_RECORD *frame = HostRecord(sequence, i);
+
+		if (ElanClassifyReport(frame->Report) != ELAN_FRAME_VALID)
+			continue;
+
+		TrackpadRawInput(NULL, sc, frame->Report, frame->IntervalMs);
+		nowMs += sc->frameintervalms;
+
+		for (int contact = 0; contact < ETP_MAX_FINGERS; contact++) {
+			REPLAY_PREDICTION *ring = ReplayPending[contact];
+
+			if (sc->x[contact] == -1) {
+				pending[contact] = 0;
+				continue;
+			}
+
+			while (pending[contact] != 0 && ring[head[contact]].DueMs <= nowMs) {
+				REPLAY_PREDICTION *due = &ring[head[contact]];
+
+				ReplayAddError(&errors,
+					sqrt((double)distancesq(sc->x[contact] - due->X, sc->y[contact] - due->Y)),
+					sqrt((double)distancesq(sc->x[contact] - due->OriginX, sc->y[contact] - due->OriginY)));
+				head[contact] = (head[contact] + 1) % REPLAY_PREDICTIONS;
+				pending[contact]--;
+			}
+
+			// A full ring drops the oldest prediction unscored
+			if (pending[contact] == REPLAY_PREDICTIONS) {
+				head[contact] = (head[contact] + 1) % REPLAY_PREDICTIONS;
+				pending[contact]--;
+			}
+
+			REPLAY_PREDICTION *next = &ring[(head[contact] + pending[contact]) % REPLAY_PREDICTIONS];
+			next->DueMs = nowMs + ReplayPredictMs;
+			next->X = sc->x[contact] + sc->predx[contact];
+			next->Y = sc->y[contact] + sc->predy[contact];
+			next->OriginX = sc->x[contact];
+			next->OriginY = sc->y[contact];
+			pending[contact]++;
+		}
+	}
+
+	printf("  predict  %d ms ahead, %zu positions scored, error in pad units\n",
+		ReplayPredictMs, errors.Count);
+	if (errors.Count != 0) {
+		ReplayPrintErrors("led", errors.Predicted, errors.Count);
+		ReplayPrintErrors("unled", errors.Unpredicted, errors.Count);
+	}
+	printf("  engine   %llu predictions scored, %.1f rms error, %.1f rms unled\n",
+		(unsigned long long)sc->predictsamples,
+		sc->predictsamples ? sqrt((double)sc->predicterrorsq / sc->predictsamples) : 0.0,
+		sc->predictsamples ? sqrt((double)sc->unpredictederrorsq / sc->predictsamples) : 0.0);
+
+	free(errors.Predicted);
+	free(errors.Unpredicted);
+}
+
+static void ReplayReport(const char *name, const HOST_SEQUENCE *sequence, int passes, ULONGLONG timerCost) {
+	ULONGLONG stageNs[REPLAY_STAGES] = { 0 };
+	ULONGLONG stageFrames[REPLAY_STAGES] = { 0 };
+	double frames = (double)sequence->Count * passes;
+
+	// One untimed warm-up pass
+	ReplayThroughput(sequence, 1);
+
+	ULONGLONG total = ReplayThroughput(sequence, passes);
+	ReplayStages(sequence, passes, timerCost, stageNs, stageFrames);
+
+	double nsPerFrame = total / frames;
+	printf("%s: %zu frames x %d passes\n", name, sequence->Count, passes);
+	printf("  %-8s %10.1f ns/frame %12.0f frames/s\n", "replay",
+		nsPerFrame, nsPerFrame > 0 ? 1e9 / nsPerFrame : 0.0);
+	for (int stage = 0; stage < REPLAY_STAGES; stage++) {
+		printf("  %-8s %10.1f ns/frame %12.1f%% of frames\n", ReplayStageNames[stage],
+			stageNs[stage] / frames, 100.0 * stageFrames[stage] / frames);
+	}
+
+	if (ReplayPredictMs != 0)
+		ReplayPrediction(sequence);
+}
+
+static void ReplayUsage(void) {
+	fprintf(stderr,
+		"usage: elan-replay-bench [-p passes] [-i interval-us] [-P predict-ms] [sequence...]\n"
+		"  sequence: an ELAN capture file, or back-to-back %d byte reports;\n"
+		"            without one, each simulator script is replayed\n"
+		"  -p  passes over each sequence (default 20)\n"
+		"  -i  microseconds between raw or simulated reports, 500 for\n"
+		"      2 kHz (default %d)\n"
+		"  -P  lead pointer motion by up to %d milliseconds and score the\n"
+		"      predictions against the replay (default 0, off)\n",
+		ETP_MAX_REPORT_LEN, GESTURE_TICK_MS * 1000, GESTURE_MAX_PREDICT_MS);
+}
+
+int main(int argc, char **argv) {
+	int passes = 20;
+	int intervalUs = GESTURE_TICK_MS * 1000;
+	int option;
+
+	while ((option = getopt(argc, argv, "p:i:P:h")) != -1) {
+		switch (option) {
+		case 'p':
+			passes = atoi(optarg);
+			break;
+		case 'i':
+			intervalUs = atoi(optarg);
+			break;
+		case 'P':
+			ReplayPredictMs = atoi(optarg);
+			break;
+		default:
+			ReplayUsage();
+			return 2;
+		}
+	}
+	if (passes < 1 || intervalUs < 1 ||
+		ReplayPredictMs < 0 || ReplayPredictMs > GESTURE_MAX_PREDICT_MS) {
+		ReplayUsage();
+		return 2;
+	}
+
+	ULONGLONG timerCost = ReplayTimerCost();
+	printf("timer overhead %llu ns, subtracted from stage times\n", (unsigned long long)timerCost);
+
+	int failed = 0;
+	if (optind == argc) {
+		for (ULONG script = ELAN_SIM_SCRIPT_NONE + 1; script < ELAN_SIM_SCRIPT_COUNT; script++) {
+			HOST_SEQUENCE sequence;
+			char name[64];
+
+			if (!HostSimSequence(script, intervalUs, 10, &sequence)) {
+				failed = 1;
+				continue;
+			}
+			snprintf(name, sizeof(name), "sim %s", HostSimScriptNames[script]);
+			ReplayReport(name, &sequence, passes, timerCost);
+			HostFreeSequence(&sequence);
+		}
+	}
+	for (int i = optind; i < argc; i++) {
+		HOST_SEQUENCE sequence;
+
+		if (!HostLoadSequence(argv[i], intervalUs, &sequence)) {
+			failed = 1;
+			continue;
+		}
+		if (sequence.Count != 0)
+			ReplayReport(argv[i], &sequence, passes, timerCost);
+		HostFreeSequence(&sequence);
+	}
+	return failed;
+}
@@ -0,0 +1,100 @@
+#include "host.h"
+#include "spb.h"
+
+//
+// The register model runs on a virtual clock here: bus latency moves the
+// clock on instead of spinning, so a replay is deterministic and costs
+// no more than the model's own code.
+//
+
+ULONGLONG HostSimTime;
+
+static VOID HostSimStall(ULONG Microseconds) {
+	HostSimTime += Microseconds * 10ULL;
+}
+
+static ULONGLONG HostSimNow(VOID) {
+	return HostSimTime;
+}
+
+const ELAN_SIM_CLOCK ElanSimClock = {
+	HostSimStall,
+	HostSimNow
+};
+
+//
+// The kernel clocks spb.cpp and boot.cpp read run on the same virtual
+// time, so a boot or a retry backoff costs what the model says it does
+//
+
+LARGE_INTEGER KeQueryPerformanceCounter(LARGE_INTEGER *Frequency) {
+	LARGE_INTEGER now;
+
+	if (Frequency != NULL)
+		Frequency->QuadPart = 10000000;
+	now.QuadPart = (LONGLONG)HostSimTime;
+	return now;
+}
+
+VOID KeStallExecutionProcessor(ULONG Microseconds) {
+	HostSimStall(Microseconds);
+}
+
+VOID ElanSimAttach(SPB_CONTEXT *SpbContext, ELAN_SIM_DEVICE *Sim) {
+	SpbContext->Transport = &ElanSimTransport;
+	SpbContext->TransportContext = Sim;
+}
+
+const char *HostSimScriptNames[ELAN_SIM_SCRIPT_COUNT] = {
+	"none",
+	"move",
+	"tap",
+	"click-drag",
+	"scroll",
+	"pinch",
+	"swipe3",
+	"swipe4",
+	"palm",
+	"jitter5"
+};
+
+static NTSTATUS HostSimCommand(ELAN_SIM_DEVICE *sim, uint16_t reg, uint16_t value) {
+	uint8_t command[4] = { (uint8_t)reg, (uint8_t)(reg >> 8), (uint8_t)value, (uint8_t)(value >> 8) };
+
+	return ElanSimTransport.Write(sim, command, sizeof(command));
+}
+
+bool HostSimSequence(ULONG Script, ULONG IntervalUs, int Loops, HOST_SEQUENCE *Sequence) {
+	ELAN_SIM_DEVICE sim;
+
+	memset(Sequence, 0, sizeof(*Sequence));
+	if (Script == ELAN_SIM_SCRIPT_NONE || Script >= ELAN_SIM_SCRIPT_COUNT || IntervalUs < 1)
+		return false;
+
+	//
+	// Woken in absolute mode, as BOOTTRACKPAD leaves it
+	//
+	ElanSimInitialize(&sim);
+	HostSimCommand(&sim, ETP_I2C_STAND_CMD, ETP_I2C_WAKE_UP);
+	HostSimCommand(&sim, ETP_I2C_SET_CMD, ETP_ENABLE_ABS);
+	ElanSimRunScript(&sim, Script);
+
+	size_t count = (size_t)ElanSimScripts[Script].DurationUs * Loops / IntervalUs;
+	if (!HostAllocSequence(count, Sequence))
+		return false;
+
+	for (size_t i = 0; i < count; i++) {
+		ELAN_CAPTURE_RECORD *record = HostRecord(Sequence, i);
+		uint8_t pointer = 0;
+		ULONG_PTR bytesRead;
+
+		ULONGLONG previous = HostSimTime;
+
+		HostSimTime += IntervalUs * 10ULL;
+		ElanSimTransport.Write(&sim, &pointer, sizeof(pointer));
+		ElanSimTransport.Read(&sim, record->Report, ETP_MAX_REPORT_LEN, &bytesRead);
+		record->IntervalMs = HostIntervalMs(previous, HostSimTime);
+		record->Timestamp = HostSimTime;
+	}
+	return true;
+}